@@ -0,0 +1,352 @@
+#include "btree.h"
+#include "pager.h"
+#include "cursor.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+// ==========================================
+// FORGEDB BENCHMARK HARNESS
+// ==========================================
+// Drives BTree / Pager directly (no command parsing, no result printing) on a
+// scratch database, once per buffer pool size, and reports throughput and
+// per-operation latency percentiles for each workload:
+//
+//   seq_insert      ids 1..rows in order (its own database, dropped after)
+//   rand_insert     the odd keys 1, 3, ... 2*rows-1 in random order
+//   zipf_lookup     point lookups of present keys, zipfian (theta 0.99)
+//   miss_lookup     point lookups of absent (even) keys: the bloom filter's case
+//   range_<w>       scans of w consecutive rows from a random start
+//   mixed           80% zipf lookups, 10% inserts of new keys, 10% range_100,
+//                   on --threads threads
+//
+// Inserts commit every --commit-every operations; the commit's cost lands in
+// the latency of the insert that triggers it (hence the p99 / p999 tails).
+// Usage: forgedb_bench [--rows n] [--ops n] [--pools f,f,...] [--threads n]
+//                      [--commit-every n] [--seed n] [--dir path] [--only name]
+
+namespace {
+
+struct BenchOptions {
+    uint64_t rows = 100000;
+    uint64_t ops = 100000;
+    std::vector<uint32_t> pools = {64, 8192};  // Frames
+    uint32_t threads = 1;
+    uint32_t commit_every = 100;
+    uint64_t seed = 42;
+    std::string dir = "/tmp";
+    std::string only;  // Workload name prefix; empty = all
+};
+
+const double ZIPF_THETA = 0.99;
+const uint32_t MIX_LOOKUP_PCT = 80;
+const uint32_t MIX_INSERT_PCT = 10;  // The rest are range scans
+const uint64_t MIX_SCAN_WIDTH = 100;
+const uint64_t RANGE_WIDTHS[] = {10, 100, 1000};
+
+// --- Results ---
+
+struct Result {
+    std::string name;
+    double seconds = 0;
+    std::vector<uint64_t> latency_ns;  // One per operation
+};
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)std::ceil(p * sorted.size()) - 1;
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void report(Result& r) {
+    std::sort(r.latency_ns.begin(), r.latency_ns.end());
+    uint64_t ops = r.latency_ns.size();
+    double rate = r.seconds > 0 ? ops / r.seconds : 0;
+    std::printf("%-14s %9llu %12.0f %10.1f %10.1f %10.1f\n", r.name.c_str(), (unsigned long long)ops, rate,
+                percentile(r.latency_ns, 0.50) / 1000.0, percentile(r.latency_ns, 0.99) / 1000.0,
+                percentile(r.latency_ns, 0.999) / 1000.0);
+    std::fflush(stdout);
+}
+
+// Runs op(i) for i in [0, count), timing each call and the whole loop
+template <class Op> Result timed(const std::string& name, uint64_t count, Op op) {
+    Result r;
+    r.name = name;
+    r.latency_ns.reserve(count);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        op(i);
+        auto t1 = std::chrono::steady_clock::now();
+        r.latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+// Engine messages ("Executed.", "Bloom: MAYBE ...") are off at LOG_QUIET;
+// what is left (errors) is dropped: a stream without a buffer fails every
+// write at once.  One per thread.
+struct Quiet {
+    std::ostream sink{nullptr};
+    OutputCapture capture{sink};
+};
+
+// --- Key distributions ---
+
+Row make_row(uint64_t id) {
+    Row row;
+    std::memset(&row, 0, sizeof(Row));
+    row.id = id;
+    std::snprintf(row.username, sizeof(row.username), "user%llu", (unsigned long long)id);
+    std::snprintf(row.email, sizeof(row.email), "user%llu@example.com", (unsigned long long)id);
+    return row;
+}
+
+// Present keys are odd: rank i ↔ key 2i + 1.  Absent keys are even.
+uint64_t present_key(uint64_t rank) { return 2 * rank + 1; }
+
+// Zipfian ranks in [0, n) after Gray et al. ("Quickly Generating
+// Billion-Record Synthetic Databases"), as YCSB draws them.  Ranks are
+// scattered over the key space so the hot keys do not share leaves.
+class Zipf {
+    uint64_t n;
+    double alpha, zetan, eta, half_pow;
+public:
+    explicit Zipf(uint64_t items) : n(std::max<uint64_t>(items, 2)) {
+        double zeta2 = 1.0 + std::pow(0.5, ZIPF_THETA);
+        zetan = 0;
+        for (uint64_t i = 1; i <= n; i++) zetan += 1.0 / std::pow((double)i, ZIPF_THETA);
+        alpha = 1.0 / (1.0 - ZIPF_THETA);
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - ZIPF_THETA)) / (1.0 - zeta2 / zetan);
+        half_pow = 1.0 + std::pow(0.5, ZIPF_THETA);
+    }
+    uint64_t next(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan;
+        uint64_t rank;
+        if (uz < 1.0) rank = 0;
+        else if (uz < half_pow) rank = 1;
+        else rank = std::min<uint64_t>(n - 1, (uint64_t)(n * std::pow(eta * u - eta + 1.0, alpha)));
+        return (rank * 0x9E3779B97F4A7C15ull) % n;  // Scatter (a few ranks may land together)
+    }
+};
+
+// --- Workloads ---
+
+// Every commit_every-th insert commits the ones before it (one WAL commit)
+class Committer {
+    Pager& pager;
+    uint32_t every;
+    uint32_t pending = 0;
+public:
+    Committer(Pager& p, uint32_t n) : pager(p), every(n) {}
+    ~Committer() { pager.commit(); }
+    void inserted() {
+        if (++pending < every) return;
+        pager.commit();
+        pending = 0;
+    }
+};
+
+Result insert_all(BTree& tree, Pager& pager, const std::string& name, const std::vector<uint64_t>& keys,
+                  uint32_t commit_every) {
+    Committer committer(pager, commit_every);
+    return timed(name, keys.size(), [&](uint64_t i) {
+        Row row = make_row(keys[i]);
+        tree.insert(row.id, row);
+        committer.inserted();
+    });
+}
+
+// width rows from the first key ≥ start, read through a snapshot like a
+// select / range command
+void scan_rows(BTree& tree, uint64_t start, uint64_t width) {
+    Snapshot snap(tree.get_pager());
+    ScanOptions opts;
+    opts.start = start;
+    opts.limit = width;
+    opts.snapshot = &snap;
+    RowCursor cursor(tree, opts);
+    std::vector<RowView> batch;
+    while (cursor.next_batch(batch) > 0) {}
+}
+
+// Each thread runs ops / threads operations of the mix; the latencies are
+// pooled and the rate is over the wall-clock time of all of them
+Result mixed(BTree& tree, Pager& pager, const BenchOptions& opt, const Zipf& zipf) {
+    std::atomic<uint64_t> next_rank{opt.rows};  // New keys go past the loaded ones
+    std::vector<Result> parts(opt.threads);
+    auto work = [&](uint32_t t) {
+        Quiet quiet;
+        std::mt19937_64 rng(opt.seed + 1 + t);
+        Committer committer(pager, opt.commit_every);
+        parts[t] = timed("mixed", opt.ops / opt.threads, [&](uint64_t) {
+            uint32_t pick = rng() % 100;
+            if (pick < MIX_LOOKUP_PCT) {
+                Row row;
+                tree.find_row(present_key(zipf.next(rng)), row);
+            } else if (pick < MIX_LOOKUP_PCT + MIX_INSERT_PCT) {
+                Row row = make_row(present_key(next_rank++));
+                tree.insert(row.id, row);
+                committer.inserted();
+            } else {
+                scan_rows(tree, present_key(rng() % opt.rows), MIX_SCAN_WIDTH);
+            }
+        });
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t t = 1; t < opt.threads; t++) threads.emplace_back(work, t);
+    work(0);
+    for (std::thread& th : threads) th.join();
+
+    Result total;
+    total.name = opt.threads > 1 ? "mixed_x" + std::to_string(opt.threads) : "mixed";
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (Result& p : parts) total.latency_ns.insert(total.latency_ns.end(), p.latency_ns.begin(), p.latency_ns.end());
+    return total;
+}
+
+bool wanted(const BenchOptions& opt, const std::string& name) {
+    return opt.only.empty() || name.compare(0, opt.only.size(), opt.only) == 0;
+}
+
+void remove_db(const std::string& path) {
+    ::unlink(path.c_str());
+    ::unlink((path + "-wal").c_str());
+}
+
+void run_pool(const BenchOptions& opt, uint32_t frames, const Zipf& zipf) {
+    std::string path = opt.dir + "/forgedb-bench-" + std::to_string(::getpid()) + ".db";
+    PagerConfig config;
+    config.pool_frames = frames;
+    std::printf("\n=== Pool: %u frames (%u KB), %llu rows ===\n", frames, frames * (PAGE_SIZE_DEFAULT >> 10),
+                (unsigned long long)opt.rows);
+    std::printf("%-14s %9s %12s %10s %10s %10s\n", "workload", "ops", "ops/s", "p50 us", "p99 us", "p999 us");
+
+    remove_db(path);
+    if (wanted(opt, "seq_insert")) {
+        std::vector<uint64_t> keys(opt.rows);
+        for (uint64_t i = 0; i < opt.rows; i++) keys[i] = i + 1;
+        Pager pager(path, config);
+        BTree tree(pager);
+        Result r = insert_all(tree, pager, "seq_insert", keys, opt.commit_every);
+        report(r);
+    }
+    remove_db(path);
+
+    // One table for the rest: rand_insert loads what they read
+    {
+        Pager pager(path, config);
+        BTree tree(pager);
+        std::mt19937_64 rng(opt.seed);
+        std::vector<uint64_t> keys(opt.rows);
+        for (uint64_t i = 0; i < opt.rows; i++) keys[i] = present_key(i);
+        std::shuffle(keys.begin(), keys.end(), rng);
+        Result r = insert_all(tree, pager, "rand_insert", keys, opt.commit_every);
+        if (wanted(opt, "rand_insert")) report(r);
+
+        if (wanted(opt, "zipf_lookup")) {
+            r = timed("zipf_lookup", opt.ops, [&](uint64_t) {
+                Row row;
+                tree.find_row(present_key(zipf.next(rng)), row);
+            });
+            report(r);
+        }
+        if (wanted(opt, "miss_lookup")) {
+            r = timed("miss_lookup", opt.ops, [&](uint64_t) {
+                Row row;
+                tree.find_row(2 * (rng() % opt.rows) + 2, row);
+            });
+            report(r);
+        }
+        for (uint64_t width : RANGE_WIDTHS) {
+            std::string name = "range_" + std::to_string(width);
+            if (!wanted(opt, name)) continue;
+            uint64_t scans = std::max<uint64_t>(1, std::min(opt.ops, opt.ops * 10 / width));
+            r = timed(name, scans, [&](uint64_t) { scan_rows(tree, present_key(rng() % opt.rows), width); });
+            report(r);
+        }
+        if (wanted(opt, "mixed")) {
+            r = mixed(tree, pager, opt, zipf);
+            report(r);
+        }
+    }
+    remove_db(path);
+}
+
+bool parse_u64(const char* text, uint64_t& out) {
+    char* end = nullptr;
+    unsigned long long n = std::strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || n == 0) return false;
+    out = n;
+    return true;
+}
+
+bool parse_u32(const char* text, uint32_t max, uint32_t& out) {
+    uint64_t n;
+    if (!parse_u64(text, n) || n > max) return false;
+    out = n;
+    return true;
+}
+
+bool parse_pools(const char* text, std::vector<uint32_t>& pools) {
+    pools.clear();
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        uint64_t n;
+        if (!parse_u64(item.c_str(), n) || n < BUFFER_POOL_MIN || n > 0xFFFFFFFFull) return false;
+        pools.push_back(n);
+    }
+    return !pools.empty();
+}
+
+}  // namespace
+
+// ==========================================
+// MAIN DRIVER
+// ==========================================
+int main(int argc, char* argv[]) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = value != nullptr;
+        if (ok && flag == "--rows")              ok = parse_u64(value, opt.rows);
+        else if (ok && flag == "--ops")          ok = parse_u64(value, opt.ops);
+        else if (ok && flag == "--pools")        ok = parse_pools(value, opt.pools);
+        else if (ok && flag == "--threads")      ok = parse_u32(value, 1024, opt.threads);
+        else if (ok && flag == "--commit-every") ok = parse_u32(value, 1000000, opt.commit_every);
+        else if (ok && flag == "--seed")         ok = parse_u64(value, opt.seed);
+        else if (ok && flag == "--dir")          opt.dir = value;
+        else if (ok && flag == "--only")         opt.only = value;
+        else ok = false;
+        if (!ok) {
+            std::cerr << "Usage: forgedb_bench [--rows n] [--ops n] [--pools frames,frames,...] [--threads n]\n"
+                      << "                     [--commit-every n] [--seed n] [--dir path] [--only workload]\n";
+            return 1;
+        }
+        i++;
+    }
+
+    set_log_level(LOG_QUIET);
+    Quiet quiet;
+    std::printf("ForgeDB benchmark: %llu rows, %llu ops, %u thread(s) in mixed, commit every %u insert(s)\n",
+                (unsigned long long)opt.rows, (unsigned long long)opt.ops, opt.threads, opt.commit_every);
+    Zipf zipf(opt.rows);
+    for (uint32_t frames : opt.pools) run_pool(opt, frames, zipf);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "common.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ==========================================
+// CLASS: ASYNC READER (Read-Ahead Backend)
+// ==========================================
+// Background page reads into a small set of staging slots.  The Pager submits
+// pages it expects to need soon; a later cache miss on a staged page waits for
+// (or immediately takes) the finished read instead of issuing a blocking pread.
+//
+// Backend: a fixed pool of worker threads issuing pread().  Workers only ever
+// touch their own slot buffer, so the buffer pool stays single-threaded.
+class AsyncReader {
+    enum SlotState : uint8_t { SLOT_FREE, SLOT_QUEUED, SLOT_READING, SLOT_READY };
+
+    struct Slot {
+        uint32_t page_num = 0;
+        SlotState state = SLOT_FREE;
+        bool ok = false;
+        uint64_t seq = 0;  // Submission order — the oldest READY slot is reclaimed first
+    };
+
+    int fd = -1;
+    uint8_t* buffers = nullptr;  // slots.size() pages, page-aligned
+    std::vector<Slot> slots;
+    std::deque<uint32_t> queue;  // Slot indices waiting for a worker
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable work_cv;  // Worker wake-up
+    std::condition_variable done_cv;  // Read completion
+    uint64_t next_seq = 0;
+    bool stopping = false;
+
+    uint8_t* slot_data(uint32_t idx) { return buffers + (size_t)idx * PAGE_SIZE; }
+    int find_slot(uint32_t page_num) const;
+    void worker_loop();
+
+public:
+    AsyncReader() = default;
+    ~AsyncReader();
+
+    void start(int file_fd, uint32_t num_slots, uint32_t num_threads);
+    void stop();
+    bool running() const { return !workers.empty(); }
+
+    // Queue a read of page_num from the main file.  FALSE if already staged
+    // or every slot is busy.
+    bool submit(uint32_t page_num);
+
+    // If page_num is staged, wait for its read, copy it to dest, release the
+    // slot and return TRUE.
+    bool take(uint32_t page_num, void* dest);
+
+    // Drop every staged page (the main file is about to change under them).
+    void discard();
+};
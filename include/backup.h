@@ -0,0 +1,74 @@
+#pragma once
+#include "pager.h"
+#include <string>
+#include <vector>
+
+// Counters reported by .backup
+struct BackupStats {
+    uint64_t lsn = 0;           // DbHeader.commit_lsn the copy is consistent with
+    uint64_t base_lsn = 0;      // Incremental: changes after this LSN were copied
+    uint32_t pages_copied = 0;
+    uint32_t pages_free = 0;    // Skipped: free at the backup's LSN
+    uint32_t pages_unchanged = 0;  // Incremental: skipped, not logged since base_lsn
+    uint32_t from_versions = 0; // Pages changed while the backup ran, taken from kept images
+    uint32_t reads = 0;         // pread() calls on the main file
+    uint32_t rereads = 0;       // Of those, repeated because a checkpoint ran meanwhile
+    double seconds = 0;
+};
+
+// Incremental backup file: this header, then num_pages records of
+// [page_num:4][reserved:4][page image].  Applied in order on top of a full
+// backup (or an earlier increment) whose commit_lsn is base_lsn.
+struct BackupDeltaHeader {
+    uint32_t magic;        // BACKUP_DELTA_MAGIC
+    uint32_t page_size;
+    uint32_t total_pages;  // DbHeader.total_pages at lsn: the restored file's length
+    uint32_t num_pages;
+    uint64_t base_lsn;
+    uint64_t lsn;
+};
+
+// ==========================================
+// CLASS: BACKUP (Online Snapshot Backups)
+// ==========================================
+// Copies the database as it stood at one commit while readers and writers
+// carry on.  The backup starts with a short write operation: it commits,
+// records the header, the free pages and the pages kept outside the pool
+// (bloom filter, free-space map, header), and opens a snapshot.  From then on
+// a writer keeps a page's image before changing it (see Pager, "Snapshots"),
+// so each page is taken from, in order: its kept image, its frame in the
+// pool, its newest WAL frame, or the main file.  The main file is read in
+// runs of up to BACKUP_RUN_PAGES pages with one pread() per run, without
+// pool_mutex; the pool and the WAL are consulted for the run afterwards, and
+// the run is read again if a checkpoint began in between.
+//
+// Images read from the WAL or the main file have their checksums verified (a
+// mismatch aborts the backup); images from memory are stamped.  Free pages
+// are not copied.
+//
+//   full         a database file, written to <path>.tmp and renamed into
+//                place; free pages are left as holes.  Open it directly or
+//                restore it with --restore.
+//   incremental  only the pages logged since the last backup's LSN
+//                (DbHeader.backup_lsn), as a BackupDeltaHeader file.  Needs
+//                the changes since then to be tracked (Pager, "Change
+//                Tracking"); after a crash before the first checkpoint, or
+//                with a lost "<db>-changes", take a full backup instead.
+class Backup {
+    Pager& pager;
+    BackupStats st;
+
+    bool copy(const std::string& path, bool incremental);
+
+public:
+    explicit Backup(Pager& p) : pager(p) {}
+
+    bool full(const std::string& path);
+    bool incremental(const std::string& path);
+    const BackupStats& stats() const { return st; }
+};
+
+// Rebuilds db_path from a full backup followed by increments, in order
+// (increment pages are verified), then removes its stale WAL and change
+// file.  Run while no process has the database open.
+bool restore_backup(const std::string& db_path, const std::vector<std::string>& files);
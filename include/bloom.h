@@ -1,36 +1,77 @@
 #pragma once
 #include "common.h"
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
 
 // ==========================================
 // CLASS: BLOOM FILTER (Probabilistic Index)
 // ==========================================
-// Stored on Page 0 after the DbHeader.  Persisted automatically via page cache.
-// On startup, rebuilt by scanning all leaf nodes (handles migration + stale bits
-// from deletes).  3 hash functions → very low false-positive rate at ForgeDB scale.
+// Blocked ("split-block") layout: the bit array is cut into 64-byte blocks,
+// one cache line each.  A key hashes to one block and sets one bit in each of
+// its eight 64-bit words, so a probe reads exactly one cache line and is a
+// single mask compare (AVX2 when the CPU has it, scalar otherwise).
 //
-// Layout of Page 0:
-//   [DbHeader: 20 bytes][Bloom bit-array: 4076 bytes (32 608 bits)]
+// The filter occupies a contiguous run of dedicated pages recorded in the
+// DbHeader (bloom_first_page / bloom_pages / bloom_capacity).  The BTree sizes
+// it from the row count and rebuilds it into a new run once the tree outgrows
+// it.  The live bits are kept in memory, not in the buffer pool: pages changed
+// since the last commit are handed to Pager::commit() through its commit hook,
+// so they are logged in the same group as the rows they describe.
+//
+// Bits are read and set with relaxed atomics: readers probe the filter while
+// the writer thread adds keys.  A table replaced by a larger one stays
+// allocated until shutdown because readers may still be probing it.
+//
+// Layout of a bloom page:
+//   [type=NODE_BLOOM:1][unused:1][crc32:4][padding to 64][blocks: 63 × 64 bytes at 4 KB]
 
 class BloomFilter {
-    uint8_t* bits;
+public:
+    struct Table {
+        uint64_t* words = nullptr;   // num_blocks × BLOOM_BLOCK_WORDS, 64-byte aligned
+        uint32_t num_blocks = 0;
+        uint32_t first_page = 0;
+        uint32_t num_pages  = 0;
+        std::vector<uint8_t> dirty;  // Per page: changed since the last commit
+        ~Table();
+    };
 
-    uint32_t hash1(uint32_t k) const;
-    uint32_t hash2(uint32_t k) const;
-    uint32_t hash3(uint32_t k) const;
+private:
+    std::atomic<Table*> live{nullptr};
+    std::vector<std::unique_ptr<Table>> tables;  // live + superseded
+    std::vector<uint8_t> images;                 // Page images of the last collect_dirty()
 
-    void set_bit(uint32_t pos) { bits[pos / 8] |= (1 << (pos % 8)); }
-    bool get_bit(uint32_t pos) const { return bits[pos / 8] & (1 << (pos % 8)); }
+    static bool set_bits(Table& t, uint64_t key, uint32_t& block);  // TRUE if any bit was newly set
 
 public:
-    BloomFilter() : bits(nullptr) {}
+    // --- Sizing ---
+    static uint32_t blocks_per_page() { return (PAGE_SIZE - BLOOM_PAGE_HEADER) / BLOOM_BLOCK_SIZE; }
+    static uint32_t capacity_of(uint32_t num_pages);  // Keys at BLOOM_BITS_PER_KEY
+    static uint32_t pages_for(uint64_t keys);
+    static std::unique_ptr<Table> make_table(uint32_t num_pages);
 
-    void attach(void* page0);
-    void add(uint32_t key);
+    // --- Building (private tables, before install) ---
+    static void add_to(Table& t, uint64_t key) { uint32_t block; set_bits(t, key, block); }
+    static bool read_page(Table& t, uint32_t index, const void* page);  // FALSE if not a bloom page
+
+    // Makes t the live table on pages [first_page, first_page + num_pages).
+    // Onto the same run the bits are copied word by word, so a concurrent
+    // probe never misses a key both tables hold.
+    void install(std::unique_ptr<Table> t, uint32_t first_page, bool dirty);
+    bool attached() const { return live.load(std::memory_order_acquire) != nullptr; }
+    void move_to(uint32_t first_page);  // Writer: same bits, every page rewritten on a new run
+
+    void add(uint64_t key);  // Writer only; the filter must be attached
 
     // Returns TRUE  → "maybe present"  (must verify in B+Tree)
     // Returns FALSE → "definitely not present"  (skip B+Tree entirely)
-    bool possibly_contains(uint32_t key) const;
+    bool possibly_contains(uint64_t key) const;
+
+    // Page images of every page changed since the last call (commit hook).
+    // The pointers stay valid until the next call.
+    void collect_dirty(std::vector<std::pair<uint32_t, const void*>>& out);
 
-    void clear();
     void print_stats() const;
 };
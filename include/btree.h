@@ -2,12 +2,29 @@
 #include "pager.h"
 #include "node.h"
 #include "bloom.h"
+#include "utils.h"
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Counters filled in by BTree::find_rows()
+struct LookupStats {
+    uint32_t requested      = 0;  // Distinct keys asked for
+    uint32_t bloom_rejected = 0;  // Answered by the bloom filter alone
+    uint32_t pages_visited  = 0;  // Tree pages latched (each at most once)
+    uint32_t leaves_visited = 0;
+};
 
 // ==========================================
 // CLASS: B+ TREE (Logic)
 // ==========================================
 class BTree {
+    friend class RowCursor;  // Streaming scans (cursor.h) walk the leaves directly
+    friend class Vacuum;     // Relocates pages and rewires the pointers to them (vacuum.h)
+    friend class ParallelScan;  // Splits a scan at the upper levels' separators (scan.h)
+
     Pager& pager;
     uint32_t root_page_num;
     BloomFilter bloom;
@@ -18,15 +35,97 @@ class BTree {
         std::vector<uint32_t> path_stack;
     };
 
-    Cursor find(uint32_t key);
+    // --- Latch crabbing ---
+    // Readers descend with shared latches, latching each child before letting
+    // go of its parent, and walk next_leaf the same way (always left → right).
+    // The writer (one at a time, see WriteOp) descends with exclusive latches
+    // and drops its ancestors as soon as a child is safe: an insert cannot
+    // split it, a delete cannot make it underflow.  Ancestors it keeps are
+    // exactly the nodes a split or merge may still touch.
+    enum WriteIntent { WRITE_INSERT, WRITE_DELETE };
+    std::vector<PageHandle> write_latches;  // Held by the writer, top-down
+
+    // Releases the writer's latches on scope exit.  Declare after the WriteOp
+    // so the latches are dropped before the op's page pins.
+    struct LatchScope {
+        BTree& tree;
+        ~LatchScope() { tree.release_write_latches(); }
+    };
+
+    // Leaf that may hold key, S-latched.  lower_fence receives the separator
+    // every key in that leaf is ≥ (0 for the leftmost leaf).
+    PageHandle find_shared(uint64_t key, uint64_t* lower_fence = nullptr);
+    // The same descent through a snapshot: each node is copied into dest
+    // (PAGE_SIZE bytes) in turn, ending with the leaf; returns its page.
+    uint32_t find_in_snapshot(const Snapshot& snap, uint64_t key, void* dest, uint64_t* lower_fence = nullptr);
+    bool step_right(PageHandle& leaf);      // Move to next_leaf; FALSE (released) at the end
+    Cursor find_for_write(uint64_t key, WriteIntent intent, uint16_t row_size, uint32_t root = ROOT_PAGE);
+    bool safe_for_write(void* node_raw, WriteIntent intent, uint64_t key, uint16_t row_size);
+    void latch_for_write(uint32_t page_num);  // X-latch a page not yet held
+    void release_write_latches(size_t keep_last = 0);
+    bool try_latch_parent(uint32_t leaf_page, uint64_t key, PageHandle& out);
+
+    // Scan read-ahead: position of the current leaf in its parent's child list.
+    // Leaves further right in the same parent are prefetched in groups.
+    struct ReadAhead {
+        uint32_t parent = 0;     // 0 = unknown, re-derive from the next leaf
+        uint32_t child_idx = 0;  // Index of the current leaf in parent
+        uint32_t issued_to = 0;  // Children up to this index have been prefetched
+    };
+    void read_ahead(uint32_t leaf_page, void* leaf_data, ReadAhead& ra);  // Latched leaf or a copy
+
+    // Scan partitioning: separator keys inside (start, end] that split it
+    // into at most `parts` ranges (each key starts one), ascending.  They come
+    // from the highest levels that have enough of them, so the ranges cover
+    // similar numbers of leaves; a small tree yields fewer.
+    std::vector<uint64_t> split_points(uint64_t start, uint64_t end, uint32_t parts);
+    void collect_separators(PageHandle& node, uint32_t depth, uint64_t start, uint64_t end,
+                            std::vector<uint64_t>& out);
 
-    void split_leaf(Cursor& cursor, uint32_t new_key, Row& new_row);
+    void split_leaf(Cursor& cursor, uint64_t new_key, const uint8_t* new_rec, uint16_t new_len);
     void split_internal(uint32_t internal_page, uint32_t child_index,
-                        uint32_t new_key, uint32_t new_child_page,
+                        uint64_t new_key, uint32_t new_child_page,
                         std::vector<uint32_t>& path);
 
     uint32_t find_child_index(InternalNode& parent, uint32_t child_page);
 
+    // (min key, page) of every node on one level — input to the next level up
+    typedef std::vector<std::pair<uint64_t, uint32_t>> LevelList;
+    LevelList bulk_build_leaves(const std::vector<Row>& rows, uint32_t fill_percent);
+    LevelList bulk_build_internals(const LevelList& children, uint32_t fill_percent, uint32_t root);
+    void build_root(LevelList level, uint32_t root);  // Levels above the leaves, ending at root
+
+    // Appends records in key order to a chain of new leaves, each filled up
+    // to budget bytes (bulk load, and the rebuild of a format 6 tree)
+    struct LeafPacker {
+        BTree& tree;
+        uint32_t budget;
+        LevelList leaves;
+        uint32_t used = 0;
+        void add(uint64_t key, const uint8_t* rec, uint16_t len);
+    };
+    void upgrade_format();  // Older formats → DB_FORMAT_VERSION, on open
+    void widen_keys();      // Format 6 tree (32-bit keys) → 64-bit keys
+
+    // --- Secondary indexes ---
+    // An index entry's key is make_key(crc32c of the value, low half of the
+    // row's id); its record is [id:8][value].  A key already taken by another
+    // row moves on to the next low half, so entries are found by scanning the
+    // value's bucket (all keys with its hash) and comparing id and value.
+    // Index readers latch the table root first: whoever moves or frees index
+    // pages (vacuum, drop_index) holds it exclusively meanwhile.
+    struct IndexEntry {
+        uint64_t key;
+        uint64_t id;
+        std::string_view value;  // Into the source row
+    };
+    static uint32_t index_hash(std::string_view value);
+    template <class Visit> void scan_index(IndexColumn column, uint64_t from, Visit visit);
+    void index_add(IndexColumn column, uint64_t id, std::string_view value);
+    void index_remove(IndexColumn column, uint64_t id, std::string_view value);
+    void build_index(IndexColumn column, std::vector<IndexEntry>& entries);  // Replaces its contents
+    void collect_pages(uint32_t root, std::vector<uint32_t>& pages);  // Every page of a tree
+
     void rebalance_leaf(uint32_t page_num, std::vector<uint32_t>& path);
     void merge_leaves(uint32_t left_page, uint32_t right_page,
                       uint32_t parent_page, uint32_t sep_idx,
@@ -37,25 +136,74 @@ class BTree {
                          uint32_t parent_page, uint32_t sep_idx,
                          std::vector<uint32_t>& path);
 
-    void _print_tree(uint32_t page_num, uint32_t level);
-    void _print_json(uint32_t page_num);
+    void probe_subtree(PageHandle& node, const uint64_t* keys, size_t count,
+                       std::vector<Row>& out, LookupStats& stats);
 
-    void rebuild_bloom();
+    void _print_tree(const Snapshot& snap, uint32_t page_num, uint32_t level);
+    void _print_json(const Snapshot& snap, uint32_t page_num, OutputBuffer& out);
+
+    // --- Bloom maintenance ---
+    // bloom_ready is FALSE while the filter may miss keys: until the persisted
+    // pages are loaded, or until the first rebuild of a file that has none
+    // (migrated from an older format); lookups then skip the filter.  Loading,
+    // rebuilding into a larger run and clearing bits left by deletes all run
+    // on a background thread while the live filter stays in use.  Keys added
+    // before the filter is attached, or while a rebuild scans a snapshot
+    // (bloom_recording), wait in pending_bloom_keys.  Lookups wait for a load
+    // (a read of the filter's pages), never for a rebuild; writers wait for
+    // neither, only for installing the result.
+    std::atomic<bool> bloom_ready{false};
+    bool bloom_loading = false;
+    std::mutex bloom_mutex;
+    std::condition_variable bloom_cv;  // Signalled when bloom_loading clears
+    std::atomic<bool> rebuild_running{false};
+    std::atomic<bool> rebuild_stop{false};
+    std::thread rebuild_thread;
+    std::vector<uint64_t> pending_bloom_keys;
+    bool bloom_recording = false;
+    std::atomic<uint64_t> stat_bloom_negatives{0};
+    std::atomic<uint64_t> stat_bloom_false_positives{0};
+
+    void bloom_add(uint64_t key);
+    void wait_for_bloom_load();  // Never while holding the writer lock
+    void install_bloom(std::unique_ptr<BloomFilter::Table> table);  // Writer: new run if resized
+    bool bloom_rebuild_due() const;
+    void schedule_bloom_rebuild(bool load_first = false);
+    bool load_bloom(uint32_t first_page, uint32_t num_pages);  // FALSE if unreadable or abandoned
+    bool rebuild_bloom();  // FALSE if abandoned at shutdown
+    double measure_bloom_fpr(uint32_t& probes);
 
 public:
+    // Lookups, scans and printing may run on any number of threads at once;
+    // insert/remove/bulk_load/batches are serialized against each other.
     BTree(Pager& p);
+    ~BTree();
 
-    void insert(uint32_t id, Row& row);
-    bool remove(uint32_t id);
+    bool insert(uint64_t id, Row& row);  // FALSE on a duplicate key
+    uint32_t bulk_load(std::vector<Row>& rows, uint32_t fill_percent = BULK_FILL_DEFAULT);
+
+    // --- Batches: every operation between begin and commit shares one WAL commit ---
+    bool begin_batch();
+    bool commit_batch();
+    bool remove(uint64_t id);
 
     void print_tree();
     void print_json();
-    void select_all();
-    void range_scan(uint32_t start, uint32_t end);
     uint32_t get_leftmost_leaf();
+    Pager& get_pager() { return pager; }  // For a Snapshot of the tree's pages
 
     // --- Bloom Filter public API ---
-    bool find_row(uint32_t id, Row& out_row);
+    bool find_row(uint64_t id, Row& out_row);
+    // Batched point lookup: the rows of every id present, in key order
+    std::vector<Row> find_rows(const std::vector<uint64_t>& ids, LookupStats* stats = nullptr);
     void print_bloom_stats();
     void do_rebuild_bloom();
+
+    // --- Secondary indexes (username / email → id) ---
+    bool has_index(IndexColumn column) const { return pager.header.index_roots[column] != 0; }
+    bool create_index(IndexColumn column);  // Indexes the rows already present
+    bool drop_index(IndexColumn column);
+    // Ids of the rows whose column holds value, in ascending order
+    std::vector<uint64_t> index_lookup(IndexColumn column, std::string_view value);
+    void print_indexes();
 };
@@ -0,0 +1,25 @@
+#pragma once
+#include "btree.h"
+#include "pager.h"
+#include <string>
+#include <vector>
+
+// ==========================================
+// COMMAND DISPATCH (REPL, script and server modes)
+// ==========================================
+// One command line in, its output written to output().  Outside a batch,
+// every command that may modify the database is committed on its own.
+void handle_command(const std::string& input, BTree& tree, Pager& pager);
+
+// TRUE for commands that only read (lookups, scans, printing, stats): they
+// are never committed and may run concurrently with each other and a writer.
+bool is_read_command(const std::string& input);
+
+// TRUE for commands that commit their own work in short steps (.vacuum), or
+// hold the writer only briefly (.backup).
+// Server mode runs them outside the write session, so other connections'
+// writes get in between the steps.
+bool is_stepwise_command(const std::string& input);
+
+// One row per line: <id> <username> <email>  (same fields as `insert`).
+bool read_rows_file(const char* path, std::vector<Row>& rows);
@@ -1,82 +1,252 @@
 #pragma once
 #include <cstdint>
 #include <cstring>
+#include <string_view>
 
 // ==========================================
 // CONSTANTS & CONFIGURATION
 // ==========================================
-const uint32_t PAGE_SIZE = 4096;
-const uint32_t BUFFER_POOL_SIZE = 100;  // Max page frames in RAM (LRU eviction beyond this)
-                                        // Must be ≥ tree height + max pages touched per operation (~10)
+// Page size is chosen when a database is created and persisted in
+// DbHeader.page_size; the Pager calls set_page_size() before touching any page.
+// 32 KB is the ceiling because leaf slot offsets are uint16_t.
+const uint32_t PAGE_SIZE_DEFAULT = 4096;
+const uint32_t PAGE_SIZE_MIN     = 1024;
+const uint32_t PAGE_SIZE_MAX     = 32768;
+
+// Buffer pool capacity in frames (see PagerConfig for the startup options)
+const uint32_t BUFFER_POOL_DEFAULT = 100;
+const uint32_t BUFFER_POOL_MIN     = 16;  // ≥ tree height + max pages touched per operation (~10)
+
+// Asynchronous I/O: leaves prefetched ahead of a scan, reader threads, and how
+// many dirty frames near the eviction end are written back in one WAL append
+const uint32_t READAHEAD_DEFAULT  = 8;
+const uint32_t IO_THREADS_DEFAULT = 4;
+const uint32_t EVICT_WRITE_BATCH  = 8;
+
+// Parallel scans: key ranges per worker thread.  More ranges than workers
+// even out the ones that hit slower pages, and let the first range's rows
+// go out while the last are still being read.
+const uint32_t SCAN_PARTITIONS_PER_THREAD = 4;
+
+// Server mode: default TCP port, socket read size, and the longest command
+// line accepted before a connection is dropped
+const uint32_t SERVER_PORT_DEFAULT = 7070;
+const uint32_t SERVER_READ_CHUNK   = 64 * 1024;
+const uint32_t SERVER_MAX_LINE     = 1024 * 1024;
+
+// Result streaming: rows handed out per RowCursor batch, and how many bytes of
+// formatted output collect before they are written to output()
+const uint32_t CURSOR_BATCH_DEFAULT = 256;
+const uint32_t OUTPUT_BUFFER_SIZE   = 64 * 1024;
+const uint32_t SCRIPT_OUTPUT_BUFFER = 1024 * 1024;  // Script mode's stdout buffer (FdOutputStream)
+
+// Background checksum verification: page copies that may wait for the
+// verifier thread before further reads go unchecked (see PageVerifier)
+const uint32_t VERIFY_QUEUE_SLOTS = 64;
+
+// Page geometry — fixed for the lifetime of the process once the database
+// is opened.  Everything derived from the page size lives here.
+inline uint32_t PAGE_SIZE = PAGE_SIZE_DEFAULT;
+
+// Keys are 64-bit.  A composite key packs its parts most significant first,
+// so numeric order is their lexicographic order; "hi:lo" in commands and SQL.
+inline uint64_t make_key(uint32_t hi, uint32_t lo) { return (uint64_t)hi << 32 | lo; }
 
 struct Row {
-    uint32_t id;
+    uint64_t id;
     char username[32];
     char email[255];
 };
 
+// Zero-copy view of a row stored in a leaf: username and email point into the
+// page, so a view is only valid while that page stays pinned and latched.
+struct RowView {
+    uint64_t id;
+    std::string_view username;
+    std::string_view email;
+
+    Row to_row() const;  // Copies the row out of the page
+};
+
 // Node Types
 const uint8_t NODE_INTERNAL = 0;
 const uint8_t NODE_LEAF = 1;
 const uint8_t NODE_FREE = 2;  // Freed page marker (prevents CRC stamping)
+const uint8_t NODE_BLOOM = 3; // Bloom filter page (see bloom.h)
+const uint8_t NODE_FSM = 4;   // Free-space map page (see fsm.h)
 
 // Common Header Layout  [type:1][is_root:1][crc32:4] = 6 bytes
 // Parent pointers intentionally omitted — stack-based traversal (path_stack)
 // avoids expensive recursive parent updates during splits/merges.
 const uint32_t OFFSET_TYPE     = 0;
 const uint32_t OFFSET_IS_ROOT  = OFFSET_TYPE + 1;
-const uint32_t OFFSET_CHECKSUM = OFFSET_IS_ROOT + 1;  // CRC32 page integrity (4 bytes)
+const uint32_t OFFSET_CHECKSUM = OFFSET_IS_ROOT + 1;  // Page checksum, DbHeader.checksum_algo (4 bytes)
 const uint32_t HEADER_SIZE     = OFFSET_CHECKSUM + 4;  // 6 bytes common header
 
 // Slotted Leaf Layout (B-Link: leaves form a singly-linked list)
 // Header: [type:1][is_root:1][crc32:4][num_cells:4][data_end:2][total_free:2][next_leaf:4] = 18 bytes
 // Slot directory grows down (towards higher addresses) from header.
-// Each slot: [offset:u16][length:u16] = 4 bytes.  Points to a record.
+// Each slot: [offset:u16][length:u16][key:u64] = 12 bytes.  Points to a record.
+// The key lives in the slot, not the record, so a search scans the directory
+// without touching the records.
 // Records grow up from the bottom of the page.
 const uint32_t OFFSET_LEAF_NUM_CELLS  = HEADER_SIZE;       // uint32_t @ byte 6
 const uint32_t OFFSET_LEAF_DATA_END   = HEADER_SIZE + 4;   // uint16_t @ byte 10
 const uint32_t OFFSET_LEAF_TOTAL_FREE = HEADER_SIZE + 6;   // uint16_t @ byte 12
 const uint32_t OFFSET_LEAF_NEXT       = HEADER_SIZE + 8;   // uint32_t @ byte 14 (→ next leaf)
 const uint32_t LEAF_HEADER_SIZE       = HEADER_SIZE + 12;  // 18 bytes total
-const uint32_t SLOT_SIZE = 4;  // per-slot overhead
-const uint32_t LEAF_USABLE_SPACE = PAGE_SIZE - LEAF_HEADER_SIZE;
+const uint32_t SLOT_SIZE = 12;  // per-slot overhead
+const uint32_t SLOT_KEY  = 4;  // Key offset within a slot
+inline uint32_t LEAF_USABLE_SPACE = PAGE_SIZE_DEFAULT - LEAF_HEADER_SIZE;
 
-// Internal Layout
+// Internal Layout: keys and child pointers in two separate arrays, so a
+// search scans contiguous keys.  Keys are frame-of-reference coded: each is
+// stored as its distance from a per-node base, all in the narrowest of 1, 2,
+// 4 or 8 bytes that holds the node's largest distance.  Separators within one
+// node are close together, so a node usually needs 2 bytes per key where a
+// full key takes 8, and fan-out rises as the tree gets deeper.
+// Header: [type:1][is_root:1][crc32:4][num_keys:4][right_child:4][key_width:1][pad:1][base:8] = 24 bytes
+// Then keys[capacity] (key_width bytes each) from byte 24, and
+// children[capacity] (u32 each) against the end of the page, where
+// capacity = internal_capacity(key_width).
 const uint32_t OFFSET_INTERNAL_NUM_KEYS = HEADER_SIZE;
 const uint32_t OFFSET_INTERNAL_RIGHT_CHILD = OFFSET_INTERNAL_NUM_KEYS + 4;
-const uint32_t INTERNAL_HEADER_SIZE = OFFSET_INTERNAL_RIGHT_CHILD + 4;
-const uint32_t INTERNAL_KEY_SIZE = sizeof(uint32_t);
+const uint32_t OFFSET_INTERNAL_KEY_WIDTH = OFFSET_INTERNAL_RIGHT_CHILD + 4;
+const uint32_t OFFSET_INTERNAL_BASE = OFFSET_INTERNAL_KEY_WIDTH + 2;
+const uint32_t INTERNAL_HEADER_SIZE = OFFSET_INTERNAL_BASE + 8;  // Keys 8-byte aligned
+const uint32_t OFFSET_INTERNAL_KEYS = INTERNAL_HEADER_SIZE;
 const uint32_t INTERNAL_CHILD_SIZE = sizeof(uint32_t);
-const uint32_t INTERNAL_CELL_SIZE = INTERNAL_CHILD_SIZE + INTERNAL_KEY_SIZE;
-const uint32_t INTERNAL_MAX_CELLS = (PAGE_SIZE - INTERNAL_HEADER_SIZE) / INTERNAL_CELL_SIZE;
+const uint32_t INTERNAL_KEY_WIDTH_MAX = sizeof(uint64_t);
+
+inline uint32_t internal_capacity(uint32_t key_width) {
+    return (PAGE_SIZE - INTERNAL_HEADER_SIZE) / (key_width + INTERNAL_CHILD_SIZE);
+}
+
+// Upper bound on the keys of any node (1-byte deltas), for sizing buffers
+inline uint32_t INTERNAL_MAX_CELLS = (PAGE_SIZE_DEFAULT - INTERNAL_HEADER_SIZE) / (1 + INTERNAL_CHILD_SIZE);
+
+// Within-node search: a branchless binary search narrows the range to this
+// many keys, which a SIMD kernel (AVX2 / NEON, scalar fallback) then counts.
+const uint32_t NODE_SEARCH_WINDOW = 32;
 
 // Minimum occupancy thresholds (for delete / rebalance)
 // With variable-length records, leaf underflow is byte-based:
 //   underflow when used_bytes < LEAF_USABLE_SPACE / 2
 // We also keep a hard floor: a leaf with < 2 cells always rebalances.
+// Internal nodes underflow below half of what a node holds at the widest
+// coding, so two underflowing siblings always fit into one, however wide.
 const uint32_t LEAF_MIN_CELLS = 2;   // absolute floor
-const uint32_t INTERNAL_MIN_KEYS = INTERNAL_MAX_CELLS / 2;
+inline uint32_t INTERNAL_MIN_KEYS = (PAGE_SIZE_DEFAULT - INTERNAL_HEADER_SIZE) /
+                                    (INTERNAL_KEY_WIDTH_MAX + INTERNAL_CHILD_SIZE) / 2;
+
+// Bulk load: target fill (percent of usable space) for packed leaves/internals.
+// Never below 50% so bulk-built nodes satisfy the same occupancy rules as split ones.
+const uint32_t BULK_FILL_DEFAULT = 90;
+const uint32_t BULK_FILL_MIN     = 50;
 
 // ==========================================
 // DB FILE HEADER (Stored in Page 0)
 // ==========================================
-const uint32_t DB_MAGIC = 0xF04DB;
+// Format 1 files (magic 0xF04DB) had only the first five fields and rebuilt
+// the bloom filter on every open; format 2 kept a fixed-size filter on page 0
+// behind the header; format 3 and older interleaved internal keys with child
+// pointers and kept leaf keys in the records; format 4 and older always used
+// CRC32 page checksums; format 5 and older kept free pages on a linked list;
+// format 6 and older had 32-bit keys (8-byte leaf slots, 4-byte internal keys);
+// format 7 and older had no secondary indexes.  All are migrated when opened
+// (a migrated file keeps its CRC32 checksums, recorded in checksum_algo): the
+// Pager brings the file up to format 6 in place, then the BTree rebuilds a
+// format 6 tree with 64-bit keys and records that no index exists.
+// Later layout changes bump format_version, not the magic.
+const uint32_t DB_MAGIC          = 0xF04DB2;
+const uint32_t DB_MAGIC_V1       = 0xF04DB;
+const uint32_t DB_FORMAT_VERSION = 8;
+const uint32_t DB_FORMAT_NARROW_KEYS = 6;  // Last format with 32-bit keys
 const uint32_t HEADER_PAGE = 0;
+const uint32_t INVALID_PAGE = UINT32_MAX;
 const uint32_t ROOT_PAGE = 1;
 
-// Free pages form a singly linked list.
-// Each free page stores the next-free page number at offset HEADER_SIZE (byte 6).
-// Offset 0 is marked NODE_FREE to prevent CRC stamping on flush.
-// A next-pointer value of 0 means "end of list".
+// DbHeader.flags
+const uint32_t DB_FLAG_BLOOM_VALID = 1u << 0;  // Bloom bits cover every key in the tree
+
+// DbHeader.checksum_algo / WalFileHeader.checksum_algo (see utils.h)
+const uint32_t CHECKSUM_CRC32  = 0;  // Software only; files from format 4 and older
+const uint32_t CHECKSUM_CRC32C = 1;  // SSE4.2 / ARMv8 CRC; new files and logs
+
+// Secondary indexes: one B+Tree per indexed column, mapping the column's
+// value to the ids of the rows holding it (see BTree, "SECONDARY INDEXES")
+enum IndexColumn : uint32_t { INDEX_USERNAME, INDEX_EMAIL, INDEX_COLUMNS };
+
+// Free pages are tracked by a bitmap on dedicated pages (the free-space map).
+// Up to format 5 they formed a singly linked list instead: each free page was
+// marked NODE_FREE and stored the next-free page number at offset HEADER_SIZE,
+// 0 ending the list.  Such a list is read once, into the map, on upgrade.
 struct DbHeader {
     uint32_t magic;            // 0xF04DB for validation
     uint32_t page_size;        // Page size used for this DB
     uint32_t total_pages;      // Total pages allocated (header + data + free)
-    uint32_t free_pages;       // Count of pages currently in the free list
-    uint32_t first_free_page;  // Head of free page linked list (0 = empty)
+    uint32_t free_pages;       // Count of pages currently free
+    uint32_t first_free_page;  // Format 5 and older: head of the free list (0 = empty)
+    uint32_t format_version;   // DB_FORMAT_VERSION
+    uint32_t flags;            // DB_FLAG_*
+    uint32_t row_count;        // Live rows in the tree
+    uint32_t bloom_stale;      // Rows deleted since the bloom filter was last rebuilt
+    uint32_t bloom_first_page; // Bloom filter: first page of its contiguous run
+    uint32_t bloom_pages;      //   pages in the run (0 = not built yet)
+    uint32_t bloom_capacity;   //   keys it was sized for
+    uint32_t checksum_algo;    // CHECKSUM_* used for tree, bloom and map pages
+    uint32_t fsm_first_page;   // Free-space map: first page of its contiguous run
+    uint32_t fsm_pages;        //   pages in the run (0 = not written yet)
+    uint32_t index_roots[INDEX_COLUMNS];  // Root page per IndexColumn (0 = not indexed)
+    uint64_t commit_lsn;       // Commit groups logged since the file was created
+    uint64_t backup_lsn;       // commit_lsn captured by the last .backup (0 = none)
 };
 
-// Bloom Filter Constants (stored on Page 0 after DbHeader)
-const uint32_t BLOOM_OFFSET = sizeof(DbHeader);          // byte 20
-const uint32_t BLOOM_SIZE   = PAGE_SIZE - BLOOM_OFFSET;   // 4076 bytes
-const uint32_t BLOOM_BITS   = BLOOM_SIZE * 8;             // 32608 bits
+// Write-ahead log ("<db>-wal", see wal.h)
+const uint32_t WAL_MAGIC = 0xF04DBA1;
+const uint32_t WAL_CHECKPOINT_FRAMES = 1024;  // Checkpoint once the log holds ~4 MB (4 KB pages)
+
+// Bloom Filter Constants (dedicated pages, see bloom.h)
+// Sized at BLOOM_BITS_PER_KEY for twice the rows present when it is (re)built,
+// i.e. well under BLOOM_TARGET_FPR until the tree outgrows it and it is rebuilt
+// larger.  512-bit blocks with 8 bits per key give ~0.5% at full capacity.
+const uint32_t BLOOM_BLOCK_SIZE   = 64;  // Bytes: one cache line per probe
+const uint32_t BLOOM_BLOCK_WORDS  = BLOOM_BLOCK_SIZE / sizeof(uint64_t);
+const uint32_t BLOOM_PAGE_HEADER  = 64;  // Common header, padded to keep blocks line-aligned
+const uint32_t BLOOM_BITS_PER_KEY = 12;
+const uint32_t BLOOM_HEADROOM     = 2;   // Capacity over the row count at build time
+const uint32_t BLOOM_FPR_PROBES   = 100000;  // Absent keys probed by .bloom
+const double   BLOOM_TARGET_FPR   = 0.01;
+
+// Deletes leave their bits set.  Once this many rows (and at least this share
+// of the live rows) were deleted since the last rebuild, one is run in the
+// background.
+const uint32_t BLOOM_STALE_MIN     = 1000;
+const uint32_t BLOOM_STALE_PERCENT = 25;
+
+// Free-space map (dedicated pages, see fsm.h).  A new page is taken within
+// FSM_HINT_WINDOW pages after its allocation hint when one is free there.
+const uint32_t FSM_PAGE_HEADER = 16;  // Common header, padded to keep the bitmap word-aligned
+const uint32_t FSM_HINT_WINDOW = 64;
+
+// Vacuum (see vacuum.h): leaves visited plus pages relocated per step.  Each
+// step holds the tree exclusively, then commits and lets foreground work in.
+const uint32_t VACUUM_STEP_PAGES = 64;
+
+// Online backups (see backup.h): main-file pages read per pread() (1 MB at
+// 4 KB pages), and the magic of an incremental backup file
+const uint32_t BACKUP_RUN_PAGES   = 256;
+const uint32_t BACKUP_DELTA_MAGIC = 0xF04DBD1;
+const uint32_t CHANGES_MAGIC      = 0xF04DBC1;  // "<db>-changes" (see Pager, "Change Tracking")
+
+inline bool valid_page_size(uint32_t size) {
+    return size >= PAGE_SIZE_MIN && size <= PAGE_SIZE_MAX && (size & (size - 1)) == 0;
+}
+
+// Recompute the page geometry.  Only valid before any page is cached.
+inline void set_page_size(uint32_t size) {
+    PAGE_SIZE          = size;
+    LEAF_USABLE_SPACE  = size - LEAF_HEADER_SIZE;
+    INTERNAL_MAX_CELLS = internal_capacity(1);
+    INTERNAL_MIN_KEYS  = internal_capacity(INTERNAL_KEY_WIDTH_MAX) / 2;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "btree.h"
+#include <vector>
+
+// ==========================================
+// CLASS: ROW CURSOR (streaming scans)
+// ==========================================
+// Walks the rows with start ≤ id ≤ end in key order (or reverse), handing them
+// out in batches of RowViews that point straight into the slotted leaf.  A
+// batch never spans two leaves: the leaf it came from stays pinned and
+// S-latched until the next call to next_batch(), close() or destruction, so
+// the views stay valid exactly that long.
+//
+// Forward scans follow next_leaf with read-ahead.  Leaves are only linked
+// left → right, so a reverse scan re-descends from the root to the leaf just
+// below the current one (using the separator that bounds it) — never while
+// still holding a leaf latch.
+//
+// With a snapshot the cursor latches nothing: every node it visits is a
+// private copy read through the snapshot, and a batch's views point into
+// the copy of its leaf (valid just as long).  Writers go on meanwhile, and
+// the scan sees none of their changes.
+//
+// A thread must not modify the tree while it has a cursor open: its writer
+// latches would wait on its own S latch (and a snapshot's pages would pile up).
+
+struct ScanOptions {
+    uint64_t start = 0;
+    uint64_t end   = UINT64_MAX;  // Inclusive
+    uint64_t limit = UINT64_MAX;  // Rows at most
+    bool reverse   = false;       // Descending key order
+    const Snapshot* snapshot = nullptr;  // Read through it instead of latching
+};
+
+class RowCursor {
+    BTree& tree;
+    ScanOptions opts;
+    PageHandle leaf;            // Current leaf, latched (held between batches)
+    std::vector<uint8_t> copy;  // Current leaf, read through the snapshot
+    uint32_t leaf_page = 0;     // Current leaf (0 = none)
+    void* leaf_data = nullptr;  // leaf.data or copy
+    uint32_t pos = 0;           // Forward: next slot.  Reverse: one past the next slot
+    uint64_t fence = 0;         // Reverse: every key of the current leaf is ≥ fence (0 = leftmost)
+    uint64_t last;              // Reverse: rows up to this key remain, once the current leaf is done
+    uint64_t remaining;         // Under LIMIT
+    bool started = false;
+    bool finished = false;
+    BTree::ReadAhead ra;
+
+    void descend(uint64_t key, uint64_t* fence = nullptr);
+    bool step_right();
+    void drop_leaf();
+    bool position_forward();
+    bool position_reverse();
+
+public:
+    RowCursor(BTree& t, const ScanOptions& options = ScanOptions());
+    ~RowCursor() { close(); }
+    RowCursor(const RowCursor&) = delete;
+    RowCursor& operator=(const RowCursor&) = delete;
+
+    // Replaces out with up to max rows; 0 once the scan is complete.
+    size_t next_batch(std::vector<RowView>& out, size_t max = CURSOR_BATCH_DEFAULT);
+    void close();  // Ends the scan early and releases the leaf
+    bool done() const { return finished && leaf_data == nullptr; }
+};
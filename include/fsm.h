@@ -0,0 +1,54 @@
+#pragma once
+#include "common.h"
+#include <utility>
+#include <vector>
+
+// ==========================================
+// CLASS: FREE-SPACE MAP (Page Allocation Bitmap)
+// ==========================================
+// One bit per page of the database file, set while the page is free.  The
+// Pager keeps the bits in memory and finds free pages (or runs of them) with
+// word scans, so neither allocating nor freeing a page reads that page.
+//
+// The map occupies a contiguous run of dedicated pages recorded in the
+// DbHeader (fsm_first_page / fsm_pages); map page i holds the bits of pages
+// [i * pages_per_map_page(), (i + 1) * pages_per_map_page()).  Like the bloom
+// filter, it never goes through the buffer pool: map pages changed since the
+// last commit are logged by Pager::commit() in the same group as the pages
+// they describe.  Once the file outgrows the run it moves to a larger one.
+//
+// Layout of a map page:
+//   [type=NODE_FSM:1][unused:1][crc:4][padding to 16][bitmap: 1 bit per page]
+class FreeSpaceMap {
+    std::vector<uint64_t> words;  // Grows with the highest page ever freed
+    std::vector<uint8_t> dirty;   // Per map page: changed since the last collect_dirty()
+    std::vector<uint8_t> images;  // Page images of the last collect_dirty()
+    uint32_t free_count = 0;
+
+    void mark_dirty(uint32_t page_num);
+
+public:
+    // --- Sizing ---
+    static uint32_t pages_per_map_page() { return (PAGE_SIZE - FSM_PAGE_HEADER) * 8; }
+    static uint32_t map_pages_for(uint64_t total_pages);
+
+    // --- Bits ---
+    bool is_free(uint32_t page_num) const;
+    bool set_free(uint32_t page_num, bool free);  // TRUE if the bit changed
+    uint32_t num_free() const { return free_count; }
+
+    // First free page in [from, to), or INVALID_PAGE
+    uint32_t find_free(uint32_t from, uint32_t to) const;
+    // First run of count free pages inside [from, to), or INVALID_PAGE
+    uint32_t find_run(uint32_t count, uint32_t from, uint32_t to) const;
+    void truncate(uint32_t total_pages);  // Clears the bits of pages cut off the file
+
+    // --- Persistence ---
+    // Page index of the run; FALSE if not a map page (its pages stay in use).
+    bool read_page(uint32_t index, const void* page, uint32_t total_pages);
+    void mark_all_dirty(uint32_t num_pages);  // After moving to a new run
+    // Page images of every map page changed since the last call.  The
+    // pointers stay valid until the next call.
+    void collect_dirty(uint32_t first_page, uint32_t num_pages,
+                       std::vector<std::pair<uint32_t, const void*>>& out);
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// ==========================================
+// HOT-PATH METRICS
+// ==========================================
+// Process-wide counters and histograms for the engine's hot paths.  Each
+// thread adds into one of METRIC_SHARDS cache-line-aligned shards with a
+// relaxed atomic add (no lock, no allocation, no shared line between the
+// first METRIC_SHARDS threads); reports sum the shards.
+//
+// Built with -DFORGEDB_NO_METRICS (make METRICS=0) every METRIC_* macro
+// compiles to nothing and the reports say the build has no metrics.
+//
+// Histograms have power-of-two buckets: bucket b holds values in
+// [2^(b-1), 2^b), bucket 0 holds zeros.  Times are in nanoseconds.
+
+enum MetricCounter {
+    MET_LEAF_SPLITS,
+    MET_INTERNAL_SPLITS,
+    MET_LEAF_MERGES,
+    MET_INTERNAL_MERGES,
+    MET_LEAF_BORROWS,
+    MET_INTERNAL_BORROWS,
+    MET_DEFRAGMENTS,
+    MET_BYTES_READ,       // pread() of the main file and the WAL
+    MET_BYTES_WRITTEN,    // pwrite() of the same
+    MET_MAPPED_READS,     // Pages copied in from the file mapping
+    MET_BLOOM_NEGATIVES,  // Keys the filter ruled out
+    MET_BLOOM_TRUE_POSITIVES,
+    MET_BLOOM_FALSE_POSITIVES,
+    MET_COUNTER_COUNT
+};
+
+enum MetricHistogram {
+    HIST_DESCENT_NS,      // Root-to-leaf descent, latch waits included
+    HIST_DESCENT_DEPTH,   // Levels visited by that descent
+    HIST_LATCH_WAIT_NS,   // Page latch not granted at once
+    HIST_FRAME_WAIT_NS,   // Every frame pinned: waiting for an unpin
+    HIST_DRAIN_WAIT_NS,   // Writer waiting for readers to let go (vacuum, index build)
+    HIST_CRC_NS,          // One page checksum, computed or verified
+    HIST_SYNC_NS,         // fsync / fdatasync (WAL commit, checkpoint)
+    MET_HISTOGRAM_COUNT
+};
+
+const uint32_t METRIC_SHARDS  = 16;
+const uint32_t METRIC_BUCKETS = 48;  // Up to 2^47 ns (~39 h): nothing lands past it
+
+struct MetricsSnapshot {
+    uint64_t counters[MET_COUNTER_COUNT] = {};
+    struct Histogram {
+        uint64_t buckets[METRIC_BUCKETS] = {};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t quantile(double q) const;  // Upper bound of the bucket holding it
+    } histograms[MET_HISTOGRAM_COUNT];
+};
+
+#ifndef FORGEDB_NO_METRICS
+
+struct alignas(64) MetricShard {
+    std::atomic<uint64_t> counters[MET_COUNTER_COUNT] = {};
+    struct Histogram {
+        std::atomic<uint64_t> buckets[METRIC_BUCKETS] = {};
+        std::atomic<uint64_t> sum{0};
+    } histograms[MET_HISTOGRAM_COUNT];
+};
+
+MetricShard& metric_shard();  // The calling thread's
+
+inline void metric_add(MetricCounter c, uint64_t n) {
+    metric_shard().counters[c].fetch_add(n, std::memory_order_relaxed);
+}
+
+inline void metric_record(MetricHistogram h, uint64_t value) {
+    uint32_t bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    MetricShard::Histogram& hist = metric_shard().histograms[h];
+    hist.buckets[bucket < METRIC_BUCKETS ? bucket : METRIC_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+    hist.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline uint64_t metric_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records the time from construction to destruction
+class MetricTimer {
+    MetricHistogram hist;
+    uint64_t start;
+public:
+    explicit MetricTimer(MetricHistogram h) : hist(h), start(metric_now_ns()) {}
+    ~MetricTimer() { metric_record(hist, metric_now_ns() - start); }
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+};
+
+#define METRIC_CAT2(a, b) a##b
+#define METRIC_CAT(a, b) METRIC_CAT2(a, b)
+#define METRIC_ADD(counter, n)      metric_add(counter, n)
+#define METRIC_INC(counter)         metric_add(counter, 1)
+#define METRIC_RECORD(hist, value)  metric_record(hist, value)
+#define METRIC_TIMER(hist)          MetricTimer METRIC_CAT(metric_timer_, __LINE__)(hist)
+
+#else
+
+#define METRIC_ADD(counter, n)      ((void)0)
+#define METRIC_INC(counter)         ((void)0)
+#define METRIC_RECORD(hist, value)  ((void)0)
+#define METRIC_TIMER(hist)          ((void)0)
+
+#endif
+
+// --- Reports ---
+bool metrics_enabled();
+MetricsSnapshot metrics_snapshot();  // Sum of every shard (not an atomic cut)
+void print_metrics(std::ostream& out);       // .metrics
+void write_prometheus(std::ostream& out);    // Text exposition format 0.0.4
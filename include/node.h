@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <vector>
 
 // ==========================================
 // CLASS: NODE (Memory Abstraction)
@@ -45,41 +46,59 @@ public:
     void set_next_leaf(uint32_t pg) { *((uint32_t*)((char*)data + OFFSET_LEAF_NEXT)) = pg; }
 
     // --- Slot directory ---
-    uint16_t slot_offset(uint32_t i) const {
-        return *((uint16_t*)((char*)data + LEAF_HEADER_SIZE + i * SLOT_SIZE));
-    }
-    void set_slot_offset(uint32_t i, uint16_t v) {
-        *((uint16_t*)((char*)data + LEAF_HEADER_SIZE + i * SLOT_SIZE)) = v;
-    }
-    uint16_t slot_length(uint32_t i) const {
-        return *((uint16_t*)((char*)data + LEAF_HEADER_SIZE + i * SLOT_SIZE + 2));
-    }
-    void set_slot_length(uint32_t i, uint16_t v) {
-        *((uint16_t*)((char*)data + LEAF_HEADER_SIZE + i * SLOT_SIZE + 2)) = v;
-    }
+    uint8_t* slot_ptr(uint32_t i) { return (uint8_t*)data + LEAF_HEADER_SIZE + i * SLOT_SIZE; }
+    const uint8_t* slot_ptr(uint32_t i) const { return (const uint8_t*)data + LEAF_HEADER_SIZE + i * SLOT_SIZE; }
+
+    uint16_t slot_offset(uint32_t i) const { return *((const uint16_t*)slot_ptr(i)); }
+    void set_slot_offset(uint32_t i, uint16_t v) { *((uint16_t*)slot_ptr(i)) = v; }
+    uint16_t slot_length(uint32_t i) const { return *((const uint16_t*)(slot_ptr(i) + 2)); }
+    void set_slot_length(uint32_t i, uint16_t v) { *((uint16_t*)(slot_ptr(i) + 2)) = v; }
+
+    // Keys sit 2 bytes past 4-byte alignment
+    uint64_t get_key(uint32_t i) const { uint64_t k; std::memcpy(&k, slot_ptr(i) + SLOT_KEY, 8); return k; }
+    void set_slot_key(uint32_t i, uint64_t key) { std::memcpy(slot_ptr(i) + SLOT_KEY, &key, 8); }
+
+    // --- Search (SIMD over the slot keys) ---
+    uint32_t lower_bound(uint64_t key, uint32_t from = 0) const;  // First slot in [from, n) with key ≥ key
+    bool find(uint64_t key, uint32_t& idx) const;                 // Slot holding key, if any
 
     // --- Record access ---
     uint8_t* record_ptr(uint32_t i) { return (uint8_t*)data + slot_offset(i); }
     const uint8_t* record_ptr(uint32_t i) const { return (const uint8_t*)data + slot_offset(i); }
 
-    uint32_t get_key(uint32_t i) const;
     Row get_row(uint32_t i) const;
+    RowView view(uint32_t i) const;  // Valid while the page stays latched
 
     // --- Space management ---
     bool can_fit(uint16_t record_size) const;
     uint16_t contiguous_free() const;
     bool leaf_underflow() const;
-    void defragment();
+    bool safe_to_remove(uint64_t key) const;  // Removing key cannot cause underflow
+    void defragment();  // In place; only needed when contiguous_free() is too small
 
     // --- Modification ---
-    void insert(uint32_t key, const Row& row);
+    void insert(uint64_t key, const Row& row);
+    void insert_record(uint64_t key, const uint8_t* rec, uint16_t len);  // Serialized record, not on this page
+    void append(const Row& row);  // Bulk load: caller guarantees row.id > every key on the page
+    void append_record(uint64_t key, const uint8_t* rec, uint16_t len);  // Same, for a serialized record
     void remove_at(uint32_t idx);
-    bool remove(uint32_t key);
+    bool remove(uint64_t key);
+
+    // --- Bulk moves (split, merge, redistribution) ---
+    // Moves slots [from, from + count) with their records to dst at slot
+    // index at.  Keys stay sorted only if the range fits there: the tail of a
+    // left page goes to the front of its right sibling, and vice versa.
+    void move_slots(uint32_t from, uint32_t count, LeafNode& dst, uint32_t at);
 };
 
 // ==========================================
 // CLASS: INTERNAL NODE
 // ==========================================
+// Keys are coded as key - base in key_width() bytes (see common.h), and every
+// change keeps that coding able to hold the node's keys: a key below the base
+// or too far above it re-codes the whole node first.  A wider coding holds
+// fewer keys, so a change that could widen it is checked against the
+// capacity beforehand (can_insert, can_set_key, fits).
 class InternalNode : public Node {
 public:
     InternalNode(void* data) : Node(data) {}
@@ -92,18 +111,67 @@ public:
     uint32_t get_right_child() const { return *((uint32_t*)((char*)data + OFFSET_INTERNAL_RIGHT_CHILD)); }
     void set_right_child(uint32_t child) { *((uint32_t*)((char*)data + OFFSET_INTERNAL_RIGHT_CHILD)) = child; }
 
-    // Cell = [Child Ptr : 4B] [Key : 4B]
-    uint32_t* get_cell(uint32_t index) {
-        return (uint32_t*)((char*)data + INTERNAL_HEADER_SIZE + (index * INTERNAL_CELL_SIZE));
-    }
+    uint32_t key_width() const { return *((uint8_t*)((char*)data + OFFSET_INTERNAL_KEY_WIDTH)); }
+    uint64_t key_base() const { return *((uint64_t*)((char*)data + OFFSET_INTERNAL_BASE)); }
+    uint32_t capacity() const { return internal_capacity(key_width()); }
+
+    // Narrowest coding for keys spread over [lo, hi], and whether count such
+    // keys fit a node
+    static uint32_t width_for(uint64_t lo, uint64_t hi);
+    static bool fits(uint32_t count, uint64_t lo, uint64_t hi);
+
+    // Raw child slot (no right_child redirect), for filling and shifting cells
+    uint32_t child_at(uint32_t index) const { return child_array()[index]; }
+    void set_child_at(uint32_t index, uint32_t child_page) { child_array()[index] = child_page; }
 
-    uint32_t get_child(uint32_t index);
+    uint32_t get_child(uint32_t index) const;
     void set_child(uint32_t index, uint32_t child_page);
-    uint32_t get_key(uint32_t index);
-    void set_key(uint32_t index, uint32_t key);
+    uint64_t get_key(uint32_t index) const;
+    void set_key(uint32_t index, uint64_t key);  // Replaces a separator
+
+    // keys[i] separates children[i] and children[i + 1]; children[num_keys] is
+    // right_child.  Writes the whole node in its narrowest coding.
+    void assign(const uint64_t* keys, const uint32_t* children, uint32_t num_keys);
+    void read_all(std::vector<uint64_t>& keys, std::vector<uint32_t>& children) const;
+
+    // Room checks for the changes that may widen the coding
+    bool can_insert(uint64_t key) const;
+    bool can_set_key(uint32_t index, uint64_t key) const;
 
     // B+Tree traversal & modification
-    uint32_t find_child(uint32_t key);
-    void insert_child(uint32_t index, uint32_t key, uint32_t new_child_page);
-    void remove_key(uint32_t key_index);
+    uint32_t find_child(uint64_t key) const;
+    uint32_t child_index_for(uint64_t key) const;  // Index of the child find_child() returns
+    void insert_child(uint32_t index, uint64_t key, uint32_t new_child_page);
+    void push_front(uint32_t child_page, uint64_t key);  // New child 0, left of key
+    void remove_key(uint32_t key_index);  // The key and the child to its right
+    void remove_first();                  // Key 0 and child 0
+
+private:
+    uint8_t* key_bytes() const { return (uint8_t*)data + OFFSET_INTERNAL_KEYS; }
+    uint32_t* child_array() const { return (uint32_t*)((char*)data + PAGE_SIZE) - capacity(); }
+    uint64_t delta_at(uint32_t index) const;
+    void set_delta_at(uint32_t index, uint64_t delta);
+    void set_coding(uint64_t base, uint32_t width);
+    bool covers(uint64_t key) const;        // key is representable as is
+};
+
+// ==========================================
+// FORMAT UPGRADE
+// ==========================================
+// Rewrites a leaf or internal page from the format 3 layout (leaf keys inside
+// the records, internal keys interleaved with child pointers) into the format
+// 6 one.  A converted leaf uses exactly the space it did before.
+void upgrade_node_layout(void* page);
+
+// Read access to format 6 pages (32-bit keys) for the rebuild that brings a
+// tree up to 64-bit keys (see BTree::widen_keys).
+struct NarrowNode {
+    const uint8_t* data;
+
+    uint8_t type() const { return data[OFFSET_TYPE]; }
+    uint32_t num_keys() const;                  // Internal: keys, leaf: cells
+    uint32_t child(uint32_t index) const;       // Internal; num_keys() → right child
+    uint32_t next_leaf() const;
+    uint32_t key(uint32_t index) const;         // Either type
+    const uint8_t* record(uint32_t index, uint16_t& len) const;  // Leaf
 };
@@ -1,55 +1,384 @@
 #pragma once
 #include "common.h"
-#include <fstream>
-#include <list>
-#include <unordered_map>
+#include "wal.h"
+#include "aio.h"
+#include "verify.h"
+#include "fsm.h"
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+// ==========================================
+// BUFFER POOL FRAME DESCRIPTOR
+// ==========================================
+// Frame i owns bytes [i * PAGE_SIZE, (i+1) * PAGE_SIZE) of the pool arena.
+// prev/next link the frame into exactly one 2Q queue (or the free list).
+const uint32_t INVALID_FRAME = UINT32_MAX;
+
+enum FrameQueue : uint8_t {
+    QUEUE_FREE = 0,  // Unused frame
+    QUEUE_A1   = 1,  // Probation FIFO: pages referenced once
+    QUEUE_AM   = 2   // Main LRU: pages referenced again while resident
+};
+
+struct Frame {
+    uint32_t page_num  = INVALID_PAGE;
+    uint32_t pin_count = 0;
+    bool     dirty     = false;
+    FrameQueue queue   = QUEUE_FREE;
+    uint32_t prev      = INVALID_FRAME;
+    uint32_t next      = INVALID_FRAME;
+    bool     op_pinned = false;  // Pinned until the current WriteOp ends
+};
+
+// ==========================================
+// PAGE LATCHES
+// ==========================================
+// A handle is a pinned frame plus a held reader/writer latch on it.
+// Obtained from Pager::acquire(), returned with Pager::release().
+enum LatchMode : uint8_t { LATCH_SHARED, LATCH_EXCLUSIVE };
+
+struct PageHandle {
+    uint32_t page_num = INVALID_PAGE;
+    uint32_t frame    = INVALID_FRAME;
+    LatchMode mode    = LATCH_SHARED;
+    void* data        = nullptr;
+    bool valid() const { return frame != INVALID_FRAME; }
+};
+
+// ==========================================
+// CHECKSUM VERIFICATION POLICY
+// ==========================================
+// When pages read from the WAL or the main file have their checksum checked.
+// Pages are always stamped on their way out, whatever the policy.
+enum VerifyPolicy : uint8_t {
+    VERIFY_ALWAYS     = 0,  // Every read, before the page is handed out
+    VERIFY_FIRST      = 1,  // Only the first read of each page since open
+    VERIFY_BACKGROUND = 2   // A copy is checked by the PageVerifier thread
+};
+
+// ==========================================
+// PAGE CHECKSUMS
+// ==========================================
+// Tree, bloom and map pages carry one (the header page and free pages do not).
+// stamp_checksum fills it in before a page leaves the pool; verify_checksum
+// is FALSE, with a warning, on a mismatch.
+void stamp_checksum(uint32_t page_num, void* data, uint32_t algo);
+bool verify_checksum(uint32_t page_num, void* data, uint32_t algo);
+
+// ==========================================
+// PAGER CONFIGURATION (startup options)
+// ==========================================
+// pool_bytes, when non-zero, overrides pool_frames once the page size is known.
+// page_size only applies to a new database; an existing file keeps the size
+// recorded in its header.
+struct PagerConfig {
+    uint32_t pool_frames = BUFFER_POOL_DEFAULT;
+    uint64_t pool_bytes  = 0;
+    uint32_t page_size   = PAGE_SIZE_DEFAULT;
+    bool     use_mmap    = false;  // Serve clean reads from a read-only file mapping
+    uint32_t readahead   = READAHEAD_DEFAULT;   // Pages prefetched ahead of scans (0 = off)
+    uint32_t io_threads  = IO_THREADS_DEFAULT;
+    uint32_t scan_threads = 0;  // Parallel scan workers (0 = one per hardware thread)
+    VerifyPolicy verify  = VERIFY_ALWAYS;
+};
 
 // ==========================================
 // CLASS: PAGER (Disk Manager + Buffer Pool)
 // ==========================================
 class Pager {
 public:
-    std::fstream file_stream;
+    int fd;
     uint32_t file_length;
-    DbHeader header;
-
-    // === Buffer Pool (LRU Page Cache) ===
-    // The on-disk file can grow without bound; only BUFFER_POOL_SIZE
-    // frames are held in RAM.  When the pool is full, the Least Recently
-    // Used page is evicted (flushed to disk if dirty) to make room.
-    std::unordered_map<uint32_t, void*> pool;
-    std::list<uint32_t> lru_order;   // front = MRU, back = LRU
-    std::unordered_map<uint32_t, std::list<uint32_t>::iterator> lru_map;
-    std::unordered_map<uint32_t, uint32_t> pin_counts;  // Pinned pages can't be evicted
+    DbHeader header{};  // Zeroed until read (the recovery pass runs before)
+
+    // === Write-Ahead Log ===
+    // The main file is only written by checkpoint().  Evicted dirty pages and
+    // commit groups are appended to the WAL; reads consult it first.
+    // checkpoint_gen counts write_back_wal() passes (pool_mutex): a reader of
+    // the main file without the lock rechecks it to detect one in between.
+    Wal wal;
+    uint64_t checkpoint_gen = 0;
+
+    // === Batches ===
+    // Inside a batch commit() is deferred until end_batch().
+    bool in_batch = false;
+
+    // === Free-Space Map ===
+    // Allocation bitmap, kept in memory; changed map pages are logged by
+    // commit() with the rest of the group.  Writer thread only.
+    FreeSpaceMap fsm;
+
+    // === Pages Kept Outside the Pool ===
+    // The bloom filter holds its pages in its own memory.  commit() calls the
+    // hook first and logs the page images it returns in the same group; the
+    // pages are read back with read_uncached(), never through the pool.
+    std::function<void(std::vector<std::pair<uint32_t, const void*>>&)> commit_hook;
+
+    // === Buffer Pool (2Q Page Cache) ===
+    // The on-disk file can grow without bound; only pool_frames frames
+    // are held in RAM, carved out of one page-aligned arena.  A hit is one
+    // probe of an open-addressing page table plus an O(1) list splice.
+    //
+    // Replacement is 2Q: a newly read page enters the A1 FIFO and is only
+    // promoted to the Am LRU when referenced again, so a one-pass scan cycles
+    // through A1 without pushing hot internal nodes out of Am.
+    uint8_t* arena = nullptr;
+    std::vector<Frame> frames;
+    std::vector<uint32_t> page_table;  // slot → frame index (INVALID_FRAME = empty)
+    uint32_t table_shift = 0;          // Fibonacci hashing: slot = hash >> shift
+    std::vector<uint32_t> free_frames;
+    std::vector<uint32_t> dirty_frames;  // Frames dirtied since the last commit (may repeat)
+
+    struct Queue {
+        uint32_t head = INVALID_FRAME;  // MRU / newest
+        uint32_t tail = INVALID_FRAME;  // LRU / oldest
+        uint32_t size = 0;
+    };
+    Queue a1, am;
+    uint32_t a1_target;  // A1 may hold this many frames before Am is raided
+
     uint64_t stat_hits   = 0;
     uint64_t stat_misses = 0;
     uint64_t stat_evicts = 0;
 
-    Pager(std::string filename);
+    // === Memory-Mapped Read Path (optional) ===
+    // The main file is mapped PROT_READ.  read_page() hands out pointers into
+    // the mapping for pages that are neither cached nor logged in the WAL, so
+    // read-only traversals skip the frame copy entirely.  The mapping is
+    // replaced after checkpoints (and tail truncation), which run inside a
+    // write operation; since read_page() pointers must not be used while a
+    // writer runs, superseded mappings are unmapped when the outermost
+    // operation ends.
+    bool use_mmap = false;
+    uint8_t* map_base = nullptr;
+    uint32_t map_pages = 0;
+    std::vector<std::pair<void*, size_t>> retired_maps;
+    uint64_t stat_map_reads = 0;
+
+    // === Read-Ahead ===
+    // Scans announce upcoming pages with prefetch(); the AsyncReader fetches
+    // them from the main file in the background and get_page() collects the
+    // result on its miss path.  With mmap the kernel does it (MADV_WILLNEED).
+    AsyncReader reader;
+    uint32_t readahead = 0;
+    uint64_t stat_prefetch_issued = 0;
+    uint64_t stat_prefetch_hits   = 0;
+
+    // === Snapshots (copy-on-write page versions) ===
+    // A snapshot sees the tree as it stood when the write operations begun
+    // before it (epoch = op_seq) had completed.  While any is open, the first
+    // change an operation makes to a page (mark_dirty, free_page) keeps the
+    // page's current image first, unless no open snapshot can see that image.
+    // A snapshot read takes the oldest kept image replaced after its epoch;
+    // without one the live page has not changed since.  An image is dropped
+    // once no open snapshot falls between the operations that made and
+    // replaced it.  All of it is guarded by pool_mutex (a live frame is copied
+    // pinned, outside it: see read_snapshot).
+    struct PageVersion {
+        uint64_t until;  // Operation that replaced it: seen by snapshots with epoch < until
+        std::unique_ptr<uint8_t[]> image;
+    };
+    std::map<uint64_t, uint32_t> open_snapshots;  // Epoch → how many
+    std::unordered_map<uint32_t, std::vector<PageVersion>> page_versions;  // Oldest first
+    std::unordered_map<uint32_t, uint64_t> page_written;  // Operation that made the live image
+    uint64_t versions_live = 0;
+    uint64_t versions_peak = 0;
+    uint64_t stat_versions_kept   = 0;
+    uint64_t stat_snapshot_reads  = 0;
+    uint64_t stat_version_reads   = 0;  // Of those, served from a kept image
+
+    // === Change Tracking (incremental backups, see backup.h) ===
+    // A commit group's LSN is header.commit_lsn after it.  page_lsn[pg] is the
+    // LSN of the group that carried pg's newest logged image (evicted frames
+    // count towards the next group); every change after tracked_from is in it.
+    //
+    // Across restarts: each checkpoint saves the pages changed since the last
+    // backup to "<db>-changes", stamped with its LSN.  On open they are loaded
+    // (at that LSN) if the main file is still at it, and the pages of any WAL
+    // frames recovered on top are added; otherwise tracking starts afresh.
+    std::vector<uint64_t> page_lsn;
+    uint64_t tracked_from = 0;
+    std::string changes_path;
+
+    // === Parallel Scans ===
+    // Worker threads a ParallelScan may start (scan.h): PagerConfig.scan_threads,
+    // or the hardware thread count.  The pool bounds it further, since every
+    // worker pins a leaf and its read-ahead.
+    uint32_t scan_threads = 1;
+
+    // === Checksum Verification ===
+    // Algorithm: header.checksum_algo.  verify_policy takes effect once the
+    // file is open (migration reads are always checked); page_verified marks
+    // pages already checked under VERIFY_FIRST.
+    VerifyPolicy verify_policy = VERIFY_ALWAYS;
+    std::vector<bool> page_verified;
+    PageVerifier verifier;
+    uint64_t stat_verified      = 0;  // Checked inline
+    uint64_t stat_verify_skips  = 0;  // Handed out unchecked (already checked, or queued)
+    uint64_t stat_crc_failures  = 0;  // Inline mismatches
+
+    // === Concurrency ===
+    // pool_mutex guards the page table, queues, frame descriptors, WAL and
+    // stats.  It is never held while waiting for a page latch.  Page bytes are
+    // protected by per-frame latches, held only on pinned frames.
+    //
+    // Writers are serialized by write_mutex (see WriteOp).  Inside a WriteOp,
+    // every page the writer thread fetches with get_page() stays pinned until
+    // the operation ends, so concurrent readers can never evict a frame the
+    // writer still holds a pointer to.
+    std::mutex pool_mutex;
+    std::condition_variable frame_cv;  // Signalled when a pin count drops to 0
+    std::unique_ptr<std::shared_mutex[]> latches;
+    uint32_t handles_out = 0;          // Outstanding PageHandles (all threads)
+    uint32_t latch_waiters = 0;        // Of those, blocked in acquire() on a busy latch
+    uint32_t draining = 0;             // Threads in wait_for_readers()
+
+    std::recursive_mutex write_mutex;
+    std::thread::id op_thread;
+    uint32_t op_depth = 0;
+    uint64_t op_seq = 0;  // Outermost write operations begun (the current one's number)
+    bool op_pin_pages = false;
+    std::vector<uint32_t> op_frames;
+
+    Pager(std::string filename, const PagerConfig& config = PagerConfig());
     ~Pager();
 
     // --- Page Cache ---
+    // get_page() hands out raw frame pointers: writer thread only (in a WriteOp
+    // when other threads are active).  Readers use acquire()/release().
     void* get_page(uint32_t page_num);
-    void flush(uint32_t page_num);
+    void flush(uint32_t page_num);  // Dirty frame → WAL (uncommitted)
+    void mark_dirty(uint32_t page_num);  // Call before modifying a fetched page
+    void* read_page(uint32_t page_num);  // Read-only, unlatched: only while no writer runs
+    void remap();                        // Extend the mapping to the current file length
+    void prefetch(const std::vector<uint32_t>& pages);
+    bool read_uncached(uint32_t page_num, void* dest);  // Newest image, bypassing the pool; FALSE on I/O or CRC error
+
+    // --- Latched Access (any thread) ---
+    PageHandle acquire(uint32_t page_num, LatchMode mode);
+    bool try_acquire(uint32_t page_num, LatchMode mode, PageHandle& out);  // Never blocks on the latch
+    void release(PageHandle& handle);
+    PageHandle acquire_pinned_only(uint32_t page_num);  // Pin without latching
+    void unpin_handle(PageHandle& handle);
+    // Waits until every handle but the caller's own `own` is blocked on a
+    // latch.  With the root X-latched, other threads then hold no page.
+    void wait_for_readers(uint32_t own);
+
+    // --- Write Operations ---
+    void begin_write_op(bool pin_pages = true);
+    void end_write_op();
 
-    // --- LRU Eviction ---
-    void evict_lru();
+    // --- Snapshots (see Snapshot below) ---
+    uint64_t open_snapshot();  // Waits for a running write operation; never call inside one
+    void close_snapshot(uint64_t epoch);
+    void read_snapshot(uint64_t epoch, uint32_t page_num, void* dest);
+    const uint8_t* version_image(uint64_t epoch, uint32_t page_num) const;  // Kept image it sees, else nullptr (pool_mutex held)
+    void keep_version(uint32_t page_num, uint32_t idx);  // Before a change (pool_mutex held)
+    void note_logged(uint32_t page_num, uint64_t lsn);   // pool_mutex held
+
+    // --- Durability ---
+    void commit();      // All dirty frames → WAL as one group, one fsync
+    bool begin_batch();
+    bool end_batch();   // Commits the batch
+    void checkpoint();  // WAL → main file in page order, then truncate the log
+    void write_back_wal();  // Checkpoint body (also the startup recovery pass)
+    bool load_changes(uint64_t file_lsn);  // TRUE if "<db>-changes" is at file_lsn
+    void save_changes();
+
+    // --- Frame Table & 2Q Eviction ---
+    void* frame_data(uint32_t idx) const { return arena + (size_t)idx * PAGE_SIZE; }
+    uint32_t lookup_frame(uint32_t page_num) const;
+    void table_insert(uint32_t page_num, uint32_t idx);
+    void table_erase(uint32_t page_num);
+    void queue_push_head(Queue& q, FrameQueue id, uint32_t idx);
+    void queue_unlink(uint32_t idx);
+    uint32_t fetch_frame(std::unique_lock<std::mutex>& lock, uint32_t page_num, bool load = true);
+    void verify_read(uint32_t page_num, void* data);  // Applies verify_policy (pool_mutex held)
+    void op_pin(uint32_t idx);
+    uint32_t allocate_frame(std::unique_lock<std::mutex>& lock);
+    bool evict();
+    void write_frame(uint32_t idx);
+    void write_frames(const std::vector<uint32_t>& idxs);  // One WAL append for all
+    void mark_frame_dirty(uint32_t idx);
+    void drop_frame(uint32_t idx);  // Unpinned frame of a free page: forgotten, never written
 
     // --- Page Pinning (prevents eviction) ---
     void pin_page(uint32_t page_num);
     void unpin_page(uint32_t page_num);
-    bool is_pinned(uint32_t page_num) const;
+    bool is_pinned(uint32_t page_num);
 
-    // --- Free List Management ---
-    uint32_t get_unused_page_num();
+    // --- Page Allocation (free-space map) ---
+    // A new page comes back zeroed, dirty and pinned like get_page(), without
+    // being read.  hint is a page it should follow closely (the page being
+    // split); with none the lowest free page is used.
+    uint32_t get_unused_page_num(uint32_t hint = 0);
+    // Contiguous pages kept outside the pool, at or after `from`.  With
+    // `below` set the run must end before it (INVALID_PAGE if none does);
+    // otherwise the file grows when no free run fits.
+    uint32_t allocate_run(uint32_t count, uint32_t from = ROOT_PAGE + 1, uint32_t below = INVALID_PAGE);
     void free_page(uint32_t page_num);
+    void free_run(uint32_t first, uint32_t count);
+    void load_fsm();
+    void import_free_list();  // Format 5 and older → free-space map (on open)
+    void prepare_fsm();       // Moves the map to a larger run once the file outgrows it
+    bool move_fsm(uint32_t from, uint32_t below = INVALID_PAGE);  // Same size, new run (see allocate_run)
+
+    // --- Vacuum Support (writer, tree held exclusively) ---
+    // move_page copies a tree page to `to` (a free page, or the end of the
+    // file) and frees `from`; the caller rewires the pointers to it.
+    void move_page(uint32_t from, uint32_t to);
+    uint32_t truncate_free_tail();  // Cuts trailing free pages off the file; returns how many
 
     // --- Header Persistence ---
     void write_header();
+    void upgrade_node_pages();  // Format 3 and older → format 6 node layout (on open)
 
     // --- Debug Helpers ---
     void print_stats();
     void print_free_list();
     void print_pool_stats();
+    void print_wal_stats();
+};
+
+// ==========================================
+// WRITE OPERATION SCOPE
+// ==========================================
+// Holds the Pager's writer lock for one logical write (or commit).  Nested
+// scopes on the same thread are free.  pin_pages = false is for operations
+// that already exclude readers (e.g. a bulk load holding the root latch).
+class WriteOp {
+    Pager& pager;
+public:
+    explicit WriteOp(Pager& p, bool pin_pages = true) : pager(p) { pager.begin_write_op(pin_pages); }
+    ~WriteOp() { pager.end_write_op(); }
+    WriteOp(const WriteOp&) = delete;
+    WriteOp& operator=(const WriteOp&) = delete;
+};
+
+// ==========================================
+// SNAPSHOT SCOPE
+// ==========================================
+// A consistent read view for long readers (scans, dumps).  Pages are read as
+// private copies with no latch held, so the view neither holds writers up
+// nor sees a split half done.  Open it before taking any latch: opening
+// waits for the running write operation, which may be waiting for that latch.
+class Snapshot {
+    Pager& pager;
+    uint64_t epoch;
+public:
+    explicit Snapshot(Pager& p) : pager(p), epoch(p.open_snapshot()) {}
+    ~Snapshot() { pager.close_snapshot(epoch); }
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    void read(uint32_t page_num, void* dest) const { pager.read_snapshot(epoch, page_num, dest); }
+    uint64_t get_epoch() const { return epoch; }
 };
@@ -9,27 +9,84 @@
 enum StatementType {
     STATEMENT_INSERT,
     STATEMENT_SELECT,
-    STATEMENT_DELETE
+    STATEMENT_DELETE,
+    STATEMENT_BEGIN,   // Open a batch: one commit for many statements
+    STATEMENT_COMMIT
 };
 
-// The Execution Plan
+// How a SELECT / DELETE reaches its rows (chosen from the WHERE clause)
+enum AccessPath {
+    ACCESS_SCAN,    // No WHERE: every row, through a (parallel) scan
+    ACCESS_POINTS,  // id = n / id IN (...): batched point lookups
+    ACCESS_RANGE,   // id BETWEEN a AND b: a (parallel) scan of [a, b]
+    ACCESS_INDEX    // username / email = s: the column's index if it has one, else a filtered scan
+};
+
+// An aggregate in a SELECT list: COUNT(*), MIN(<column>), MAX(<column>)
+enum AggregateFunc { AGG_COUNT, AGG_MIN, AGG_MAX };
+
+struct Aggregate {
+    AggregateFunc func = AGG_COUNT;
+    bool of_id = true;                    // MIN / MAX of the id, or else of `column`
+    IndexColumn column = INDEX_USERNAME;
+};
+
+// A value in a statement: literal text, or a ? placeholder filled in by bind().
+// The literal views the query text, which must outlive the statement.
+struct Operand {
+    bool is_param = false;
+    uint32_t param = 0;   // Placeholder index, in order of appearance
+    std::string_view literal;
+};
+
+// The Execution Plan.  Parsing fills in the shape; bind() turns the operands
+// into the values execution reads, so a prepared statement is parsed once and
+// bound again for every execution.
 struct Statement {
     StatementType type;
-    Row row_to_insert;     // Payload for INSERT
-    uint32_t target_id;    // Payload for DELETE/SELECT
+    AccessPath access = ACCESS_SCAN;
+    std::vector<Aggregate> aggregates;  // SELECT list; empty for *
+    std::vector<Operand> operands;  // INSERT: id, username, email.  POINTS: ids.  RANGE: low, high.  INDEX: value
+    IndexColumn column = INDEX_EMAIL;  // ACCESS_INDEX
+    bool has_limit = false;
+    Operand limit;
+    bool descending = false;        // ORDER BY id DESC
+    uint32_t num_params = 0;
+
+    // --- Bound values ---
+    Row row_to_insert;              // Payload for INSERT
+    std::vector<uint64_t> target_ids;  // ACCESS_POINTS
+    uint64_t range_start = 0;       // ACCESS_RANGE (inclusive)
+    uint64_t range_end = UINT64_MAX;
+    std::string match_value;        // ACCESS_INDEX
+    uint64_t row_limit = UINT64_MAX;
+
+    // FALSE (error set) on a wrong parameter count or a value out of range
+    bool bind(const std::vector<std::string_view>& params, std::string& error);
+    void reset();  // Back to an empty plan, keeping the vectors' capacity
 };
 
+// Reads the caller's token buffer in place (no copy)
 class Parser {
-    std::vector<Token> tokens;
+    const std::vector<Token>& tokens;
     size_t pos;
+    uint32_t num_params;
 
     Token current_token() const;
     void advance();
     bool match(TokenType expected); // Checks type and advances if matches
+    bool match_id_column();
+    bool match_indexed_column(IndexColumn& column);
+    bool parse_operand(TokenType literal_type, Operand& out);
+    bool parse_aggregate(Aggregate& out);
 
     bool parse_insert(Statement& statement);
+    bool parse_select(Statement& statement);
+    bool parse_delete(Statement& statement);
+    bool parse_where(Statement& statement);
+    bool parse_order_limit(Statement& statement);
 
 public:
     Parser(const std::vector<Token>& tokens);
     bool parse_statement(Statement& statement);
-};
\ No newline at end of file
+};
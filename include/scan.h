@@ -0,0 +1,56 @@
+#pragma once
+#include "cursor.h"
+#include "parser.h"  // Aggregate
+#include <string>
+#include <vector>
+
+// WHERE username / email = '...', tested by the scanning worker against the
+// views into the leaf: rows that fail it are never copied or formatted.
+struct ScanFilter {
+    bool active = false;
+    IndexColumn column = INDEX_USERNAME;
+    std::string_view value;
+    bool matches(const RowView& row) const { return !active || column_value(row, column) == value; }
+};
+
+// ==========================================
+// CLASS: PARALLEL SCAN (full and range scans across worker threads)
+// ==========================================
+// Splits [start, end] at separator keys of the tree's upper levels
+// (BTree::split_points) into up to SCAN_PARTITIONS_PER_THREAD ranges per
+// worker, and reads each range with its own RowCursor on one of
+// Pager::scan_threads workers.  A worker filters, formats or folds its rows
+// into that range's result; the calling thread takes the results in key order
+// (descending for a reverse scan), each as soon as it is complete, so output
+// starts while later ranges are still being read.
+//
+// Every range is read through one snapshot, opened with the scan, so the
+// ranges add up to the table as of a single moment while writers go on.
+//
+// A limit caps every range at that many matches and the total at the merge,
+// which then tells the workers to stop.  A scan that yields a single range
+// runs on the calling thread.  As for RowCursor, the calling thread must not
+// modify the tree until the scan returns.
+class ParallelScan {
+    BTree& tree;
+    Snapshot snapshot;  // Opened before split_points() takes any latch
+    ScanOptions opts;
+    ScanFilter filter;
+    std::vector<ScanOptions> parts;  // One cursor per range, in result order
+    uint32_t workers = 1;
+
+    template <class Result, class Visit, class Take> void run(Visit visit, Take take);
+
+public:
+    ParallelScan(BTree& t, const ScanOptions& options = ScanOptions(), const ScanFilter& filter = ScanFilter());
+
+    uint64_t print();             // Matching rows as "  (id, username, email)"; returns how many
+    std::vector<uint64_t> ids();  // Of the matching rows, in result order
+    void print_aggregates(const std::vector<Aggregate>& aggregates);  // One line: "  (v, ...)"
+
+    uint32_t partitions() const { return parts.size(); }
+    uint32_t threads() const { return workers; }
+};
+
+// The same line for rows already fetched (point and index lookups)
+void print_aggregates(const std::vector<Aggregate>& aggregates, const std::vector<Row>& rows);
@@ -0,0 +1,62 @@
+#pragma once
+#include "btree.h"
+#include "pager.h"
+#include <string>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+
+// ==========================================
+// CLASS: SERVER (Long-Running Network Mode)
+// ==========================================
+// Keeps one Pager/BTree open and serves commands over a TCP or Unix stream
+// socket, so clients pay neither the open + bloom rebuild nor the exit flush
+// per command.
+//
+// Protocol:
+//   request  — command lines exactly as typed at the REPL, "\n" or "\r\n"
+//              terminated.  Clients may pipeline any number of lines: every
+//              complete line in a read is executed in order and all of their
+//              responses go back in one write.
+//   response — one frame per command: "<length>\n" then <length> bytes of
+//              output (what the REPL would have printed; may be empty).
+//   "exit" closes the connection.
+//
+// A connection whose first line is an HTTP GET is answered as HTTP/1.0
+// instead and closed: GET /metrics returns the hot-path metrics in the
+// Prometheus text format (metrics.h), so a scraper can point at the same port.
+//
+// Each connection runs on its own thread.  Read-only commands run
+// concurrently; writes are serialized across connections, and a
+// begin ... commit batch keeps the write session for its connection until
+// it commits (a client that disconnects mid-batch has it committed).
+// .vacuum commits its own steps and runs outside the session.
+class Server {
+    BTree& tree;
+    Pager& pager;
+    int listen_fd = -1;
+    int wake_pipe[2] = {-1, -1};  // stop() → accept loop
+    std::string unix_path;        // Unlinked on shutdown
+
+    std::mutex write_session;     // Owned by the connection currently writing
+
+    std::mutex conn_mutex;
+    std::condition_variable conn_cv;
+    std::set<int> conn_fds;       // Open client sockets
+
+    void serve_connection(int fd);
+    void run_command(const std::string& line, std::string& response,
+                     std::unique_lock<std::mutex>& session);
+
+public:
+    Server(BTree& t, Pager& p);
+    ~Server();
+
+    bool listen_tcp(const std::string& host, uint16_t port);
+    bool listen_unix(const std::string& path);
+
+    // Accept loop.  Returns once stop() was called (or SIGINT/SIGTERM arrived)
+    // and every connection has finished.
+    void run();
+    void stop();  // Async-signal-safe
+};
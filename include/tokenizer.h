@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
@@ -8,6 +9,9 @@ enum TokenType {
     // Keywords
     TOKEN_SELECT, TOKEN_INSERT, TOKEN_DELETE, TOKEN_VALUES,
     TOKEN_FROM, TOKEN_WHERE, TOKEN_INTO,
+    TOKEN_BEGIN, TOKEN_COMMIT, TOKEN_IN,
+    TOKEN_BETWEEN, TOKEN_AND, TOKEN_ORDER, TOKEN_BY,
+    TOKEN_ASC, TOKEN_DESC, TOKEN_LIMIT,
     
     // Symbols
     TOKEN_ASTERISK, // *
@@ -15,10 +19,11 @@ enum TokenType {
     TOKEN_LPAREN,   // (
     TOKEN_RPAREN,   // )
     TOKEN_EQUALS,   // =
+    TOKEN_PARAM,    // ?  (placeholder in a prepared statement)
     
     // Literals
     TOKEN_IDENTIFIER, // users, id, name (table/col names)
-    TOKEN_NUMBER,     // 123
+    TOKEN_NUMBER,     // 123, or 7:123 (a composite key)
     TOKEN_STRING,     // 'alice'
     
     // Control
@@ -26,15 +31,19 @@ enum TokenType {
     TOKEN_ILLEGAL
 };
 
+// lexeme is a view into the query text: it stays valid only as long as
+// that text does.  String literals are viewed without their quotes.
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     
     void debug_print() const;
 };
 
+// Borrows the query and appends tokens to a caller-owned buffer, so a buffer
+// reused across queries makes tokenizing allocation-free once it has grown.
 class Tokenizer {
-    std::string input;
+    std::string_view input;
     size_t pos;
 
     char current_char() const;
@@ -46,6 +55,6 @@ class Tokenizer {
     Token read_string();
 
 public:
-    Tokenizer(const std::string& query);
-    std::vector<Token> tokenize();
-};
\ No newline at end of file
+    Tokenizer(std::string_view query);
+    void tokenize(std::vector<Token>& tokens);  // Clears tokens first; ends with TOKEN_EOF
+};
@@ -1,16 +1,140 @@
 #pragma once
 #include "common.h"
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
 
 // ==========================================
-// CRC32 PAGE CHECKSUMS (ISO 3309, 0xEDB88320)
+// PAGE CHECKSUMS
 // ==========================================
-uint32_t crc32_compute(const uint8_t* buf, uint32_t len);
+// CRC32 (ISO 3309, 0xEDB88320) is what files created before format 5 carry;
+// CRC32C (Castagnoli, 0x82F63B78) has hardware support and is used for new
+// files.  DbHeader.checksum_algo / WalFileHeader.checksum_algo say which.
+// Pass a previous result as `seed` to continue a checksum over split buffers.
+uint32_t crc32_compute(const uint8_t* buf, uint32_t len, uint32_t seed = 0);
+uint32_t crc32c_compute(const uint8_t* buf, uint32_t len, uint32_t seed = 0);
+uint32_t checksum_compute(uint32_t algo, const uint8_t* buf, uint32_t len, uint32_t seed = 0);
+const char* checksum_name(uint32_t algo);  // Algorithm and the implementation in use
 
 // ==========================================
 // VARIABLE-LENGTH ROW SERIALIZATION
 // ==========================================
-// Wire format: [id:4B][username_len:2B][username:NB][email_len:2B][email:MB]
-// Min size: 4+2+0+2+0 = 8 bytes   Max size: 4+2+31+2+254 = 293 bytes
+// Wire format: [username_len:2B][username:NB][email_len:2B][email:MB]
+// The id is not serialized: leaves keep it in the slot next to the record.
+// Min size: 2+0+2+0 = 4 bytes   Max size: 2+31+2+254 = 289 bytes
 uint16_t serialize_row(const Row& row, uint8_t* dest);
-Row deserialize_row(const uint8_t* src);
+Row deserialize_row(uint64_t id, const uint8_t* src);
+RowView view_row(uint64_t id, const uint8_t* src);  // Points into src
 uint16_t serialized_row_size(const Row& row);
+
+// ==========================================
+// INDEXED COLUMNS
+// ==========================================
+const char* column_name(IndexColumn column);  // "username", "email"
+bool parse_column(std::string_view name, IndexColumn& column);  // Any case; FALSE for others
+std::string_view column_value(const Row& row, IndexColumn column);
+std::string_view column_value(const RowView& row, IndexColumn column);
+
+// ==========================================
+// KEYS
+// ==========================================
+// A key is written as a number, or as "hi:lo" for a composite key
+// (make_key).  FALSE on anything else, or a part out of range.
+bool parse_key(std::string_view text, uint64_t& key);
+
+// ==========================================
+// CPU FEATURES (runtime dispatch of SIMD kernels)
+// ==========================================
+#if defined(__x86_64__)
+inline bool cpu_has_avx2() {
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return has;
+}
+
+inline bool cpu_has_sse42() {
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+    return has;
+}
+#endif
+
+// ==========================================
+// COMMAND OUTPUT (per thread)
+// ==========================================
+// Messages and query results go to output(): std::cout unless the calling
+// thread has installed an OutputCapture, in which case they collect in that
+// stream (server mode buffers each command's response this way).
+std::ostream& output();
+
+class OutputCapture {
+    std::ostream* saved;
+public:
+    explicit OutputCapture(std::ostream& dest);
+    ~OutputCapture();
+    OutputCapture(const OutputCapture&) = delete;
+    OutputCapture& operator=(const OutputCapture&) = delete;
+};
+
+// Verbosity of what the engine says besides results and errors.  A message
+// below the current level costs one relaxed load: LOG_AT skips formatting it.
+//   LOG_QUIET  query results, reports (.stats ...) and errors only
+//   LOG_INFO   + acknowledgements ("Executed.", "Deleted key ...", "Batch committed.")
+//   LOG_DEBUG  + structural tracing (splits, merges, page reuse) and bloom probes
+enum LogLevel : uint8_t { LOG_QUIET, LOG_INFO, LOG_DEBUG };
+
+extern std::atomic<uint8_t> log_threshold;  // Process-wide; LOG_DEBUG by default
+inline bool log_enabled(LogLevel level) {
+    return log_threshold.load(std::memory_order_relaxed) >= level;
+}
+inline void set_log_level(LogLevel level) { log_threshold.store(level, std::memory_order_relaxed); }
+bool parse_log_level(std::string_view name, LogLevel& level);  // quiet, info, debug
+
+#define LOG_AT(level) if (!log_enabled(level)) {} else output()
+
+// A stream that writes to a file descriptor in `capacity`-byte chunks and on
+// flush / destruction, for script mode: one write(2) per chunk rather than
+// std::cout's per-line behaviour on a terminal.
+class FdOutputStream : private std::streambuf, public std::ostream {
+    int fd;
+    std::string buf;
+    int overflow(int c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+public:
+    FdOutputStream(int fd, size_t capacity);
+    ~FdOutputStream() override;
+    FdOutputStream(const FdOutputStream&) = delete;
+    FdOutputStream& operator=(const FdOutputStream&) = delete;
+};
+
+// Formats into a local buffer and writes it to output() in OUTPUT_BUFFER_SIZE
+// chunks (and on destruction), so result printing costs one stream write per
+// chunk instead of several per row.
+class OutputBuffer {
+    std::string buf;
+public:
+    OutputBuffer() { buf.reserve(OUTPUT_BUFFER_SIZE); }
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    OutputBuffer& operator<<(std::string_view s) { buf.append(s); return spill(); }
+    OutputBuffer& operator<<(char c) { buf.push_back(c); return spill(); }
+    OutputBuffer& operator<<(uint32_t n) { return *this << (uint64_t)n; }
+    OutputBuffer& operator<<(uint64_t n);
+    void flush();
+
+private:
+    OutputBuffer& spill() {
+        if (buf.size() >= OUTPUT_BUFFER_SIZE) flush();
+        return *this;
+    }
+};
+
+// ==========================================
+// FILE I/O HELPERS (retry short reads/writes)
+// ==========================================
+// pread_full zero-fills whatever lies past end-of-file.
+bool pread_full(int fd, void* buf, size_t len, uint64_t offset);
+bool pwrite_full(int fd, const void* buf, size_t len, uint64_t offset);
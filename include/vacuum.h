@@ -0,0 +1,69 @@
+#pragma once
+#include "btree.h"
+
+// Counters reported by .vacuum
+struct VacuumStats {
+    uint32_t steps = 0;
+    uint32_t pages_moved = 0;      // Tree pages relocated (a page may move twice)
+    uint32_t runs_moved = 0;       // Bloom / free-space map runs relocated
+    uint32_t leaves_in_order = 0;  // Leaves that now sit at consecutive pages
+    uint32_t pages_before = 0;     // DbHeader.total_pages when the vacuum started
+    uint32_t pages_after = 0;
+};
+
+// ==========================================
+// CLASS: VACUUM (Online Compaction)
+// ==========================================
+// Rewrites the file so that the leaves follow each other in key order from
+// page 2 (next_leaf always points at the next page) and no free page is left
+// below a live one, then truncates the free tail.  Three phases:
+//
+//   CLUSTER   walk the leaves in key order; the i-th goes to page 2 + i.
+//             Whatever sits there first moves out of the way: a tree page to
+//             the lowest free page above it, a bloom / map run to a free run
+//             above it (or the end of the file).
+//   COMPACT   from the top of the file down, move each live page into the
+//             lowest free page below it, until none is left below.
+//   TRUNCATE  cut the free pages at the end off the file.
+//
+// Moving a tree page rewrites the one child pointer to it and, for a leaf,
+// the next_leaf of its left neighbour; both are found by a descent with the
+// page's first key, in the table or else in one of its indexes (whose roots
+// move too: the header points at them).  Nothing else refers to a page by
+// number.  Index readers start at the table's root latch, as all others do.
+//
+// The work runs in steps bounded by VACUUM_STEP_PAGES.  A step is one
+// write operation holding the root latch exclusively once in-flight readers
+// have drained, and ends with a commit (unless a batch is open, which then
+// carries it), so readers and writers get in between steps.  Positions are
+// re-derived from keys at every step: the tree may change in between, and
+// the outcome is then merely less tidy, never wrong.
+class Vacuum {
+    enum Phase { CLUSTER, COMPACT, TRUNCATE, DONE };
+
+    BTree& tree;
+    Pager& pager;
+    Phase phase = CLUSTER;
+    uint64_t next_key = 0;                // CLUSTER: first key of the next leaf to place
+    uint32_t target = ROOT_PAGE + 1;      // CLUSTER: page that leaf goes to
+    uint32_t scan_top = INVALID_PAGE;     // COMPACT: pages above this one are done
+    VacuumStats st;
+
+    void cluster(uint32_t& budget);
+    void compact(uint32_t& budget);
+
+    bool make_room(uint32_t pg, uint32_t& budget);  // FALSE if pg cannot be freed
+    bool move_tree_page(uint32_t from, uint32_t to);
+    bool move_run(uint32_t pg, uint32_t from, uint32_t below);  // The run holding pg
+    bool in_run(uint32_t pg, uint32_t& first, uint32_t& count) const;
+    bool first_key(uint32_t pg, uint64_t& key);
+    uint32_t leaf_for(uint64_t key, uint32_t root);
+
+public:
+    explicit Vacuum(BTree& t);
+
+    bool step();                  // One bounded step; FALSE once the vacuum is done
+    void run(uint32_t max_steps = UINT32_MAX);
+    bool done() const { return phase == DONE; }
+    const VacuumStats& stats() const { return st; }
+};
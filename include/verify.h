@@ -0,0 +1,49 @@
+#pragma once
+#include "common.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// ==========================================
+// CLASS: PAGE VERIFIER (Background Checksums)
+// ==========================================
+// Checks page checksums off the read path.  The Pager copies a page it has
+// just read into a free slot and carries on; a single worker thread runs the
+// check on the copy.  When every slot is busy the page is dropped unchecked
+// (and counted), so a cold scan never waits on the verifier.
+//
+// The check function reports mismatches itself; the verifier only counts.
+class PageVerifier {
+    std::function<bool(uint32_t, void*)> check;  // FALSE on a mismatch
+    uint8_t* buffers = nullptr;        // slot_pages.size() pages
+    std::vector<uint32_t> slot_pages;  // Page held by each slot
+    std::vector<uint32_t> free_slots;
+    std::deque<uint32_t> queue;        // Filled slots, oldest first
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    bool stopping = false;
+
+    uint64_t stat_checked = 0;
+    uint64_t stat_failed  = 0;
+    uint64_t stat_dropped = 0;
+
+    uint8_t* slot_data(uint32_t idx) { return buffers + (size_t)idx * PAGE_SIZE; }
+    void worker_loop();
+
+public:
+    PageVerifier() = default;
+    ~PageVerifier();
+
+    void start(uint32_t num_slots, std::function<bool(uint32_t, void*)> check_fn);
+    void stop();  // Checks whatever is still queued first
+    bool running() const { return worker.joinable(); }
+
+    // Copies the image into a free slot; FALSE (dropped) if none is free.
+    bool submit(uint32_t page_num, const void* image);
+
+    void stats(uint64_t& checked, uint64_t& failed, uint64_t& dropped);
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+// ==========================================
+// CLASS: WAL (Write-Ahead Log)
+// ==========================================
+// Append-only log of full page images, kept next to the database file
+// ("<db>-wal").  The Pager never overwrites the main file directly: dirty
+// pages are appended here, and a commit group is made durable with a single
+// fsync.  A checkpoint later copies the newest image of every logged page
+// back into the main file (in page order) and truncates the log.
+//
+// File layout:
+//   [WalFileHeader: 16 bytes]
+//   [WalFrameHeader: 16 bytes][page image: PAGE_SIZE]  ... repeated
+//
+// A frame with commit_pages != 0 closes a commit group; every frame up to
+// and including it is committed.  Frames after the last commit frame belong
+// to a transaction that never committed and are discarded by recovery.
+//
+// A log left by an older build carries CRC32 frames and is recovered as such;
+// every log started (or reset) by this one uses CRC32C.
+struct WalFileHeader {
+    uint32_t magic;      // WAL_MAGIC
+    uint32_t page_size;  // Must match the database page size
+    uint32_t salt;       // Changes on every reset — stale frames never validate
+    uint32_t checksum_algo;  // CHECKSUM_* of the frame CRCs (0 = CRC32, older logs)
+};
+
+struct WalFrameHeader {
+    uint32_t page_num;
+    uint32_t commit_pages;  // DbHeader.total_pages on commit frames, else 0
+    uint32_t salt;          // Copy of WalFileHeader.salt
+    uint32_t crc;           // CRC over this header (crc = 0) + page image
+};
+
+class Wal {
+    int fd = -1;
+    WalFileHeader file_header;
+    uint64_t end_offset = 0;    // Append position
+    uint32_t frame_count = 0;   // Frames in the log (committed + pending)
+    std::atomic<uint32_t> commit_count{0};  // Frames covered by the last durable commit (sync() stores it unlocked)
+    uint32_t synced_target = 0; // Frames covered by the last appended commit frame
+
+    // page → file offset of its newest frame (committed or not)
+    std::unordered_map<uint32_t, uint64_t> index;
+
+    void write_file_header();
+    void recover();
+
+public:
+    Wal() = default;
+    ~Wal();
+
+    void open(const std::string& path);
+
+    // --- Frame I/O ---
+    // Appends frames with one write.  If commit_pages != 0 the last frame is
+    // marked as a commit frame; the commit is durable once sync() returns.
+    void append(const std::vector<std::pair<uint32_t, const void*>>& pages,
+                uint32_t commit_pages);
+    void sync();
+    bool lookup(uint32_t page_num, uint64_t& offset) const;
+    void read_frame(uint64_t offset, void* dest) const;
+
+    // --- Checkpoint support ---
+    // Newest frame of every logged page, sorted by page number.
+    std::vector<std::pair<uint32_t, uint64_t>> checkpoint_list() const;
+    void reset();  // Truncate after a checkpoint
+
+    uint32_t num_frames() const { return frame_count; }
+    uint32_t num_committed() const { return commit_count.load(std::memory_order_acquire); }
+    uint32_t num_pages() const { return index.size(); }
+    uint64_t size_bytes() const { return end_offset; }
+    uint32_t checksum_algo() const { return file_header.checksum_algo; }
+};
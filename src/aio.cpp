@@ -0,0 +1,112 @@
+#include "aio.h"
+#include "utils.h"
+#include <cstdlib>
+
+// ==========================================
+// ASYNC READER IMPLEMENTATION
+// ==========================================
+
+AsyncReader::~AsyncReader() {
+    stop();
+}
+
+void AsyncReader::start(int file_fd, uint32_t num_slots, uint32_t num_threads) {
+    if (running() || num_slots == 0 || num_threads == 0) return;
+    fd = file_fd;
+    buffers = (uint8_t*)std::aligned_alloc(PAGE_SIZE, (size_t)num_slots * PAGE_SIZE);
+    if (!buffers) return;
+    slots.assign(num_slots, Slot());
+    stopping = false;
+    for (uint32_t i = 0; i < num_threads; i++)
+        workers.emplace_back(&AsyncReader::worker_loop, this);
+}
+
+void AsyncReader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread& t : workers) t.join();
+    workers.clear();
+    queue.clear();
+    slots.clear();
+    std::free(buffers);
+    buffers = nullptr;
+}
+
+int AsyncReader::find_slot(uint32_t page_num) const {
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].state != SLOT_FREE && slots[i].page_num == page_num) return i;
+    }
+    return -1;
+}
+
+void AsyncReader::worker_loop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        work_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) return;
+        uint32_t idx = queue.front();
+        queue.pop_front();
+        slots[idx].state = SLOT_READING;
+        uint32_t page_num = slots[idx].page_num;
+
+        lock.unlock();
+        bool ok = pread_full(fd, slot_data(idx), PAGE_SIZE, (uint64_t)page_num * PAGE_SIZE);
+        lock.lock();
+
+        slots[idx].ok = ok;
+        slots[idx].state = SLOT_READY;
+        done_cv.notify_all();
+    }
+}
+
+bool AsyncReader::submit(uint32_t page_num) {
+    if (!running()) return false;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (find_slot(page_num) >= 0) return false;
+
+    // Free slot first, else recycle the oldest finished read nobody took
+    int victim = -1;
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].state == SLOT_FREE) { victim = i; break; }
+        if (slots[i].state == SLOT_READY && (victim < 0 || slots[i].seq < slots[victim].seq))
+            victim = i;
+    }
+    if (victim < 0) return false;
+
+    Slot& s = slots[victim];
+    s.page_num = page_num;
+    s.state = SLOT_QUEUED;
+    s.ok = false;
+    s.seq = next_seq++;
+    queue.push_back(victim);
+    work_cv.notify_one();
+    return true;
+}
+
+bool AsyncReader::take(uint32_t page_num, void* dest) {
+    if (!running()) return false;
+    std::unique_lock<std::mutex> lock(mtx);
+    int idx = find_slot(page_num);
+    if (idx < 0) return false;
+    done_cv.wait(lock, [&] { return slots[idx].state == SLOT_READY; });
+
+    bool ok = slots[idx].ok;
+    if (ok) std::memcpy(dest, slot_data(idx), PAGE_SIZE);
+    slots[idx].state = SLOT_FREE;
+    return ok;
+}
+
+void AsyncReader::discard() {
+    if (!running()) return;
+    std::unique_lock<std::mutex> lock(mtx);
+    for (uint32_t idx : queue) slots[idx].state = SLOT_FREE;
+    queue.clear();
+    done_cv.wait(lock, [this] {
+        for (const Slot& s : slots) if (s.state == SLOT_READING) return false;
+        return true;
+    });
+    for (Slot& s : slots) s.state = SLOT_FREE;
+}
@@ -0,0 +1,311 @@
+#include "backup.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// ==========================================
+// BACKUP IMPLEMENTATION
+// ==========================================
+
+namespace {
+// Where a page image came from: memory images are stamped, disk images verified
+enum ImageSource : uint8_t { FROM_FILE, FROM_WAL, FROM_MEMORY };
+
+struct DeltaRecord {
+    uint32_t page_num;
+    uint32_t reserved;
+};
+
+// Writes the pages to a full backup (at their place in the file) or appends
+// them as records to an incremental one
+class BackupWriter {
+    int fd;
+    bool delta;
+    uint64_t end = sizeof(BackupDeltaHeader);
+    std::vector<uint8_t> records;
+public:
+    BackupWriter(int out, bool incremental) : fd(out), delta(incremental) {}
+
+    bool write_run(uint32_t first, const uint8_t* images, uint32_t count) {
+        if (!delta) return pwrite_full(fd, images, (size_t)count * PAGE_SIZE, (uint64_t)first * PAGE_SIZE);
+        size_t record_size = sizeof(DeltaRecord) + PAGE_SIZE;
+        records.resize(count * record_size);
+        for (uint32_t k = 0; k < count; k++) {
+            DeltaRecord rec{first + k, 0};
+            std::memcpy(records.data() + k * record_size, &rec, sizeof(rec));
+            std::memcpy(records.data() + k * record_size + sizeof(rec), images + (size_t)k * PAGE_SIZE, PAGE_SIZE);
+        }
+        if (!pwrite_full(fd, records.data(), records.size(), end)) return false;
+        end += records.size();
+        return true;
+    }
+};
+}  // namespace
+
+bool Backup::full(const std::string& path) {
+    return copy(path, false);
+}
+
+bool Backup::incremental(const std::string& path) {
+    return copy(path, true);
+}
+
+bool Backup::copy(const std::string& path, bool incremental) {
+    auto start = std::chrono::steady_clock::now();
+    st = BackupStats();
+    std::string tmp = path + ".tmp";
+    int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        output() << "Error: Cannot create " << tmp << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    auto fail = [&](const std::string& message) {
+        output() << "Error: " << message << "\n";
+        ::close(out);
+        ::unlink(tmp.c_str());
+        return false;
+    };
+
+    // --- Capture: the state at one commit ---
+    std::optional<Snapshot> snapshot;
+    uint32_t total;
+    std::vector<uint32_t> pages;        // Through the pool, ascending
+    std::vector<uint32_t> held;         // Kept outside the pool: copied now
+    std::vector<uint8_t> held_images;
+    {
+        WriteOp op(pager);
+        DbHeader& h = pager.header;
+        if (pager.in_batch) return fail("Cannot back up inside a batch; commit it first.");
+        if (incremental && (h.backup_lsn == 0 || h.backup_lsn < pager.tracked_from)) {
+            return fail(h.backup_lsn == 0 ? std::string("No earlier backup; take a full one first.")
+                                          : "Changes since LSN " + std::to_string(h.backup_lsn) +
+                                            " were made before this process opened the database; take a full backup.");
+        }
+        pager.commit();
+        st.lsn = h.commit_lsn;
+        st.base_lsn = incremental ? h.backup_lsn : 0;
+        total = h.total_pages;
+        snapshot.emplace(pager);
+
+        auto in_run = [](uint32_t pg, uint32_t first, uint32_t count) { return pg >= first && pg < first + count; };
+        {
+            std::lock_guard<std::mutex> lock(pager.pool_mutex);
+            for (uint32_t pg = HEADER_PAGE + 1; pg < total; pg++) {
+                if (pager.fsm.is_free(pg)) {
+                    st.pages_free++;
+                } else if (incremental && (pg >= pager.page_lsn.size() || pager.page_lsn[pg] <= st.base_lsn)) {
+                    st.pages_unchanged++;
+                } else if (in_run(pg, h.bloom_first_page, h.bloom_pages) || in_run(pg, h.fsm_first_page, h.fsm_pages)) {
+                    held.push_back(pg);
+                } else {
+                    pages.push_back(pg);
+                }
+            }
+        }
+        held_images.resize((held.size() + 1) * PAGE_SIZE);
+        std::memcpy(held_images.data(), &h, sizeof(DbHeader));  // Page 0 is the header and zeros
+        for (size_t i = 0; i < held.size(); i++) {
+            if (!pager.read_uncached(held[i], held_images.data() + (i + 1) * PAGE_SIZE)) {
+                return fail("Backup aborted: cannot read Page " + std::to_string(held[i]) + ".");
+            }
+        }
+        held.insert(held.begin(), HEADER_PAGE);
+    }
+
+    // --- Stream: runs of consecutive pages, one pread each ---
+    BackupWriter writer(out, incremental);
+    uint64_t epoch = snapshot->get_epoch();
+    uint32_t algo = pager.header.checksum_algo;
+    std::vector<uint8_t> buf((size_t)BACKUP_RUN_PAGES * PAGE_SIZE);
+    ImageSource source[BACKUP_RUN_PAGES];
+    for (size_t i = 0; i < pages.size();) {
+        uint32_t first = pages[i], count = 1;
+        while (i + count < pages.size() && count < BACKUP_RUN_PAGES && pages[i + count] == first + count) count++;
+        // Anything changed since the epoch has a kept image; pages cached or
+        // logged are newer than the main file.  The run is read again if a
+        // checkpoint began meanwhile: it may have moved a page out of the WAL
+        // after the read (or be writing it during it), and the bytes read
+        // would be an older, valid image.
+        std::unique_lock<std::mutex> lock(pager.pool_mutex);
+        bool read_ok;
+        for (;;) {
+            uint64_t generation = pager.checkpoint_gen;
+            lock.unlock();
+            read_ok = pread_full(pager.fd, buf.data(), (size_t)count * PAGE_SIZE, (uint64_t)first * PAGE_SIZE);
+            st.reads++;
+            lock.lock();
+            if (pager.checkpoint_gen == generation) break;
+            st.rereads++;
+        }
+        if (!read_ok) return fail("Backup aborted: read failed at Page " + std::to_string(first) + ".");
+        for (uint32_t k = 0; k < count; k++) {
+            uint32_t pg = first + k;
+            uint8_t* dest = buf.data() + (size_t)k * PAGE_SIZE;
+            uint32_t idx;
+            uint64_t wal_offset;
+            source[k] = FROM_MEMORY;
+            if (const uint8_t* image = pager.version_image(epoch, pg)) {
+                std::memcpy(dest, image, PAGE_SIZE);
+                st.from_versions++;
+            } else if ((idx = pager.lookup_frame(pg)) != INVALID_FRAME) {
+                std::memcpy(dest, pager.frame_data(idx), PAGE_SIZE);
+            } else if (pager.wal.lookup(pg, wal_offset)) {
+                pager.wal.read_frame(wal_offset, dest);
+                source[k] = FROM_WAL;
+            } else {
+                source[k] = FROM_FILE;
+            }
+        }
+        lock.unlock();
+        for (uint32_t k = 0; k < count; k++) {
+            uint8_t* dest = buf.data() + (size_t)k * PAGE_SIZE;
+            if (source[k] == FROM_MEMORY) {
+                stamp_checksum(first + k, dest, algo);
+            } else if (!verify_checksum(first + k, dest, algo)) {
+                return fail("Backup aborted: checksum mismatch on Page " + std::to_string(first + k) + ".");
+            }
+        }
+        if (!writer.write_run(first, buf.data(), count)) return fail("Backup aborted: write failed.");
+        st.pages_copied += count;
+        i += count;
+    }
+    for (size_t i = 0; i < held.size(); i++) {
+        if (!writer.write_run(held[i], held_images.data() + i * PAGE_SIZE, 1)) return fail("Backup aborted: write failed.");
+    }
+    st.pages_copied += held.size();
+    snapshot.reset();
+
+    // --- Finish: length / header, durable, then renamed into place ---
+    bool ok;
+    if (incremental) {
+        BackupDeltaHeader dh{BACKUP_DELTA_MAGIC, PAGE_SIZE, total, (uint32_t)(pages.size() + held.size()),
+                             st.base_lsn, st.lsn};
+        ok = pwrite_full(out, &dh, sizeof(dh), 0);
+    } else {
+        ok = ::ftruncate(out, (off_t)total * PAGE_SIZE) == 0;  // Free pages at the end stay holes too
+    }
+    if (!ok || ::fsync(out) != 0) return fail("Backup aborted: write failed.");
+    ::close(out);
+    if (::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        output() << "Error: Cannot rename " << tmp << " to " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    {
+        WriteOp op(pager);
+        pager.header.backup_lsn = st.lsn;
+        if (!pager.in_batch) pager.commit();  // An open batch carries it
+    }
+    st.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// ==========================================
+// RESTORE
+// ==========================================
+
+// copy_file_range() first (an in-kernel copy, or a reflink where the file
+// system shares extents); plain reads and writes where it is unsupported
+static bool copy_file(int src, int dst, uint64_t len) {
+    uint64_t done = 0;
+    while (done < len) {
+        ssize_t n = ::copy_file_range(src, nullptr, dst, nullptr, len - done, 0);
+        if (n > 0) {
+            done += n;
+            continue;
+        }
+        if (n == 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)) break;
+        std::vector<uint8_t> buf((size_t)BACKUP_RUN_PAGES * PAGE_SIZE);
+        while (done < len) {
+            size_t chunk = std::min<uint64_t>(buf.size(), len - done);
+            if (!pread_full(src, buf.data(), chunk, done) || !pwrite_full(dst, buf.data(), chunk, done)) return false;
+            done += chunk;
+        }
+    }
+    return done == len;
+}
+
+bool restore_backup(const std::string& db_path, const std::vector<std::string>& files) {
+    std::string tmp = db_path + ".restore";
+    int src = ::open(files[0].c_str(), O_RDONLY);
+    DbHeader h{};
+    struct stat sb{};
+    if (src < 0 || ::fstat(src, &sb) != 0 || !pread_full(src, &h, sizeof(h), 0)) {
+        std::cerr << "ERROR: Cannot read backup " << files[0] << "\n";
+        if (src >= 0) ::close(src);
+        return false;
+    }
+    if (h.magic != DB_MAGIC || !valid_page_size(h.page_size)) {
+        std::cerr << "ERROR: " << files[0] << " is not a full backup (a ForgeDB database file).\n";
+        ::close(src);
+        return false;
+    }
+    set_page_size(h.page_size);
+
+    int dst = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    bool ok = dst >= 0 && copy_file(src, dst, sb.st_size);
+    ::close(src);
+    if (!ok) {
+        std::cerr << "ERROR: Cannot copy " << files[0] << " to " << tmp << "\n";
+        if (dst >= 0) ::close(dst);
+        ::unlink(tmp.c_str());
+        return false;
+    }
+
+    // Increments, in LSN order
+    uint64_t lsn = h.commit_lsn;
+    uint32_t total = h.total_pages;
+    std::vector<uint8_t> record(sizeof(DeltaRecord) + PAGE_SIZE);
+    for (size_t f = 1; ok && f < files.size(); f++) {
+        int in = ::open(files[f].c_str(), O_RDONLY);
+        BackupDeltaHeader dh{};
+        if (in < 0 || !pread_full(in, &dh, sizeof(dh), 0) || dh.magic != BACKUP_DELTA_MAGIC) {
+            std::cerr << "ERROR: " << files[f] << " is not an incremental backup.\n";
+            ok = false;
+        } else if (dh.page_size != PAGE_SIZE || dh.base_lsn != lsn) {
+            std::cerr << "ERROR: " << files[f] << " applies to LSN " << dh.base_lsn
+                      << "; the restore is at LSN " << lsn << ".\n";
+            ok = false;
+        }
+        uint64_t offset = sizeof(dh);
+        for (uint32_t r = 0; ok && r < dh.num_pages; r++, offset += record.size()) {
+            DeltaRecord rec;
+            uint8_t* image = record.data() + sizeof(rec);
+            ok = pread_full(in, record.data(), record.size(), offset);
+            std::memcpy(&rec, record.data(), sizeof(rec));
+            if (ok && rec.page_num >= dh.total_pages) {  // Past the restored file's end
+                std::cerr << "ERROR: " << files[f] << ": Page " << rec.page_num << " is past the end ("
+                          << dh.total_pages << " pages)\n";
+                ok = false;
+            }
+            if (ok && !verify_checksum(rec.page_num, image, h.checksum_algo)) {
+                std::cerr << "ERROR: " << files[f] << ": checksum mismatch on Page " << rec.page_num << "\n";
+                ok = false;
+            }
+            if (ok) ok = pwrite_full(dst, image, PAGE_SIZE, (uint64_t)rec.page_num * PAGE_SIZE);
+        }
+        lsn = dh.lsn;
+        total = dh.total_pages;
+        if (in >= 0) ::close(in);
+    }
+
+    ok = ok && ::ftruncate(dst, (off_t)total * PAGE_SIZE) == 0 && ::fsync(dst) == 0;
+    ::close(dst);
+    if (!ok || ::rename(tmp.c_str(), db_path.c_str()) != 0) {
+        std::cerr << "ERROR: Restore failed; " << db_path << " is unchanged.\n";
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    ::unlink((db_path + "-wal").c_str());  // Both belong to the replaced file
+    ::unlink((db_path + "-changes").c_str());
+    std::cout << "Restored " << db_path << " to LSN " << lsn << " from " << files.size() << " file(s).\n";
+    return true;
+}
@@ -1,43 +1,217 @@
 #include "bloom.h"
+#include "utils.h"
 #include <iostream>
-#include <cmath>
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 
-// Three independent hash functions (multiplicative hashing with distinct primes)
-uint32_t BloomFilter::hash1(uint32_t k) const { return (uint32_t)(((uint64_t)k * 2654435761ULL) % BLOOM_BITS); }
-uint32_t BloomFilter::hash2(uint32_t k) const { return (uint32_t)(((uint64_t)k * 0x85ebca6bULL) % BLOOM_BITS); }
-uint32_t BloomFilter::hash3(uint32_t k) const { return (uint32_t)(((uint64_t)(k ^ (k >> 16)) * 0xcc9e2d51ULL) % BLOOM_BITS); }
+#if defined(__x86_64__) && !defined(__SANITIZE_THREAD__)
+#include <immintrin.h>
+#define BLOOM_HAVE_AVX2 1
+#endif
 
-// Point the filter at the bloom area on page 0
-void BloomFilter::attach(void* page0) {
-    bits = (uint8_t*)page0 + BLOOM_OFFSET;
+// One 64-bit hash per key: the high half picks the block, the low half is
+// multiplied by eight odd salts whose top 6 bits pick one bit in each word.
+// Keys below 2^32 hash exactly as the 32-bit keys of format 6 did, so a filter
+// persisted before the upgrade stays valid.
+static const uint32_t BLOOM_SALT[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+static inline uint64_t bloom_hash(uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    h ^= h >> 32;
+    return h;
+}
+
+// Multiply-shift range reduction instead of a modulo
+static inline uint32_t block_of(uint64_t h, uint32_t num_blocks) {
+    return (uint32_t)(((h >> 32) * num_blocks) >> 32);
+}
+
+static inline uint64_t word_mask(uint32_t lo, uint32_t i) {
+    return 1ull << ((lo * BLOOM_SALT[i]) >> 26);
+}
+
+#ifdef BLOOM_HAVE_AVX2
+// Eight masks at once; the block is all-ones under both masks or the key is
+// absent.  A vector load never tears within a 64-bit lane, so a word the
+// writer is setting concurrently reads either before or after its bit.
+__attribute__((target("avx2")))
+static bool probe_avx2(const uint64_t* block, uint32_t lo) {
+    const __m256i salts = _mm256_loadu_si256((const __m256i*)BLOOM_SALT);
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)lo), salts), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i mask_lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shifts)));
+    __m256i mask_hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shifts, 1)));
+    __m256i words_lo = _mm256_load_si256((const __m256i*)block);
+    __m256i words_hi = _mm256_load_si256((const __m256i*)(block + 4));
+    return _mm256_testc_si256(words_lo, mask_lo) & _mm256_testc_si256(words_hi, mask_hi);
+}
+#endif
+
+static bool probe_scalar(const uint64_t* block, uint32_t lo) {
+    uint64_t missing = 0;
+    for (uint32_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+        uint64_t mask = word_mask(lo, i);
+        missing |= mask & ~__atomic_load_n(&block[i], __ATOMIC_RELAXED);
+    }
+    return missing == 0;
 }
 
-void BloomFilter::add(uint32_t key) {
-    set_bit(hash1(key));
-    set_bit(hash2(key));
-    set_bit(hash3(key));
+// --- Sizing ---
+
+BloomFilter::Table::~Table() { std::free(words); }
+
+uint32_t BloomFilter::capacity_of(uint32_t num_pages) {
+    uint64_t bits = (uint64_t)num_pages * blocks_per_page() * BLOOM_BLOCK_SIZE * 8;
+    return (uint32_t)std::min<uint64_t>(bits / BLOOM_BITS_PER_KEY, UINT32_MAX);
 }
 
-bool BloomFilter::possibly_contains(uint32_t key) const {
-    return get_bit(hash1(key)) && get_bit(hash2(key)) && get_bit(hash3(key));
+uint32_t BloomFilter::pages_for(uint64_t keys) {
+    uint64_t block_bits = BLOOM_BLOCK_SIZE * 8;
+    uint64_t blocks = (keys * BLOOM_BITS_PER_KEY + block_bits - 1) / block_bits;
+    uint64_t pages = (blocks + blocks_per_page() - 1) / blocks_per_page();
+    return (uint32_t)std::max<uint64_t>(pages, 1);
 }
 
-void BloomFilter::clear() {
-    std::memset(bits, 0, BLOOM_SIZE);
+std::unique_ptr<BloomFilter::Table> BloomFilter::make_table(uint32_t num_pages) {
+    auto t = std::make_unique<Table>();
+    t->num_pages = num_pages;
+    t->num_blocks = num_pages * blocks_per_page();
+    size_t bytes = (size_t)t->num_blocks * BLOOM_BLOCK_SIZE;
+    t->words = (uint64_t*)std::aligned_alloc(BLOOM_BLOCK_SIZE, bytes);
+    if (!t->words) {
+        std::cerr << "ERROR: Cannot allocate a " << num_pages << "-page bloom filter.\n";
+        std::exit(1);
+    }
+    std::memset(t->words, 0, bytes);
+    t->dirty.assign(num_pages, 0);
+    return t;
+}
+
+// --- Building ---
+
+bool BloomFilter::set_bits(Table& t, uint64_t key, uint32_t& block) {
+    uint64_t h = bloom_hash(key);
+    block = block_of(h, t.num_blocks);
+    uint64_t* words = t.words + (size_t)block * BLOOM_BLOCK_WORDS;
+    bool changed = false;
+    for (uint32_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+        uint64_t mask = word_mask((uint32_t)h, i);
+        changed |= !(__atomic_fetch_or(&words[i], mask, __ATOMIC_RELAXED) & mask);
+    }
+    return changed;
+}
+
+bool BloomFilter::read_page(Table& t, uint32_t index, const void* page) {
+    if (*(const uint8_t*)page != NODE_BLOOM) return false;
+    size_t per_page = (size_t)blocks_per_page() * BLOOM_BLOCK_WORDS;
+    std::memcpy(t.words + index * per_page, (const char*)page + BLOOM_PAGE_HEADER,
+                per_page * sizeof(uint64_t));
+    return true;
+}
+
+void BloomFilter::install(std::unique_ptr<Table> t, uint32_t first_page, bool dirty) {
+    Table* cur = live.load(std::memory_order_relaxed);
+    if (cur && cur->first_page == first_page && cur->num_pages == t->num_pages) {
+        size_t n = (size_t)cur->num_blocks * BLOOM_BLOCK_WORDS;
+        for (size_t i = 0; i < n; i++)
+            __atomic_store_n(&cur->words[i], t->words[i], __ATOMIC_RELAXED);
+        if (dirty) std::fill(cur->dirty.begin(), cur->dirty.end(), 1);
+        return;
+    }
+    t->first_page = first_page;
+    if (dirty) std::fill(t->dirty.begin(), t->dirty.end(), 1);
+    live.store(t.get(), std::memory_order_release);
+    tables.push_back(std::move(t));
+}
+
+void BloomFilter::move_to(uint32_t first_page) {
+    Table* t = live.load(std::memory_order_relaxed);
+    t->first_page = first_page;
+    std::fill(t->dirty.begin(), t->dirty.end(), 1);
+}
+
+// --- Filter Operations ---
+
+void BloomFilter::add(uint64_t key) {
+    Table* t = live.load(std::memory_order_relaxed);
+    uint32_t block;
+    if (set_bits(*t, key, block)) t->dirty[block / blocks_per_page()] = 1;
+}
+
+bool BloomFilter::possibly_contains(uint64_t key) const {
+    const Table* t = live.load(std::memory_order_acquire);
+    uint64_t h = bloom_hash(key);
+    const uint64_t* block = t->words + (size_t)block_of(h, t->num_blocks) * BLOOM_BLOCK_WORDS;
+#ifdef BLOOM_HAVE_AVX2
+    if (cpu_has_avx2()) return probe_avx2(block, (uint32_t)h);
+#endif
+    return probe_scalar(block, (uint32_t)h);
+}
+
+void BloomFilter::collect_dirty(std::vector<std::pair<uint32_t, const void*>>& out) {
+    Table* t = live.load(std::memory_order_relaxed);
+    if (!t) return;
+    uint32_t count = std::count(t->dirty.begin(), t->dirty.end(), 1);
+    if (count == 0) return;
+
+    images.assign((size_t)count * PAGE_SIZE, 0);
+    size_t per_page = (size_t)blocks_per_page() * BLOOM_BLOCK_WORDS;
+    uint8_t* image = images.data();
+    for (uint32_t p = 0; p < t->num_pages; p++) {
+        if (!t->dirty[p]) continue;
+        t->dirty[p] = 0;
+        image[OFFSET_TYPE] = NODE_BLOOM;
+        std::memcpy(image + BLOOM_PAGE_HEADER, t->words + p * per_page, per_page * sizeof(uint64_t));
+        out.push_back({t->first_page + p, image});
+        image += PAGE_SIZE;
+    }
 }
 
 void BloomFilter::print_stats() const {
-    uint32_t set_count = 0;
-    for (uint32_t i = 0; i < BLOOM_SIZE; i++) {
-        uint8_t b = bits[i];
-        while (b) { set_count += b & 1; b >>= 1; }
+    const Table* t = live.load(std::memory_order_acquire);
+    output() << "=== Bloom Filter ===\n";
+    if (!t) {
+        output() << "Size:     (not built)\n";
+        return;
     }
-    double fill = (double)set_count / BLOOM_BITS * 100.0;
-    double fpr  = std::pow((double)set_count / BLOOM_BITS, 3) * 100.0;
-    std::cout << "=== Bloom Filter ===\n";
-    std::cout << "Size:     " << BLOOM_SIZE << " bytes (" << BLOOM_BITS << " bits)\n";
-    std::cout << "Bits Set: " << set_count << " / " << BLOOM_BITS << "\n";
-    std::printf("Fill:     %.1f%%\n", fill);
-    std::printf("Est. FPR: ~%.4f%%\n", fpr);
+    // Expected FPR from the actual bits: a probe hits one random bit per word
+    uint64_t set_count = 0;
+    double fpr = 0;
+    for (uint32_t b = 0; b < t->num_blocks; b++) {
+        double p = 1.0;
+        for (uint32_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+            uint32_t bits = __builtin_popcountll(
+                __atomic_load_n(&t->words[(size_t)b * BLOOM_BLOCK_WORDS + i], __ATOMIC_RELAXED));
+            set_count += bits;
+            p *= bits / 64.0;
+        }
+        fpr += p;
+    }
+    fpr /= t->num_blocks;
+    uint64_t total_bits = (uint64_t)t->num_blocks * BLOOM_BLOCK_SIZE * 8;
+
+#ifdef BLOOM_HAVE_AVX2
+    const char* probe = cpu_has_avx2() ? "AVX2" : "scalar";
+#else
+    const char* probe = "scalar";
+#endif
+    output() << "Layout:   blocked, " << BLOOM_BLOCK_SIZE << "-byte blocks, "
+             << BLOOM_BLOCK_WORDS << " bits/key set (" << probe << " probe)\n";
+    output() << "Size:     " << t->num_pages << " page(s) at " << t->first_page << ", "
+             << t->num_blocks << " blocks (" << total_bits << " bits)\n";
+    output() << "Capacity: " << capacity_of(t->num_pages) << " keys at "
+             << BLOOM_BITS_PER_KEY << " bits/key\n";
+    output() << "Bits Set: " << set_count << " / " << total_bits << "\n";
+    char line[80];
+    std::snprintf(line, sizeof(line), "Fill:     %.1f%%\n", set_count * 100.0 / total_bits);
+    output() << line;
+    std::snprintf(line, sizeof(line), "Est. FPR: ~%.4f%% (target %.2f%%)\n",
+                  fpr * 100.0, BLOOM_TARGET_FPR * 100.0);
+    output() << line;
 }
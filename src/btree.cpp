@@ -1,6 +1,10 @@
 #include "btree.h"
 #include "utils.h"
+#include "metrics.h"
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <optional>
 
 // ==========================================
 // B+ TREE IMPLEMENTATION
@@ -11,247 +15,1157 @@ BTree::BTree(Pager& p) : pager(p), root_page_num(ROOT_PAGE) {
         // New DB — create root leaf at page 1
         pager.header.total_pages = ROOT_PAGE + 1;
         void* root = pager.get_page(ROOT_PAGE);
+        pager.mark_dirty(ROOT_PAGE);
         LeafNode node(root);
         node.initialize();
         node.set_root(true);
         pager.write_header();
+    } else if (pager.header.format_version < DB_FORMAT_VERSION) {
+        upgrade_format();
+    }
+    // Bloom pages changed since the last commit are logged with it.  Open
+    // reads nothing but the header: the persisted filter is loaded (or, if
+    // there is none, rebuilt) in the background.
+    pager.commit_hook = [this](std::vector<std::pair<uint32_t, const void*>>& out) {
+        bloom.collect_dirty(out);
+    };
+    if (!(pager.header.flags & DB_FLAG_BLOOM_VALID)) {
+        schedule_bloom_rebuild();
+    } else if (pager.header.bloom_pages == 0) {
+        // New database: empty tree, empty filter on the smallest run
+        install_bloom(BloomFilter::make_table(BloomFilter::pages_for(0)));
+        pager.write_header();
+        bloom_ready = true;
+    } else {
+        bloom_loading = true;
+        schedule_bloom_rebuild(true);
     }
-    // Attach bloom filter to page 0 and rebuild from leaf scan
-    bloom.attach(pager.get_page(HEADER_PAGE));
-    rebuild_bloom();
+}
+
+// A first rebuild is waited for (the filter is unusable without it); loading
+// a valid filter or refreshing stale bits is abandoned and simply runs again
+// on a later open.
+BTree::~BTree() {
+    bool valid;
+    {
+        WriteOp op(pager);
+        valid = (pager.header.flags & DB_FLAG_BLOOM_VALID) != 0;
+    }
+    if (valid) rebuild_stop = true;
+    if (rebuild_thread.joinable()) rebuild_thread.join();
+
+    // The last bloom pages go out now; the Pager outlives the filter
+    WriteOp op(pager);
+    pager.commit();
+    pager.commit_hook = nullptr;
 }
 
 // ==========================================
 // INSERT
 // ==========================================
 
-void BTree::insert(uint32_t id, Row& row) {
-    Cursor cursor = find(id);
+bool BTree::insert(uint64_t id, Row& row) {
+    WriteOp op(pager);
+    LatchScope latched{*this};
+    uint8_t rec[512];
+    uint16_t needed = serialize_row(row, rec);
+    Cursor cursor = find_for_write(id, WRITE_INSERT, needed);
     LeafNode leaf(pager.get_page(cursor.page_num));
 
     // Duplicate key check — primary keys must be unique
-    uint32_t n = leaf.get_num_cells();
-    // Binary search for exact match
-    uint32_t lo = 0, hi = n;
-    while (lo < hi) {
-        uint32_t mid = (lo + hi) / 2;
-        uint32_t mk = leaf.get_key(mid);
-        if (mk < id) lo = mid + 1;
-        else if (mk > id) hi = mid;
-        else { // exact match
-            std::cout << "Error: Duplicate key " << id << "\n";
-            return;
-        }
+    uint32_t existing;
+    if (leaf.find(id, existing)) {
+        output() << "Error: Duplicate key " << id << "\n";
+        return false;
     }
 
-    bloom.add(id);
-    uint16_t needed = serialized_row_size(row);
+    bloom_add(id);
+    pager.header.row_count++;
+    if (bloom_rebuild_due()) schedule_bloom_rebuild();
     if (!leaf.can_fit(needed)) {
-        split_leaf(cursor, id, row);
+        split_leaf(cursor, id, rec, needed);
     } else {
-        leaf.insert(id, row);
-        std::cout << "Executed. (Inserted into Page " << cursor.page_num
+        pager.mark_dirty(cursor.page_num);
+        leaf.insert_record(id, rec, needed);
+        LOG_AT(LOG_INFO) << "Executed. (Inserted into Page " << cursor.page_num
                   << ", record " << needed << "B)\n";
     }
+
+    // Indexes, in the same write operation (and so the same commit)
+    release_write_latches();
+    for (uint32_t c = 0; c < INDEX_COLUMNS; c++) {
+        if (has_index((IndexColumn)c)) index_add((IndexColumn)c, id, column_value(row, (IndexColumn)c));
+    }
+    return true;
 }
 
 // ==========================================
 // DELETE
 // ==========================================
 
-bool BTree::remove(uint32_t id) {
+bool BTree::remove(uint64_t id) {
     // Bloom filter: skip tree traversal if key definitely not present
-    if (!bloom.possibly_contains(id)) {
-        std::cout << "Error: Key " << id << " not found. (bloom: definite negative)\n";
+    wait_for_bloom_load();
+    if (bloom_ready && !bloom.possibly_contains(id)) {
+        stat_bloom_negatives++;
+        METRIC_INC(MET_BLOOM_NEGATIVES);
+        output() << "Error: Key " << id << " not found. (bloom: definite negative)\n";
         return false;
     }
-    Cursor cursor = find(id);
+    WriteOp op(pager);
+    LatchScope latched{*this};
+    Cursor cursor = find_for_write(id, WRITE_DELETE, 0);
     void* leaf_raw = pager.get_page(cursor.page_num);
     LeafNode leaf(leaf_raw);
 
-    if (!leaf.remove(id)) {
-        std::cout << "Error: Key " << id << " not found.\n";
+    uint32_t idx;
+    if (!leaf.find(id, idx)) {
+        output() << "Error: Key " << id << " not found.\n";
         return false;
     }
+    Row row = leaf.get_row(idx);  // Its index entries go once the tree is done
+    pager.mark_dirty(cursor.page_num);
+    leaf.remove_at(idx);
+    pager.header.row_count--;
+    pager.header.bloom_stale++;  // Its bits stay set until the next rebuild
+    if (bloom_rebuild_due()) schedule_bloom_rebuild();
 
-    std::cout << "Deleted key " << id << " from Page " << cursor.page_num << ".\n";
+    LOG_AT(LOG_INFO) << "Deleted key " << id << " from Page " << cursor.page_num << ".\n";
 
-    // Root leaf has no minimum occupancy constraint
-    if (leaf.is_root()) return true;
+    // Leaf underflow — must rebalance (the root leaf has no minimum occupancy)
+    if (!leaf.is_root() && leaf.leaf_underflow()) rebalance_leaf(cursor.page_num, cursor.path_stack);
 
-    // No underflow? Done.
-    if (!leaf.leaf_underflow()) return true;
+    release_write_latches();
+    for (uint32_t c = 0; c < INDEX_COLUMNS; c++) {
+        if (has_index((IndexColumn)c)) index_remove((IndexColumn)c, id, column_value(row, (IndexColumn)c));
+    }
+    return true;
+}
 
-    // Leaf underflow — must rebalance
-    rebalance_leaf(cursor.page_num, cursor.path_stack);
+// ==========================================
+// BATCHES
+// ==========================================
+// Header, free-space map and bloom changes and every dirty leaf/internal page are
+// written once, when the batch commits.
+
+bool BTree::begin_batch() {
+    WriteOp op(pager);
+    if (!pager.begin_batch()) {
+        output() << "Error: A batch is already open.\n";
+        return false;
+    }
+    LOG_AT(LOG_INFO) << "Batch started.\n";
+    return true;
+}
+
+bool BTree::commit_batch() {
+    WriteOp op(pager);
+    if (!pager.end_batch()) {
+        output() << "Error: No open batch to commit.\n";
+        return false;
+    }
+    LOG_AT(LOG_INFO) << "Batch committed.\n";
     return true;
 }
 
 // ==========================================
-// VISUALIZATION
+// BULK LOAD (bottom-up build)
 // ==========================================
+// Packs rows into leaves left-to-right, chains next_leaf, then builds each
+// internal level from the (min key, page) list of the level below — one
+// sequential pass per level, no find()/split.  Only valid on an empty table.
+// Readers queue on the root latch for the whole build, so unlike insert the
+// operation does not need to keep every page it touches pinned.
+
+uint32_t BTree::bulk_load(std::vector<Row>& rows, uint32_t fill_percent) {
+    WriteOp op(pager, false);
+    LatchScope latched{*this};
+    latch_for_write(root_page_num);
+    Node root(pager.get_page(root_page_num));
+    if (root.get_type() != NODE_LEAF ||
+        LeafNode(pager.get_page(root_page_num)).get_num_cells() != 0) {
+        output() << "Error: Bulk load requires an empty table.\n";
+        return 0;
+    }
+    if (rows.empty()) return 0;
+
+    auto by_id = [](const Row& a, const Row& b) { return a.id < b.id; };
+    if (!std::is_sorted(rows.begin(), rows.end(), by_id))
+        std::sort(rows.begin(), rows.end(), by_id);
+    auto dup = std::adjacent_find(rows.begin(), rows.end(),
+                                  [](const Row& a, const Row& b) { return a.id == b.id; });
+    if (dup != rows.end()) {
+        output() << "Error: Duplicate key " << dup->id << " in bulk load input.\n";
+        return 0;
+    }
+    fill_percent = std::max(BULK_FILL_MIN, std::min(fill_percent, 100u));
+
+    // Size the filter for the whole load up front (the table is empty)
+    uint32_t bloom_pages = BloomFilter::pages_for((uint64_t)rows.size() * BLOOM_HEADROOM);
+    if (bloom.attached() && bloom_pages > pager.header.bloom_pages)
+        install_bloom(BloomFilter::make_table(bloom_pages));
+
+    // Everything fits in the root leaf — no tree to build
+    uint32_t total_bytes = 0;
+    for (const Row& r : rows) total_bytes += serialized_row_size(r) + SLOT_SIZE;
+    if (total_bytes <= LEAF_USABLE_SPACE) {
+        LeafNode leaf(pager.get_page(root_page_num));
+        pager.mark_dirty(root_page_num);
+        for (const Row& r : rows) {
+            leaf.append(r);
+            bloom_add(r.id);
+        }
+        LOG_AT(LOG_INFO) << "Bulk-loaded " << rows.size() << " rows into root leaf.\n";
+    } else {
+        LevelList level = bulk_build_leaves(rows, fill_percent);
+        uint32_t num_leaves = level.size();
+        uint32_t height = 1;
+        while (level.size() > 1) {
+            level = bulk_build_internals(level, fill_percent, root_page_num);
+            height++;
+        }
+        LOG_AT(LOG_INFO) << "Bulk-loaded " << rows.size() << " rows into " << num_leaves
+                  << " leaves (height " << height << ").\n";
+    }
+    pager.header.row_count += rows.size();
+
+    // The indexes are as empty as the table was: built bottom-up as well
+    std::vector<IndexEntry> entries;
+    for (uint32_t c = 0; c < INDEX_COLUMNS; c++) {
+        if (!has_index((IndexColumn)c)) continue;
+        entries.clear();
+        for (const Row& r : rows) entries.push_back({0, r.id, column_value(r, (IndexColumn)c)});
+        build_index((IndexColumn)c, entries);
+    }
+    return rows.size();
+}
 
-void BTree::print_tree() {
-    _print_tree(root_page_num, 0);
+BTree::LevelList BTree::bulk_build_leaves(const std::vector<Row>& rows, uint32_t fill_percent) {
+    LeafPacker packer{*this, LEAF_USABLE_SPACE * fill_percent / 100, {}};
+    uint8_t rec[512];
+    for (const Row& r : rows) {
+        packer.add(r.id, rec, serialize_row(r, rec));
+        bloom_add(r.id);
+    }
+    return packer.leaves;
 }
 
-void BTree::print_json() {
-    _print_json(root_page_num);
-    std::cout << "\n";
+// Pages are not pinned: the current leaf is fetched again for every record
+void BTree::LeafPacker::add(uint64_t key, const uint8_t* rec, uint16_t len) {
+    uint32_t curr_page = leaves.empty() ? 0 : leaves.back().second;
+    if (curr_page == 0 || used + len + SLOT_SIZE > budget) {
+        uint32_t new_page = tree.pager.get_unused_page_num(curr_page);  // Next to its left sibling
+        LeafNode(tree.pager.get_page(new_page)).initialize();
+        if (curr_page != 0) {
+            LeafNode prev(tree.pager.get_page(curr_page));
+            tree.pager.mark_dirty(curr_page);
+            prev.set_next_leaf(new_page);
+        }
+        leaves.push_back({key, new_page});
+        curr_page = new_page;
+        used = 0;
+    }
+    LeafNode(tree.pager.get_page(curr_page)).append_record(key, rec, len);
+    used += len + SLOT_SIZE;
 }
 
-void BTree::select_all() {
-    uint32_t curr = get_leftmost_leaf();
-    while (curr != 0) {
-        LeafNode leaf(pager.get_page(curr));
-        for (uint32_t i = 0; i < leaf.get_num_cells(); i++) {
-            Row row = leaf.get_row(i);
-            std::cout << "  (" << row.id << ", " << row.username << ", " << row.email << ")\n";
+// Builds one internal level.  When the children fit under a single node it
+// becomes the root, written in place over the (empty) root page.  A node's
+// capacity depends on the spread of its keys, so nodes are first cut
+// greedily (each as full as fill_percent of its capacity allows), the last
+// two evened out so neither underflows, then the children are spread evenly
+// over as many nodes if every node still fits.
+BTree::LevelList BTree::bulk_build_internals(const LevelList& children, uint32_t fill_percent, uint32_t root) {
+    uint32_t n = children.size();
+    // count children starting at first, i.e. count - 1 keys from first + 1 on
+    auto fits = [&](uint32_t first, uint32_t count, uint32_t percent) {
+        if (count < 2) return count == 1;
+        uint32_t width = InternalNode::width_for(children[first + 1].first, children[first + count - 1].first);
+        return count - 1 <= std::max(1u, internal_capacity(width) * percent / 100);
+    };
+
+    std::vector<uint32_t> counts;
+    if (fits(0, n, 100)) {
+        counts.push_back(n);
+    } else {
+        for (uint32_t next = 0; next < n;) {
+            uint32_t count = std::min(2u, n - next);
+            while (next + count < n && fits(next, count + 1, fill_percent)) count++;
+            counts.push_back(count);
+            next += count;
         }
-        curr = leaf.get_next_leaf();
+        // Every greedy node but the last holds at least INTERNAL_MIN_KEYS keys.
+        // A short last node takes children over from the one before until it
+        // does too (INTERNAL_MIN_KEYS keys fit at any width), or, when the two
+        // cannot both reach it, the two become one (at most 2 * INTERNAL_MIN_KEYS
+        // keys, which also fit at any width).
+        uint32_t min_count = INTERNAL_MIN_KEYS + 1;
+        if (counts.back() < min_count) {
+            uint32_t pair = counts[counts.size() - 2] + counts.back();
+            counts.pop_back();
+            if (pair >= 2 * min_count) {
+                counts.back() = pair - min_count;
+                counts.push_back(min_count);
+            } else {
+                counts.back() = pair;
+            }
+        }
+        // Spread children evenly where every node still fits; each then holds
+        // at least the average, which is no less than min_count
+        uint32_t num_nodes = counts.size();
+        std::vector<uint32_t> even(num_nodes);
+        bool even_fits = true;
+        for (uint32_t i = 0, next = 0; i < num_nodes; next += even[i++]) {
+            even[i] = n / num_nodes + (i < n % num_nodes ? 1 : 0);
+            even_fits = even_fits && fits(next, even[i], fill_percent);
+        }
+        if (even_fits) counts = even;
+    }
+    bool is_root = counts.size() == 1;
+
+    LevelList parents;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> pages;
+    uint32_t next = 0;
+    uint32_t prev_page = 0;
+    for (uint32_t count : counts) {
+        keys.clear();
+        pages.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            if (i > 0) keys.push_back(children[next + i].first);
+            pages.push_back(children[next + i].second);
+        }
+        uint32_t page_num = is_root ? root : pager.get_unused_page_num(prev_page);
+        prev_page = page_num;
+        InternalNode node(pager.get_page(page_num));
+        pager.mark_dirty(page_num);
+        node.initialize();
+        node.set_root(is_root);
+        node.assign(keys.data(), pages.data(), count - 1);
+
+        parents.push_back({children[next].first, page_num});
+        next += count;
     }
+    return parents;
 }
 
-// Range scan: prints all rows with start ≤ id ≤ end
-void BTree::range_scan(uint32_t start, uint32_t end) {
-    Cursor cursor = find(start);
-    uint32_t curr = cursor.page_num;
-    while (curr != 0) {
-        LeafNode leaf(pager.get_page(curr));
-        for (uint32_t i = 0; i < leaf.get_num_cells(); i++) {
-            uint32_t key = leaf.get_key(i);
-            if (key > end) return;
-            if (key >= start) {
-                Row row = leaf.get_row(i);
-                std::cout << "  (" << row.id << ", " << row.username << ", " << row.email << ")\n";
+// Hangs a level of leaves built bottom-up under root: left an empty leaf for
+// none, given the only leaf's contents, or made the top of the internal
+// levels built over them.
+void BTree::build_root(LevelList level, uint32_t root) {
+    pager.mark_dirty(root);
+    if (level.empty()) {
+        LeafNode(pager.get_page(root)).initialize();
+    } else if (level.size() == 1) {
+        std::vector<uint8_t> copy(PAGE_SIZE);  // The two pages need not be resident together
+        std::memcpy(copy.data(), pager.get_page(level[0].second), PAGE_SIZE);
+        std::memcpy(pager.get_page(root), copy.data(), PAGE_SIZE);
+        pager.free_page(level[0].second);
+    } else {
+        while (level.size() > 1) level = bulk_build_internals(level, BULK_FILL_DEFAULT, root);
+    }
+    Node(pager.get_page(root)).set_root(true);
+}
+
+// ==========================================
+// FORMAT UPGRADE
+// ==========================================
+// The Pager has brought older files up to format 6.  A format 6 tree is
+// rebuilt bottom-up, as by a bulk load: its records are packed into new
+// leaves and the internal levels built over them, the root again on page 1.
+// The old pages are freed afterwards.  Format 7 needs no more than the
+// (empty) index roots.  Everything is one commit, so a crash leaves the old
+// file in place.
+
+void BTree::upgrade_format() {
+    WriteOp op(pager, false);
+    std::cerr << "Upgrading to format " << DB_FORMAT_VERSION;
+    if (pager.header.format_version <= DB_FORMAT_NARROW_KEYS) {
+        std::cerr << ": rebuilding the tree with 64-bit keys.\n";
+        widen_keys();
+    } else {
+        std::cerr << ".\n";
+    }
+    std::memset(pager.header.index_roots, 0, sizeof(pager.header.index_roots));
+    pager.header.format_version = DB_FORMAT_VERSION;
+    pager.write_header();
+    pager.commit();
+}
+
+void BTree::widen_keys() {
+    // Old tree: every page, and the leftmost leaf to start the chain from
+    std::vector<uint32_t> old_pages, pending{root_page_num};
+    uint32_t leftmost = 0;
+    while (!pending.empty()) {
+        uint32_t pg = pending.back();
+        pending.pop_back();
+        old_pages.push_back(pg);
+        NarrowNode node{(const uint8_t*)pager.get_page(pg)};
+        if (node.type() != NODE_INTERNAL) continue;
+        if (leftmost == 0 && node.num_keys() > 0) {
+            uint32_t child = node.child(0);
+            while (true) {
+                NarrowNode down{(const uint8_t*)pager.get_page(child)};
+                if (down.type() != NODE_INTERNAL) break;
+                child = down.child(0);
             }
+            leftmost = child;
         }
-        curr = leaf.get_next_leaf();
+        for (uint32_t i = 0; i <= node.num_keys(); i++) pending.push_back(node.child(i));
     }
+    if (leftmost == 0) leftmost = root_page_num;
+
+    LeafPacker packer{*this, LEAF_USABLE_SPACE * BULK_FILL_DEFAULT / 100, {}};
+    std::vector<uint8_t> copy(PAGE_SIZE);
+    uint64_t rows = 0;
+    for (uint32_t pg = leftmost; pg != 0;) {
+        // The packer's page fetches may evict the old leaf
+        std::memcpy(copy.data(), pager.get_page(pg), PAGE_SIZE);
+        NarrowNode leaf{copy.data()};
+        for (uint32_t i = 0; i < leaf.num_keys(); i++) {
+            uint16_t len;
+            const uint8_t* rec = leaf.record(i, len);
+            packer.add(leaf.key(i), rec, len);
+            rows++;
+        }
+        pg = leaf.next_leaf();
+    }
+
+    build_root(packer.leaves, root_page_num);
+    for (uint32_t pg : old_pages) {
+        if (pg != root_page_num) pager.free_page(pg);
+    }
+    std::cerr << "Rebuilt " << rows << " rows with 64-bit keys (" << old_pages.size()
+              << " pages before, " << packer.leaves.size() << " leaves after).\n";
 }
 
-uint32_t BTree::get_leftmost_leaf() {
-    uint32_t curr = root_page_num;
-    void* raw = pager.get_page(curr);
-    Node node(raw);
-    while (node.get_type() == NODE_INTERNAL) {
-        InternalNode internal(raw);
-        curr = internal.get_child(0);
-        raw = pager.get_page(curr);
-        node = Node(raw);
+// ==========================================
+// SECONDARY INDEXES
+// ==========================================
+// An index is a B+Tree like the table's, rooted at DbHeader.index_roots, and
+// written by the same code (find_for_write, split_leaf, rebalance_leaf); each
+// insert and remove updates it inside the table's write operation.
+
+uint32_t BTree::index_hash(std::string_view value) {
+    return crc32c_compute((const uint8_t*)value.data(), value.size());
+}
+
+// Calls visit(key, id, value) for the entries from key `from` to the end of
+// its bucket, in key order, until it returns FALSE.
+template <class Visit>
+void BTree::scan_index(IndexColumn column, uint64_t from, Visit visit) {
+    uint64_t last = make_key(from >> 32, UINT32_MAX);
+    PageHandle node = pager.acquire(root_page_num, LATCH_SHARED);
+    uint32_t root = pager.header.index_roots[column];
+    if (root == 0) {
+        pager.release(node);
+        return;
+    }
+    PageHandle child = pager.acquire(root, LATCH_SHARED);
+    pager.release(node);
+    node = child;
+    while (Node(node.data).get_type() == NODE_INTERNAL) {
+        child = pager.acquire(InternalNode(node.data).find_child(from), LATCH_SHARED);
+        pager.release(node);
+        node = child;
+    }
+
+    uint32_t pos = LeafNode(node.data).lower_bound(from);
+    do {
+        LeafNode leaf(node.data);
+        for (uint32_t n = leaf.get_num_cells(); pos < n; pos++) {
+            uint64_t key = leaf.get_key(pos);
+            const uint8_t* rec = leaf.record_ptr(pos);
+            uint64_t id;
+            std::memcpy(&id, rec, sizeof(id));
+            if (key > last ||
+                !visit(key, id, std::string_view((const char*)rec + sizeof(id), leaf.slot_length(pos) - sizeof(id)))) {
+                pager.release(node);
+                return;
+            }
+        }
+        pos = 0;
+    } while (step_right(node));
+}
+
+void BTree::index_add(IndexColumn column, uint64_t id, std::string_view value) {
+    uint8_t rec[sizeof(id) + sizeof(Row::email)];
+    std::memcpy(rec, &id, sizeof(id));
+    std::memcpy(rec + sizeof(id), value.data(), value.size());
+    uint16_t len = sizeof(id) + value.size();
+    uint32_t hash = index_hash(value);
+
+    for (uint32_t lo = (uint32_t)id;; lo++) {  // Wraps within the bucket
+        uint64_t key = make_key(hash, lo);
+        Cursor cursor = find_for_write(key, WRITE_INSERT, len, pager.header.index_roots[column]);
+        LeafNode leaf(pager.get_page(cursor.page_num));
+        uint32_t existing;
+        if (leaf.find(key, existing)) {
+            release_write_latches();
+            continue;
+        }
+        if (!leaf.can_fit(len)) {
+            split_leaf(cursor, key, rec, len);
+        } else {
+            pager.mark_dirty(cursor.page_num);
+            leaf.insert_record(key, rec, len);
+        }
+        release_write_latches();
+        return;
+    }
+}
+
+// The entry is searched for from where index_add() first tried to put it,
+// then from the start of the bucket, in case its key wrapped around.
+void BTree::index_remove(IndexColumn column, uint64_t id, std::string_view value) {
+    uint32_t hash = index_hash(value);
+    uint64_t found = 0;
+    bool hit = false;
+    auto match = [&](uint64_t key, uint64_t entry_id, std::string_view entry_value) {
+        hit = entry_id == id && entry_value == value;
+        if (hit) found = key;
+        return !hit;
+    };
+    scan_index(column, make_key(hash, (uint32_t)id), match);
+    if (!hit) scan_index(column, make_key(hash, 0), match);
+    if (!hit) {
+        std::cerr << "WARNING: No " << column_name(column) << " index entry for key " << id << ".\n";
+        return;
+    }
+
+    Cursor cursor = find_for_write(found, WRITE_DELETE, 0, pager.header.index_roots[column]);
+    LeafNode leaf(pager.get_page(cursor.page_num));
+    pager.mark_dirty(cursor.page_num);
+    leaf.remove(found);
+    if (!leaf.is_root() && leaf.leaf_underflow()) rebalance_leaf(cursor.page_num, cursor.path_stack);
+    release_write_latches();
+}
+
+// Bottom-up, as a bulk load.  Within a bucket keys follow the ids' low
+// halves, each moved past the one before it if taken; should that run off the
+// end of the bucket, the bucket is simply numbered from 0.
+void BTree::build_index(IndexColumn column, std::vector<IndexEntry>& entries) {
+    uint32_t root = pager.header.index_roots[column];
+    std::vector<uint32_t> old_pages;
+    collect_pages(root, old_pages);
+    for (uint32_t pg : old_pages) {
+        if (pg != root) pager.free_page(pg);
+    }
+
+    for (IndexEntry& e : entries) e.key = make_key(index_hash(e.value), (uint32_t)e.id);
+    std::sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+        return a.key != b.key ? a.key < b.key : a.id < b.id;
+    });
+    for (size_t first = 0, end; first < entries.size(); first = end) {
+        uint64_t bucket = entries[first].key >> 32;
+        bool wrapped = false;
+        for (end = first + 1; end < entries.size() && entries[end].key >> 32 == bucket; end++) {
+            if (entries[end].key > entries[end - 1].key) continue;
+            wrapped = wrapped || (uint32_t)entries[end - 1].key == UINT32_MAX;
+            entries[end].key = entries[end - 1].key + 1;
+        }
+        if (wrapped) {
+            for (size_t i = first; i < end; i++) entries[i].key = make_key(bucket, i - first);
+        }
+    }
+
+    LeafPacker packer{*this, LEAF_USABLE_SPACE * BULK_FILL_DEFAULT / 100, {}};
+    uint8_t rec[sizeof(uint64_t) + sizeof(Row::email)];
+    for (const IndexEntry& e : entries) {
+        std::memcpy(rec, &e.id, sizeof(e.id));
+        std::memcpy(rec + sizeof(e.id), e.value.data(), e.value.size());
+        packer.add(e.key, rec, sizeof(e.id) + e.value.size());
+    }
+    build_root(packer.leaves, root);
+}
+
+// Caller holds the tree exclusively
+void BTree::collect_pages(uint32_t root, std::vector<uint32_t>& pages) {
+    std::vector<uint32_t> pending{root};
+    while (!pending.empty()) {
+        uint32_t pg = pending.back();
+        pending.pop_back();
+        pages.push_back(pg);
+        InternalNode node(pager.get_page(pg));
+        if (node.get_type() != NODE_INTERNAL) continue;
+        for (uint32_t i = 0; i <= node.get_num_keys(); i++) pending.push_back(node.get_child(i));
+    }
+}
+
+// Readers queue on the table's root latch for the whole build, as for a
+// bulk load.  The values are gathered from the leaves first, in key order.
+bool BTree::create_index(IndexColumn column) {
+    WriteOp op(pager, false);
+    LatchScope latched{*this};
+    latch_for_write(root_page_num);
+    if (has_index(column)) {
+        output() << "Error: " << column_name(column) << " is already indexed.\n";
+        return false;
+    }
+
+    std::string values;
+    std::vector<std::pair<uint64_t, uint32_t>> ids;  // Row id, end of its value in values
+    uint32_t pg = root_page_num;
+    while (Node(pager.get_page(pg)).get_type() == NODE_INTERNAL) pg = InternalNode(pager.get_page(pg)).get_child(0);
+    for (; pg != 0; pg = LeafNode(pager.get_page(pg)).get_next_leaf()) {
+        LeafNode leaf(pager.get_page(pg));
+        for (uint32_t i = 0; i < leaf.get_num_cells(); i++) {
+            RowView row = leaf.view(i);
+            values.append(column_value(row, column));
+            ids.push_back({row.id, (uint32_t)values.size()});
+        }
     }
-    return curr;
+    std::vector<IndexEntry> entries;
+    entries.reserve(ids.size());
+    for (size_t i = 0, begin = 0; i < ids.size(); begin = ids[i++].second)
+        entries.push_back({0, ids[i].first, std::string_view(values).substr(begin, ids[i].second - begin)});
+
+    uint32_t root = pager.get_unused_page_num(0);
+    LeafNode(pager.get_page(root)).initialize();
+    pager.header.index_roots[column] = root;
+    build_index(column, entries);
+    pager.write_header();
+    LOG_AT(LOG_INFO) << "Indexed " << column_name(column) << ": " << entries.size() << " row(s), root Page "
+             << root << ".\n";
+    return true;
+}
+
+// In-flight index readers are drained first: they passed the root latch
+// before it was taken.
+bool BTree::drop_index(IndexColumn column) {
+    WriteOp op(pager, false);
+    LatchScope latched{*this};
+    latch_for_write(root_page_num);
+    pager.wait_for_readers(1);
+    if (!has_index(column)) {
+        output() << "Error: " << column_name(column) << " is not indexed.\n";
+        return false;
+    }
+    std::vector<uint32_t> pages;
+    collect_pages(pager.header.index_roots[column], pages);
+    for (uint32_t pg : pages) pager.free_page(pg);
+    pager.header.index_roots[column] = 0;
+    pager.write_header();
+    LOG_AT(LOG_INFO) << "Dropped the " << column_name(column) << " index (" << pages.size() << " page(s) freed).\n";
+    return true;
+}
+
+std::vector<uint64_t> BTree::index_lookup(IndexColumn column, std::string_view value) {
+    std::vector<uint64_t> ids;
+    scan_index(column, make_key(index_hash(value), 0), [&](uint64_t, uint64_t id, std::string_view v) {
+        if (v == value) ids.push_back(id);
+        return true;
+    });
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+void BTree::print_indexes() {
+    for (uint32_t c = 0; c < INDEX_COLUMNS; c++) {
+        IndexColumn column = (IndexColumn)c;
+        PageHandle node = pager.acquire(root_page_num, LATCH_SHARED);
+        uint32_t root = pager.header.index_roots[column];
+        if (root == 0) {
+            pager.release(node);
+            output() << column_name(column) << ": not indexed\n";
+            continue;
+        }
+        PageHandle child = pager.acquire(root, LATCH_SHARED);
+        pager.release(node);
+        node = child;
+        uint32_t height = 1;
+        for (; Node(node.data).get_type() == NODE_INTERNAL; height++) {
+            child = pager.acquire(InternalNode(node.data).get_child(0), LATCH_SHARED);
+            pager.release(node);
+            node = child;
+        }
+        uint64_t entries = 0;
+        uint32_t leaves = 0;
+        do {
+            entries += LeafNode(node.data).get_num_cells();
+            leaves++;
+        } while (step_right(node));
+        output() << column_name(column) << ": " << entries << " entries in " << leaves
+                 << " leaves (height " << height << ", root Page " << root << ")\n";
+    }
+}
+
+// ==========================================
+// VISUALIZATION
+// ==========================================
+
+void BTree::print_tree() {
+    Snapshot snap(pager);
+    _print_tree(snap, root_page_num, 0);
+}
+
+void BTree::print_json() {
+    Snapshot snap(pager);
+    OutputBuffer out;
+    _print_json(snap, root_page_num, out);
+    out << '\n';
+}
+
+uint32_t BTree::get_leftmost_leaf() {
+    PageHandle handle = find_shared(0);
+    uint32_t page_num = handle.page_num;
+    pager.release(handle);
+    return page_num;
 }
 
 // ==========================================
 // BLOOM FILTER PUBLIC API
 // ==========================================
 
-bool BTree::find_row(uint32_t id, Row& out_row) {
-    if (!bloom.possibly_contains(id)) {
-        std::cout << "Bloom: DEFINITELY NOT PRESENT (0 disk reads)\n";
+bool BTree::find_row(uint64_t id, Row& out_row) {
+    wait_for_bloom_load();
+    if (!bloom_ready) {
+        LOG_AT(LOG_DEBUG) << "Bloom: REBUILDING (searching B+Tree...)\n";
+    } else if (!bloom.possibly_contains(id)) {
+        stat_bloom_negatives++;
+        METRIC_INC(MET_BLOOM_NEGATIVES);
+        LOG_AT(LOG_DEBUG) << "Bloom: DEFINITELY NOT PRESENT (0 disk reads)\n";
         return false;
+    } else {
+        LOG_AT(LOG_DEBUG) << "Bloom: MAYBE (searching B+Tree...)\n";
     }
-    std::cout << "Bloom: MAYBE (searching B+Tree...)\n";
-    Cursor cursor = find(id);
-    LeafNode leaf(pager.get_page(cursor.page_num));
-    for (uint32_t i = 0; i < leaf.get_num_cells(); i++) {
-        if (leaf.get_key(i) == id) {
-            out_row = leaf.get_row(i);
-            return true;
-        }
+    PageHandle handle = find_shared(id);
+    LeafNode leaf(handle.data);
+    uint32_t idx;
+    if (leaf.find(id, idx)) {
+        out_row = leaf.get_row(idx);
+        pager.release(handle);
+        if (bloom_ready) METRIC_INC(MET_BLOOM_TRUE_POSITIVES);
+        return true;
+    }
+    pager.release(handle);
+    if (bloom_ready) {
+        stat_bloom_false_positives++;
+        METRIC_INC(MET_BLOOM_FALSE_POSITIVES);
+        LOG_AT(LOG_DEBUG) << "Bloom: FALSE POSITIVE — key not in B+Tree.\n";
     }
-    std::cout << "Bloom: FALSE POSITIVE — key not in B+Tree.\n";
     return false;
 }
 
-void BTree::print_bloom_stats() { bloom.print_stats(); }
+// The batch goes through the bloom filter first; the survivors are sorted and
+// walked down the tree together.  Each internal node is visited once for all
+// keys below it (its latch held while its children are), and each leaf
+// resolves all of its keys in one merge pass.
+std::vector<Row> BTree::find_rows(const std::vector<uint64_t>& ids, LookupStats* stats) {
+    wait_for_bloom_load();
+    LookupStats local;
+    LookupStats& st = stats ? *stats : local;
+
+    std::vector<uint64_t> keys(ids);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    st.requested = keys.size();
+    if (bloom_ready) {
+        auto rejected = std::remove_if(keys.begin(), keys.end(),
+                                       [this](uint64_t k) { return !bloom.possibly_contains(k); });
+        st.bloom_rejected = keys.end() - rejected;
+        stat_bloom_negatives += st.bloom_rejected;
+        METRIC_ADD(MET_BLOOM_NEGATIVES, st.bloom_rejected);
+        keys.erase(rejected, keys.end());
+    }
+
+    std::vector<Row> rows;
+    if (keys.empty()) return rows;
+    rows.reserve(keys.size());
+    PageHandle root = pager.acquire(root_page_num, LATCH_SHARED);
+    probe_subtree(root, keys.data(), keys.size(), rows, st);
+    pager.release(root);
+    if (bloom_ready) {
+        stat_bloom_false_positives += keys.size() - rows.size();
+        METRIC_ADD(MET_BLOOM_FALSE_POSITIVES, keys.size() - rows.size());
+        METRIC_ADD(MET_BLOOM_TRUE_POSITIVES, rows.size());
+    }
+    return rows;
+}
+
+// keys: sorted, distinct, all routed to node (S-latched by the caller)
+void BTree::probe_subtree(PageHandle& node, const uint64_t* keys, size_t count,
+                          std::vector<Row>& out, LookupStats& st) {
+    st.pages_visited++;
+    if (Node(node.data).get_type() != NODE_INTERNAL) {
+        st.leaves_visited++;
+        LeafNode leaf(node.data);
+        uint32_t cells = leaf.get_num_cells();
+        uint32_t pos = 0;  // Keys ascend, so each search starts where the last ended
+        for (size_t i = 0; i < count; i++) {
+            pos = leaf.lower_bound(keys[i], pos);
+            if (pos < cells && leaf.get_key(pos) == keys[i]) out.push_back(leaf.get_row(pos));
+        }
+        return;
+    }
+
+    // Split the keys into one run per child, then prefetch those children
+    // before descending into the first
+    InternalNode internal(node.data);
+    uint32_t num_keys = internal.get_num_keys();
+    struct Run { uint32_t child; size_t begin, end; };
+    std::vector<Run> runs;
+    for (size_t i = 0; i < count;) {
+        uint32_t idx = internal.child_index_for(keys[i]);
+        size_t end = idx < num_keys
+            ? std::lower_bound(keys + i, keys + count, internal.get_key(idx)) - keys
+            : count;
+        runs.push_back({internal.get_child(idx), i, end});
+        i = end;
+    }
+    if (runs.size() > 1) {
+        std::vector<uint32_t> pages;
+        for (const Run& r : runs) pages.push_back(r.child);
+        pager.prefetch(pages);
+    }
+    for (const Run& r : runs) {
+        PageHandle child = pager.acquire(r.child, LATCH_SHARED);
+        probe_subtree(child, keys + r.begin, r.end - r.begin, out, st);
+        pager.release(child);
+    }
+}
+
+void BTree::print_bloom_stats() {
+    wait_for_bloom_load();
+    bloom.print_stats();
+    char line[96];
+    if (bloom_ready) {
+        uint32_t probes;
+        double fpr = measure_bloom_fpr(probes);
+        std::snprintf(line, sizeof(line), "Measured: %.4f%% over %u absent keys (%s target)\n",
+                      fpr * 100.0, probes, fpr <= BLOOM_TARGET_FPR ? "within" : "ABOVE");
+        output() << line;
+    }
+    output() << "Rows:     " << pager.header.row_count << " of " << pager.header.bloom_capacity
+             << " capacity\n";
+    output() << "Lookups:  " << stat_bloom_negatives << " rejected, "
+             << stat_bloom_false_positives << " false positive(s)\n";
+    output() << "Stale:    " << pager.header.bloom_stale << " deleted key(s) since the last rebuild"
+             << (rebuild_running ? " (rebuilding)" : "") << "\n";
+    if (!bloom_ready) output() << "State:    not yet loaded or built — lookups bypass the filter\n";
+}
+
+// Probes keys above the largest one in the tree: all known absent, so every
+// hit is a false positive.
+double BTree::measure_bloom_fpr(uint32_t& probes) {
+    PageHandle handle = find_shared(UINT64_MAX);
+    LeafNode leaf(handle.data);
+    uint32_t n = leaf.get_num_cells();
+    uint64_t last = n ? leaf.get_key(n - 1) : 0;
+    pager.release(handle);
+
+    uint64_t start = n ? last + 1 : 0;
+    probes = BLOOM_FPR_PROBES;
+    if (n && last == UINT64_MAX) probes = 0;
+    else if (UINT64_MAX - start < probes) probes = (uint32_t)(UINT64_MAX - start + 1);
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i < probes; i++)
+        hits += bloom.possibly_contains(start + i);
+    return probes ? (double)hits / probes : 0.0;
+}
+
 void BTree::do_rebuild_bloom() { rebuild_bloom(); }
 
 // ==========================================
-// PRIVATE: CURSOR / FIND
+// PRIVATE: LATCHED DESCENT
 // ==========================================
 
-BTree::Cursor BTree::find(uint32_t key) {
-    uint32_t curr_page = root_page_num;
-    std::vector<uint32_t> path;
+PageHandle BTree::find_shared(uint64_t key, uint64_t* lower_fence) {
+    METRIC_TIMER(HIST_DESCENT_NS);
+    PageHandle node = pager.acquire(root_page_num, LATCH_SHARED);
+    uint64_t fence = 0;
+    uint32_t depth = 1;
+    for (; Node(node.data).get_type() == NODE_INTERNAL; depth++) {
+        InternalNode internal(node.data);
+        uint32_t idx = internal.child_index_for(key);
+        if (idx > 0) fence = internal.get_key(idx - 1);
+        PageHandle child = pager.acquire(internal.get_child(idx), LATCH_SHARED);
+        pager.release(node);
+        node = child;
+    }
+    METRIC_RECORD(HIST_DESCENT_DEPTH, depth);
+    if (lower_fence) *lower_fence = fence;
+    return node;
+}
 
-    void* node_raw = pager.get_page(curr_page);
-    Node node(node_raw);
+uint32_t BTree::find_in_snapshot(const Snapshot& snap, uint64_t key, void* dest, uint64_t* lower_fence) {
+    METRIC_TIMER(HIST_DESCENT_NS);
+    uint32_t page_num = root_page_num;
+    uint64_t fence = 0;
+    uint32_t depth = 1;
+    snap.read(page_num, dest);
+    for (; Node(dest).get_type() == NODE_INTERNAL; depth++) {
+        InternalNode internal(dest);
+        uint32_t idx = internal.child_index_for(key);
+        if (idx > 0) fence = internal.get_key(idx - 1);
+        page_num = internal.get_child(idx);
+        snap.read(page_num, dest);
+    }
+    METRIC_RECORD(HIST_DESCENT_DEPTH, depth);
+    if (lower_fence) *lower_fence = fence;
+    return page_num;
+}
 
-    while (node.get_type() == NODE_INTERNAL) {
+bool BTree::step_right(PageHandle& leaf) {
+    uint32_t next = LeafNode(leaf.data).get_next_leaf();
+    if (next == 0) {
+        pager.release(leaf);
+        return false;
+    }
+    PageHandle next_leaf = pager.acquire(next, LATCH_SHARED);
+    pager.release(leaf);
+    leaf = next_leaf;
+    return true;
+}
+
+// Exclusive crabbing.  On a delete that may underflow the leaf, its siblings
+// under the same parent are latched too (left to right, the order scans use),
+// since a borrow or merge rewrites one of them.  Internal-level siblings are
+// latched on demand by rebalance_internal(), under their X-latched parent.
+BTree::Cursor BTree::find_for_write(uint64_t key, WriteIntent intent, uint16_t row_size, uint32_t root) {
+    METRIC_TIMER(HIST_DESCENT_NS);
+    uint32_t curr_page = root;
+    std::vector<uint32_t> path;
+    latch_for_write(curr_page);
+
+    while (Node(write_latches.back().data).get_type() == NODE_INTERNAL) {
         path.push_back(curr_page); // Push internal node to stack
-        InternalNode internal(node_raw);
-        curr_page = internal.find_child(key);
-        node_raw = pager.get_page(curr_page);
-        node = Node(node_raw);
+        InternalNode internal(write_latches.back().data);
+        uint32_t child_page = internal.find_child(key);
+        PageHandle child = pager.acquire(child_page, LATCH_EXCLUSIVE);
+        bool safe = safe_for_write(child.data, intent, key, row_size);
+
+        if (!safe && intent == WRITE_DELETE && Node(child.data).get_type() == NODE_LEAF) {
+            pager.release(child);  // Re-latched below, in sibling order
+            uint32_t idx = find_child_index(internal, child_page);
+            if (idx > 0) latch_for_write(internal.get_child(idx - 1));
+            latch_for_write(child_page);
+            if (idx < internal.get_num_keys()) latch_for_write(internal.get_child(idx + 1));
+            METRIC_RECORD(HIST_DESCENT_DEPTH, path.size() + 1);
+            return {child_page, path};
+        }
+        write_latches.push_back(child);
+        if (safe) release_write_latches(1);
+        curr_page = child_page;
     }
+    METRIC_RECORD(HIST_DESCENT_DEPTH, path.size() + 1);
     return {curr_page, path};
 }
 
+// Safe = the operation cannot propagate above this (non-root) node.  A split
+// below adds a separator from within the split child's range: inside this
+// node's own key range for a middle child, so the coding stays as narrow;
+// anywhere beyond it for the first or last child, so the widest is assumed.
+bool BTree::safe_for_write(void* node_raw, WriteIntent intent, uint64_t key, uint16_t row_size) {
+    if (Node(node_raw).get_type() == NODE_LEAF) {
+        LeafNode leaf(node_raw);
+        return intent == WRITE_INSERT ? leaf.can_fit(row_size) : leaf.safe_to_remove(key);
+    }
+    InternalNode internal(node_raw);
+    uint32_t n = internal.get_num_keys();
+    if (intent == WRITE_DELETE) return n > INTERNAL_MIN_KEYS;
+    uint32_t idx = internal.child_index_for(key);
+    if (idx == 0 || idx == n) return n < internal_capacity(INTERNAL_KEY_WIDTH_MAX);
+    return InternalNode::fits(n + 1, internal.get_key(0), internal.get_key(n - 1));
+}
+
+void BTree::latch_for_write(uint32_t page_num) {
+    for (const PageHandle& h : write_latches) {
+        if (h.page_num == page_num) return;
+    }
+    write_latches.push_back(pager.acquire(page_num, LATCH_EXCLUSIVE));
+}
+
+void BTree::release_write_latches(size_t keep_last) {
+    if (write_latches.size() <= keep_last) return;
+    size_t drop = write_latches.size() - keep_last;
+    for (size_t i = 0; i < drop; i++) pager.release(write_latches[i]);
+    write_latches.erase(write_latches.begin(), write_latches.begin() + drop);
+}
+
+// Non-blocking descent to the parent of leaf_page.  Callers hold a latch on
+// the leaf, and waiting for an ancestor from there could deadlock against a
+// writer crabbing down towards it — so give up on the first busy latch.
+bool BTree::try_latch_parent(uint32_t leaf_page, uint64_t key, PageHandle& out) {
+    if (leaf_page == root_page_num) return false;
+    PageHandle node;
+    if (!pager.try_acquire(root_page_num, LATCH_SHARED, node)) return false;
+    while (Node(node.data).get_type() == NODE_INTERNAL) {
+        uint32_t child_page = InternalNode(node.data).find_child(key);
+        if (child_page == leaf_page) {
+            out = node;
+            return true;
+        }
+        PageHandle child;
+        bool ok = pager.try_acquire(child_page, LATCH_SHARED, child);
+        pager.release(node);
+        if (!ok) return false;
+        node = child;
+    }
+    pager.release(node);
+    return false;
+}
+
+// ==========================================
+// PRIVATE: SCAN READ-AHEAD
+// ==========================================
+// Called once per leaf, in next_leaf order, with the leaf S-latched (or a
+// snapshot copy of it).  The sibling chain only reveals one page at a time,
+// so upcoming leaves are taken from the parent's child list instead and
+// handed to the Pager in groups of `readahead` pages.  Read-ahead is
+// advisory: a busy parent latch skips it, and a snapshot scan prefetches
+// from the live parent, which may have moved on.
+
+void BTree::read_ahead(uint32_t leaf_page, void* leaf_data, ReadAhead& ra) {
+    if (pager.readahead == 0) return;
+
+    PageHandle parent;
+    if (ra.parent != 0) {
+        if (!pager.try_acquire(ra.parent, LATCH_SHARED, parent)) {
+            ra.parent = 0;
+            return;
+        }
+        InternalNode node(parent.data);
+        ra.child_idx++;
+        if (node.get_type() != NODE_INTERNAL || ra.child_idx > node.get_num_keys() ||
+            node.get_child(ra.child_idx) != leaf_page) {
+            pager.release(parent);
+            ra.parent = 0;  // Walked off this parent (or it was restructured)
+        }
+    }
+    if (ra.parent == 0) {
+        LeafNode node(leaf_data);
+        if (node.get_num_cells() == 0) return;
+        if (!try_latch_parent(leaf_page, node.get_key(0), parent)) return;
+        ra.parent = parent.page_num;
+        InternalNode parent_node(parent.data);
+        ra.child_idx = find_child_index(parent_node, leaf_page);
+        ra.issued_to = ra.child_idx;
+    }
+
+    // Top up once half of the prefetched window has been consumed
+    std::vector<uint32_t> pages;
+    if (ra.issued_to <= ra.child_idx + pager.readahead / 2) {
+        InternalNode parent_node(parent.data);
+        uint32_t last = std::min(parent_node.get_num_keys(), ra.child_idx + pager.readahead);
+        for (uint32_t i = ra.issued_to + 1; i <= last; i++) pages.push_back(parent_node.get_child(i));
+        ra.issued_to = std::max(ra.issued_to, last);
+    }
+    pager.release(parent);
+    if (!pages.empty()) pager.prefetch(pages);
+}
+
+// ==========================================
+// PRIVATE: SCAN PARTITIONING
+// ==========================================
+// Level d holds the separators of the root's descendants d levels down.
+// Deeper levels are only read while the ones above have too few keys in the
+// range, so a large tree is usually split from its root and one level below.
+// The latches are shared and held top-down, as a lookup holds them.
+
+std::vector<uint64_t> BTree::split_points(uint64_t start, uint64_t end, uint32_t parts) {
+    std::vector<uint64_t> keys;
+    if (parts < 2 || start >= end) return keys;
+
+    // Internal levels, counted down the leftmost path
+    uint32_t internal_levels = 0;
+    PageHandle node = pager.acquire(root_page_num, LATCH_SHARED);
+    while (Node(node.data).get_type() == NODE_INTERNAL) {
+        internal_levels++;
+        PageHandle child = pager.acquire(InternalNode(node.data).get_child(0), LATCH_SHARED);
+        pager.release(node);
+        node = child;
+    }
+    pager.release(node);
+
+    for (uint32_t depth = 0; depth < internal_levels && keys.size() + 1 < parts; depth++) {
+        keys.clear();
+        PageHandle root = pager.acquire(root_page_num, LATCH_SHARED);
+        if (Node(root.data).get_type() == NODE_INTERNAL) collect_separators(root, depth, start, end, keys);
+        pager.release(root);
+    }
+    if (keys.size() + 1 > parts) {  // Evenly spaced picks
+        std::vector<uint64_t> picked;
+        for (uint32_t i = 1; i < parts; i++) picked.push_back(keys[(uint64_t)i * keys.size() / parts]);
+        keys.swap(picked);
+    }
+    return keys;
+}
+
+// In key order: each child's separators, then the key that follows it.
+// Children entirely outside [start, end] are not visited.
+void BTree::collect_separators(PageHandle& node, uint32_t depth, uint64_t start, uint64_t end,
+                               std::vector<uint64_t>& out) {
+    InternalNode internal(node.data);
+    uint32_t num_keys = internal.get_num_keys();
+    for (uint32_t i = 0; i <= num_keys; i++) {
+        uint64_t lower = i > 0 ? internal.get_key(i - 1) : 0;
+        if (i > 0 && lower > end) break;
+        bool below_start = i < num_keys && internal.get_key(i) <= start;
+        if (depth > 0 && !below_start) {
+            PageHandle child = pager.acquire(internal.get_child(i), LATCH_SHARED);
+            if (Node(child.data).get_type() == NODE_INTERNAL) collect_separators(child, depth - 1, start, end, out);
+            pager.release(child);
+        }
+        if (i < num_keys && internal.get_key(i) > start && internal.get_key(i) <= end)
+            out.push_back(internal.get_key(i));
+    }
+}
+
 // ==========================================
 // PRIVATE: LEAF SPLIT
 // ==========================================
 
-void BTree::split_leaf(Cursor& cursor, uint32_t new_key, Row& new_row) {
+void BTree::split_leaf(Cursor& cursor, uint64_t new_key, const uint8_t* new_rec, uint16_t new_len) {
+    METRIC_INC(MET_LEAF_SPLITS);
     uint32_t page_num = cursor.page_num;
     void* old_node_raw = pager.get_page(page_num);
+    pager.mark_dirty(page_num);
     LeafNode old_node(old_node_raw);
 
-    // 1. Collect all rows (existing + new) in sorted order
+    // 1. Find split point by bytes over the records in key order (the new one
+    //    included): try to balance data across both pages
     uint32_t total = old_node.get_num_cells();
-    std::vector<Row> all_rows;
-    all_rows.reserve(total + 1);
-    bool inserted = false;
-    for (uint32_t i = 0; i < total; i++) {
-        if (!inserted && new_key < old_node.get_key(i)) {
-            all_rows.push_back(new_row);
-            inserted = true;
-        }
-        all_rows.push_back(old_node.get_row(i));
-    }
-    if (!inserted) all_rows.push_back(new_row);
-
-    // 2. Find split point by bytes: try to balance data across both pages
+    uint32_t insert_at = old_node.lower_bound(new_key);
+    auto record_bytes = [&](uint32_t i) -> uint32_t {
+        if (i == insert_at) return new_len + SLOT_SIZE;
+        return old_node.slot_length(i < insert_at ? i : i - 1) + SLOT_SIZE;
+    };
     uint32_t half_usable = LEAF_USABLE_SPACE / 2;
     uint32_t running = 0;
     uint32_t split_point = 0;
-    for (uint32_t i = 0; i < all_rows.size(); i++) {
-        running += serialized_row_size(all_rows[i]) + SLOT_SIZE;
+    for (uint32_t i = 0; i <= total; i++) {
+        running += record_bytes(i);
         if (running > half_usable) {
             split_point = (i > 0) ? i : 1;  // at least 1 in left
             break;
         }
     }
-    if (split_point == 0) split_point = all_rows.size() / 2;
+    if (split_point == 0) split_point = (total + 1) / 2;
 
-    // 3. Allocate new page for right half
-    uint32_t new_page_num = pager.get_unused_page_num();
+    // 2. Allocate new page for right half, physically close to the left one
+    uint32_t new_page_num = pager.get_unused_page_num(page_num);
     void* new_node_raw = pager.get_page(new_page_num);
     LeafNode new_node(new_node_raw);
     new_node.initialize();
 
-    // 4. Save sibling chain, re-initialise old page (preserve root flag)
-    uint32_t old_next = old_node.get_next_leaf();
-    bool was_root = old_node.is_root();
-    old_node.initialize();
-    old_node.set_root(was_root);
-
-    // 5. Distribute rows
-    for (uint32_t i = 0; i < split_point; i++)
-        old_node.insert(all_rows[i].id, all_rows[i]);
-    for (uint32_t i = split_point; i < all_rows.size(); i++)
-        new_node.insert(all_rows[i].id, all_rows[i]);
+    // 3. Move the upper records across in one pass (the lower ones stay where
+    //    they are, root flag included), then add the new record to its side
+    bool new_goes_left = insert_at < split_point;
+    uint32_t keep = new_goes_left ? split_point - 1 : split_point;
+    old_node.move_slots(keep, total - keep, new_node, 0);
+    (new_goes_left ? old_node : new_node).insert_record(new_key, new_rec, new_len);
 
-    // 5b. Wire sibling pointers:  old → new → old's-old-next
+    // 3b. Wire sibling pointers:  old → new → old's-old-next
+    new_node.set_next_leaf(old_node.get_next_leaf());
     old_node.set_next_leaf(new_page_num);
-    new_node.set_next_leaf(old_next);
+    bool was_root = old_node.is_root();
 
-    uint32_t separator = new_node.get_key(0);
+    uint64_t separator = new_node.get_key(0);
 
-    // 6. Parent update logic
+    // 4. Parent update logic
     if (was_root) {
-        uint32_t left_copy_page = pager.get_unused_page_num();
+        uint32_t left_copy_page = pager.get_unused_page_num(page_num);
         void* left_copy = pager.get_page(left_copy_page);
         std::memcpy(left_copy, old_node_raw, PAGE_SIZE);
         LeafNode left_leaf(left_copy);
@@ -260,26 +1174,25 @@ void BTree::split_leaf(Cursor& cursor, uint32_t new_key, Row& new_row) {
         InternalNode root(old_node_raw);
         root.initialize();
         root.set_root(true);
-        root.set_num_keys(1);
-        root.set_right_child(new_page_num);
-        root.set_child(0, left_copy_page);
-        root.set_key(0, separator);
+        uint32_t children[2] = {left_copy_page, new_page_num};
+        root.assign(&separator, children, 1);
 
-        std::cout << "DEBUG: Root Split. Left(" << left_copy_page
+        LOG_AT(LOG_DEBUG) << "DEBUG: Root Split. Left(" << left_copy_page
                   << ") Key(" << separator << ") Right(" << new_page_num << ")\n";
     } else {
         uint32_t parent_page = cursor.path_stack.back();
         InternalNode parent(pager.get_page(parent_page));
         uint32_t child_index = find_child_index(parent, page_num);
 
-        if (parent.get_num_keys() >= INTERNAL_MAX_CELLS) {
+        if (!parent.can_insert(separator)) {
             cursor.path_stack.pop_back();
             split_internal(parent_page, child_index,
                            separator, new_page_num,
                            cursor.path_stack);
         } else {
+            pager.mark_dirty(parent_page);
             parent.insert_child(child_index, separator, new_page_num);
-            std::cout << "DEBUG: Internal Update. Added child " << new_page_num
+            LOG_AT(LOG_DEBUG) << "DEBUG: Internal Update. Added child " << new_page_num
                       << " at index " << child_index << "\n";
         }
     }
@@ -290,59 +1203,47 @@ void BTree::split_leaf(Cursor& cursor, uint32_t new_key, Row& new_row) {
 // ==========================================
 
 void BTree::split_internal(uint32_t internal_page, uint32_t child_index,
-                    uint32_t new_key, uint32_t new_child_page,
+                    uint64_t new_key, uint32_t new_child_page,
                     std::vector<uint32_t>& path) {
+    METRIC_INC(MET_INTERNAL_SPLITS);
     InternalNode old_node(pager.get_page(internal_page));
-    uint32_t N = old_node.get_num_keys(); // N == INTERNAL_MAX_CELLS
-
-    // 1. Build temporary arrays for the (N+1) keys and (N+2) children
-    uint32_t total_keys = N + 1;
-    std::vector<uint32_t> keys(total_keys);
-    std::vector<uint32_t> children(total_keys + 1);
-
-    // Children
-    for (uint32_t i = 0; i <= child_index; i++)
-        children[i] = old_node.get_child(i);
-    children[child_index + 1] = new_child_page;
-    for (uint32_t i = child_index + 1; i <= N; i++)
-        children[i + 1] = old_node.get_child(i);
-
-    // Keys
-    for (uint32_t i = 0; i < child_index; i++)
-        keys[i] = old_node.get_key(i);
-    keys[child_index] = new_key;
-    for (uint32_t i = child_index; i < N; i++)
-        keys[i + 1] = old_node.get_key(i);
-
-    // 2. Split point — middle key is pushed UP, not kept in either node.
+    pager.mark_dirty(internal_page);
+
+    // 1. The (N+1) keys and (N+2) children, the new pair included
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> children;
+    old_node.read_all(keys, children);
+    keys.insert(keys.begin() + child_index, new_key);
+    children.insert(children.begin() + child_index + 1, new_child_page);
+    uint32_t total_keys = keys.size();
+
+    // 2. Split point — middle key is pushed UP, not kept in either node.  The
+    //    halves are coded separately; the middle moves off centre only if one
+    //    of them does not fit its coding (a new key far from all others).
+    auto fits = [&](uint32_t mid) {
+        return mid > 0 && mid + 1 < total_keys &&
+               InternalNode::fits(mid, keys[0], keys[mid - 1]) &&
+               InternalNode::fits(total_keys - mid - 1, keys[mid + 1], keys[total_keys - 1]);
+    };
     uint32_t mid = total_keys / 2;
-    uint32_t push_up_key = keys[mid];
+    for (uint32_t d = 1; !fits(mid) && d <= total_keys / 2; d++) {
+        if (fits(total_keys / 2 - d)) mid = total_keys / 2 - d;
+        else if (fits(total_keys / 2 + d)) mid = total_keys / 2 + d;
+    }
+    uint64_t push_up_key = keys[mid];
 
     // 3. Write left half back into old_node.
-    uint32_t left_count = mid;
-    for (uint32_t i = 0; i < left_count; i++) {
-        *old_node.get_cell(i) = children[i];
-        old_node.set_key(i, keys[i]);
-    }
-    old_node.set_right_child(children[mid]);
-    old_node.set_num_keys(left_count);
+    old_node.assign(keys.data(), children.data(), mid);
 
     // 4. Create new internal node for the right half.
-    uint32_t new_internal_page = pager.get_unused_page_num();
+    uint32_t new_internal_page = pager.get_unused_page_num(internal_page);
     InternalNode new_node(pager.get_page(new_internal_page));
     new_node.initialize();
-
-    uint32_t right_count = total_keys - mid - 1;
-    for (uint32_t i = 0; i < right_count; i++) {
-        *new_node.get_cell(i) = children[mid + 1 + i];
-        new_node.set_key(i, keys[mid + 1 + i]);
-    }
-    new_node.set_right_child(children[total_keys]);
-    new_node.set_num_keys(right_count);
+    new_node.assign(keys.data() + mid + 1, children.data() + mid + 1, total_keys - mid - 1);
 
     // 5. Push middle key up.
     if (old_node.is_root()) {
-        uint32_t left_page = pager.get_unused_page_num();
+        uint32_t left_page = pager.get_unused_page_num(internal_page);
         std::memcpy(pager.get_page(left_page),
                     pager.get_page(internal_page), PAGE_SIZE);
         InternalNode left_copy(pager.get_page(left_page));
@@ -351,12 +1252,10 @@ void BTree::split_internal(uint32_t internal_page, uint32_t child_index,
         InternalNode root(pager.get_page(internal_page));
         root.initialize();
         root.set_root(true);
-        root.set_num_keys(1);
-        root.set_child(0, left_page);
-        root.set_key(0, push_up_key);
-        root.set_right_child(new_internal_page);
+        uint32_t root_children[2] = {left_page, new_internal_page};
+        root.assign(&push_up_key, root_children, 1);
 
-        std::cout << "DEBUG: Internal Root Split. Left(" << left_page
+        LOG_AT(LOG_DEBUG) << "DEBUG: Internal Root Split. Left(" << left_page
                   << ") Key(" << push_up_key
                   << ") Right(" << new_internal_page << ")\n";
     } else {
@@ -366,12 +1265,13 @@ void BTree::split_internal(uint32_t internal_page, uint32_t child_index,
         InternalNode parent(pager.get_page(parent_page));
         uint32_t pidx = find_child_index(parent, internal_page);
 
-        if (parent.get_num_keys() >= INTERNAL_MAX_CELLS) {
+        if (!parent.can_insert(push_up_key)) {
             split_internal(parent_page, pidx,
                            push_up_key, new_internal_page, path);
         } else {
+            pager.mark_dirty(parent_page);
             parent.insert_child(pidx, push_up_key, new_internal_page);
-            std::cout << "DEBUG: Internal Update (post internal split). Key("
+            LOG_AT(LOG_DEBUG) << "DEBUG: Internal Update (post internal split). Key("
                       << push_up_key << ") -> Page " << parent_page << "\n";
         }
     }
@@ -384,19 +1284,44 @@ void BTree::split_internal(uint32_t internal_page, uint32_t child_index,
 uint32_t BTree::find_child_index(InternalNode& parent, uint32_t child_page) {
     uint32_t nk = parent.get_num_keys();
     for (uint32_t i = 0; i < nk; i++) {
-        if (*parent.get_cell(i) == child_page) return i;
+        if (parent.child_at(i) == child_page) return i;
     }
     if (parent.get_right_child() == child_page) return nk;
-    std::cout << "CRITICAL ERROR: child not found in parent!\n";
+    output() << "CRITICAL ERROR: child not found in parent!\n";
     return UINT32_MAX;
 }
 
 // --- Leaf Rebalance ---
 
+// Records to move from the near end of `from` (its tail if from_tail, else its
+// head) so both leaves end up holding about the same bytes.  At least one, as
+// `from` has more than LEAF_MIN_CELLS, and `from` keeps LEAF_MIN_CELLS.
+static uint32_t redistribute_count(const LeafNode& from, const LeafNode& to, bool from_tail) {
+    uint32_t n = from.get_num_cells();
+    uint32_t to_used = LEAF_USABLE_SPACE - to.get_total_free();
+    uint32_t half = (to_used + LEAF_USABLE_SPACE - from.get_total_free()) / 2;
+    uint32_t count = 0, moved = 0;
+    while (n - count > LEAF_MIN_CELLS) {
+        uint32_t rec = from.slot_length(from_tail ? n - 1 - count : count) + SLOT_SIZE;
+        if (count > 0 && to_used + moved + rec > half) break;
+        moved += rec;
+        count++;
+    }
+    return count;
+}
+
+// A borrow moves the separator between the two leaves.  Moving the parent's
+// first or last separator outwards may widen its key coding past what the
+// parent can hold; the borrow is then skipped, and if merging does not fit
+// either the leaf stays below its minimum (deletes only ever shrink it further
+// until a merge does fit).
 void BTree::rebalance_leaf(uint32_t page_num, std::vector<uint32_t>& path) {
     uint32_t parent_page = path.back();
     InternalNode parent(pager.get_page(parent_page));
     LeafNode leaf(pager.get_page(page_num));
+    // Every outcome (borrow or merge) rewrites the parent and this leaf
+    pager.mark_dirty(parent_page);
+    pager.mark_dirty(page_num);
 
     uint32_t child_index = find_child_index(parent, page_num);
     uint32_t num_keys = parent.get_num_keys();
@@ -407,14 +1332,16 @@ void BTree::rebalance_leaf(uint32_t page_num, std::vector<uint32_t>& path) {
         LeafNode left_sib(pager.get_page(left_page));
 
         if (!left_sib.leaf_underflow() && left_sib.get_num_cells() > LEAF_MIN_CELLS) {
-            uint32_t ln = left_sib.get_num_cells();
-            Row borrowed = left_sib.get_row(ln - 1);
-            leaf.insert(borrowed.id, borrowed);
-            left_sib.remove_at(ln - 1);
-
-            parent.set_key(child_index - 1, leaf.get_key(0));
-            std::cout << "DEBUG: Leaf borrow-left from Page " << left_page << "\n";
-            return;
+            uint32_t count = redistribute_count(left_sib, leaf, true);
+            uint32_t first = left_sib.get_num_cells() - count;
+            if (parent.can_set_key(child_index - 1, left_sib.get_key(first))) {
+                pager.mark_dirty(left_page);
+                left_sib.move_slots(first, count, leaf, 0);
+                parent.set_key(child_index - 1, leaf.get_key(0));
+                METRIC_INC(MET_LEAF_BORROWS);
+                LOG_AT(LOG_DEBUG) << "DEBUG: Leaf borrow-left " << count << " from Page " << left_page << "\n";
+                return;
+            }
         }
     }
 
@@ -424,46 +1351,51 @@ void BTree::rebalance_leaf(uint32_t page_num, std::vector<uint32_t>& path) {
         LeafNode right_sib(pager.get_page(right_page));
 
         if (!right_sib.leaf_underflow() && right_sib.get_num_cells() > LEAF_MIN_CELLS) {
-            Row borrowed = right_sib.get_row(0);
-            leaf.insert(borrowed.id, borrowed);
-            right_sib.remove_at(0);
-
-            parent.set_key(child_index, right_sib.get_key(0));
-            std::cout << "DEBUG: Leaf borrow-right from Page " << right_page << "\n";
-            return;
+            uint32_t count = redistribute_count(right_sib, leaf, false);
+            if (parent.can_set_key(child_index, right_sib.get_key(count))) {
+                pager.mark_dirty(right_page);
+                right_sib.move_slots(0, count, leaf, leaf.get_num_cells());
+                parent.set_key(child_index, right_sib.get_key(0));
+                METRIC_INC(MET_LEAF_BORROWS);
+                LOG_AT(LOG_DEBUG) << "DEBUG: Leaf borrow-right " << count << " from Page " << right_page << "\n";
+                return;
+            }
         }
     }
 
     // Cannot borrow — must merge
-    if (child_index > 0) {
-        uint32_t left_page = parent.get_child(child_index - 1);
-        merge_leaves(left_page, page_num, parent_page, child_index - 1, path);
-    } else {
-        uint32_t right_page = parent.get_child(child_index + 1);
-        merge_leaves(page_num, right_page, parent_page, child_index, path);
+    uint32_t left_page = child_index > 0 ? parent.get_child(child_index - 1) : page_num;
+    uint32_t right_page = child_index > 0 ? page_num : parent.get_child(child_index + 1);
+    uint32_t used = 2 * LEAF_USABLE_SPACE - LeafNode(pager.get_page(left_page)).get_total_free() -
+                    LeafNode(pager.get_page(right_page)).get_total_free();
+    if (used > LEAF_USABLE_SPACE) {
+        LOG_AT(LOG_DEBUG) << "DEBUG: Leaf Page " << page_num << " left underfull (parent keys too wide)\n";
+        return;
     }
+    merge_leaves(left_page, right_page, parent_page, child_index > 0 ? child_index - 1 : child_index, path);
 }
 
 // Merge right leaf INTO left leaf, free right, remove separator from parent.
 void BTree::merge_leaves(uint32_t left_page, uint32_t right_page,
                   uint32_t parent_page, uint32_t sep_idx,
                   std::vector<uint32_t>& path) {
+    METRIC_INC(MET_LEAF_MERGES);
     LeafNode left(pager.get_page(left_page));
     LeafNode right(pager.get_page(right_page));
+    pager.mark_dirty(left_page);
+    pager.mark_dirty(right_page);  // Emptied before it is freed: snapshots keep it whole
 
-    uint32_t rn = right.get_num_cells();
-    for (uint32_t i = 0; i < rn; i++) {
-        Row row = right.get_row(i);
-        left.insert(row.id, row);
-    }
+    // Right's keys all follow left's: one bulk move onto the end of left
+    right.move_slots(0, right.get_num_cells(), left, left.get_num_cells());
 
     // Bypass right in the sibling chain
     left.set_next_leaf(right.get_next_leaf());
 
     pager.free_page(right_page);
-    std::cout << "DEBUG: Merged leaf Pages " << left_page << " + " << right_page << " (freed " << right_page << ")\n";
+    LOG_AT(LOG_DEBUG) << "DEBUG: Merged leaf Pages " << left_page << " + " << right_page << " (freed " << right_page << ")\n";
 
     InternalNode parent(pager.get_page(parent_page));
+    pager.mark_dirty(parent_page);
     parent.remove_key(sep_idx);
 
     if (parent.is_root() && parent.get_num_keys() == 0) {
@@ -472,7 +1404,7 @@ void BTree::merge_leaves(uint32_t left_page, uint32_t right_page,
         Node new_root(pager.get_page(parent_page));
         new_root.set_root(true);
         pager.free_page(only_child);
-        std::cout << "DEBUG: Root collapsed. Tree shrunk by one level.\n";
+        LOG_AT(LOG_DEBUG) << "DEBUG: Root collapsed. Tree shrunk by one level.\n";
     } else if (!parent.is_root() && parent.get_num_keys() < INTERNAL_MIN_KEYS) {
         path.pop_back();
         rebalance_internal(parent_page, path);
@@ -480,6 +1412,9 @@ void BTree::merge_leaves(uint32_t left_page, uint32_t right_page,
 }
 
 // --- Internal Node Rebalance ---
+// The node taking a key has fewer than INTERNAL_MIN_KEYS, so it holds one
+// more at any coding; only the parent's new separator needs checking, as for
+// leaves.  Two nodes at or below the minimum always merge into one.
 
 void BTree::rebalance_internal(uint32_t page_num, std::vector<uint32_t>& path) {
     if (path.empty()) return;
@@ -487,6 +1422,8 @@ void BTree::rebalance_internal(uint32_t page_num, std::vector<uint32_t>& path) {
     uint32_t parent_page = path.back();
     InternalNode parent(pager.get_page(parent_page));
     InternalNode current(pager.get_page(page_num));
+    pager.mark_dirty(parent_page);
+    pager.mark_dirty(page_num);
 
     uint32_t child_index = find_child_index(parent, page_num);
     uint32_t num_keys = parent.get_num_keys();
@@ -494,28 +1431,23 @@ void BTree::rebalance_internal(uint32_t page_num, std::vector<uint32_t>& path) {
     // Try borrowing from LEFT sibling
     if (child_index > 0) {
         uint32_t left_page = parent.get_child(child_index - 1);
+        latch_for_write(left_page);
         InternalNode left_sib(pager.get_page(left_page));
+        uint32_t sep = child_index - 1;
+        uint32_t ln = left_sib.get_num_keys();
 
-        if (left_sib.get_num_keys() > INTERNAL_MIN_KEYS) {
-            uint32_t sep = child_index - 1;
-            uint32_t parent_key = parent.get_key(sep);
+        if (ln > INTERNAL_MIN_KEYS && parent.can_set_key(sep, left_sib.get_key(ln - 1))) {
+            pager.mark_dirty(left_page);
+            uint64_t parent_key = parent.get_key(sep);
 
-            uint32_t ln = left_sib.get_num_keys();
             uint32_t borrowed_child = left_sib.get_right_child();
-            uint32_t borrowed_key = left_sib.get_key(ln - 1);
-            left_sib.set_right_child(*left_sib.get_cell(ln - 1));
-            left_sib.set_num_keys(ln - 1);
-
-            uint32_t cn = current.get_num_keys();
-            for (int32_t i = cn - 1; i >= 0; i--) {
-                std::memcpy(current.get_cell(i + 1), current.get_cell(i), INTERNAL_CELL_SIZE);
-            }
-            *current.get_cell(0) = borrowed_child;
-            current.set_key(0, parent_key);
-            current.set_num_keys(cn + 1);
+            uint64_t borrowed_key = left_sib.get_key(ln - 1);
+            left_sib.remove_key(ln - 1);  // Its left child becomes the right child
 
+            current.push_front(borrowed_child, parent_key);
             parent.set_key(sep, borrowed_key);
-            std::cout << "DEBUG: Internal borrow-left from Page " << left_page << "\n";
+            METRIC_INC(MET_INTERNAL_BORROWS);
+            LOG_AT(LOG_DEBUG) << "DEBUG: Internal borrow-left from Page " << left_page << "\n";
             return;
         }
     }
@@ -523,69 +1455,67 @@ void BTree::rebalance_internal(uint32_t page_num, std::vector<uint32_t>& path) {
     // Try borrowing from RIGHT sibling
     if (child_index < num_keys) {
         uint32_t right_page = parent.get_child(child_index + 1);
+        latch_for_write(right_page);
         InternalNode right_sib(pager.get_page(right_page));
+        uint32_t sep = child_index;
 
-        if (right_sib.get_num_keys() > INTERNAL_MIN_KEYS) {
-            uint32_t sep = child_index;
-            uint32_t parent_key = parent.get_key(sep);
+        if (right_sib.get_num_keys() > INTERNAL_MIN_KEYS && parent.can_set_key(sep, right_sib.get_key(0))) {
+            pager.mark_dirty(right_page);
+            uint64_t parent_key = parent.get_key(sep);
 
-            uint32_t borrowed_child = *right_sib.get_cell(0);
-            uint32_t borrowed_key = right_sib.get_key(0);
-            uint32_t rn = right_sib.get_num_keys();
-            for (uint32_t i = 0; i < rn - 1; i++) {
-                std::memcpy(right_sib.get_cell(i), right_sib.get_cell(i + 1), INTERNAL_CELL_SIZE);
-            }
-            right_sib.set_num_keys(rn - 1);
+            uint32_t borrowed_child = right_sib.child_at(0);
+            uint64_t borrowed_key = right_sib.get_key(0);
+            right_sib.remove_first();
 
-            uint32_t cn = current.get_num_keys();
-            *current.get_cell(cn) = current.get_right_child();
-            current.set_key(cn, parent_key);
+            current.insert_child(current.get_num_keys(), parent_key, current.get_right_child());
             current.set_right_child(borrowed_child);
-            current.set_num_keys(cn + 1);
-
             parent.set_key(sep, borrowed_key);
-            std::cout << "DEBUG: Internal borrow-right from Page " << right_page << "\n";
+            METRIC_INC(MET_INTERNAL_BORROWS);
+            LOG_AT(LOG_DEBUG) << "DEBUG: Internal borrow-right from Page " << right_page << "\n";
             return;
         }
     }
 
     // Must merge internal nodes
-    if (child_index > 0) {
-        uint32_t left_page = parent.get_child(child_index - 1);
-        merge_internals(left_page, page_num, parent_page, child_index - 1, path);
-    } else {
-        uint32_t right_page = parent.get_child(child_index + 1);
-        merge_internals(page_num, right_page, parent_page, child_index, path);
+    uint32_t sep = child_index > 0 ? child_index - 1 : child_index;
+    uint32_t left_page = parent.get_child(sep);
+    uint32_t right_page = parent.get_child(sep + 1);
+    InternalNode left(pager.get_page(left_page));
+    InternalNode right(pager.get_page(right_page));
+    uint32_t ln = left.get_num_keys(), rn = right.get_num_keys();
+    uint64_t separator = parent.get_key(sep);
+    if (!InternalNode::fits(ln + 1 + rn, ln ? left.get_key(0) : separator,
+                            rn ? right.get_key(rn - 1) : separator)) {
+        LOG_AT(LOG_DEBUG) << "DEBUG: Internal Page " << page_num << " left underfull (parent keys too wide)\n";
+        return;
     }
+    merge_internals(left_page, right_page, parent_page, sep, path);
 }
 
 // Merge right internal node INTO left, pulling separator down from parent.
 void BTree::merge_internals(uint32_t left_page, uint32_t right_page,
                      uint32_t parent_page, uint32_t sep_idx,
                      std::vector<uint32_t>& path) {
+    METRIC_INC(MET_INTERNAL_MERGES);
     InternalNode left(pager.get_page(left_page));
     InternalNode right(pager.get_page(right_page));
     InternalNode parent(pager.get_page(parent_page));
-
-    uint32_t separator = parent.get_key(sep_idx);
-    uint32_t ln = left.get_num_keys();
-    uint32_t rn = right.get_num_keys();
-
-    // 1. Pull separator down
-    *left.get_cell(ln) = left.get_right_child();
-    left.set_key(ln, separator);
-
-    // 2. Copy all cells from right into left
-    for (uint32_t i = 0; i < rn; i++) {
-        std::memcpy(left.get_cell(ln + 1 + i), right.get_cell(i), INTERNAL_CELL_SIZE);
-    }
-
-    // 3. Left's new right_child = right's right_child
-    left.set_right_child(right.get_right_child());
-    left.set_num_keys(ln + 1 + rn);
+    pager.mark_dirty(left_page);
+    pager.mark_dirty(parent_page);
+
+    // Left's keys, the separator pulled down, then right's keys; left's
+    // right_child is followed by all of right's children
+    std::vector<uint64_t> keys, right_keys;
+    std::vector<uint32_t> children, right_children;
+    left.read_all(keys, children);
+    right.read_all(right_keys, right_children);
+    keys.push_back(parent.get_key(sep_idx));
+    keys.insert(keys.end(), right_keys.begin(), right_keys.end());
+    children.insert(children.end(), right_children.begin(), right_children.end());
+    left.assign(keys.data(), children.data(), keys.size());
 
     pager.free_page(right_page);
-    std::cout << "DEBUG: Merged internal Pages " << left_page << " + " << right_page << "\n";
+    LOG_AT(LOG_DEBUG) << "DEBUG: Merged internal Pages " << left_page << " + " << right_page << "\n";
 
     InternalNode parent2(pager.get_page(parent_page));
     parent2.remove_key(sep_idx);
@@ -596,7 +1526,7 @@ void BTree::merge_internals(uint32_t left_page, uint32_t right_page,
         Node new_root(pager.get_page(parent_page));
         new_root.set_root(true);
         pager.free_page(only_child);
-        std::cout << "DEBUG: Root collapsed (internal merge). Tree shrunk by one level.\n";
+        LOG_AT(LOG_DEBUG) << "DEBUG: Root collapsed (internal merge). Tree shrunk by one level.\n";
     } else if (!parent2.is_root() && parent2.get_num_keys() < INTERNAL_MIN_KEYS) {
         path.pop_back();
         rebalance_internal(parent_page, path);
@@ -607,71 +1537,235 @@ void BTree::merge_internals(uint32_t left_page, uint32_t right_page,
 // PRIVATE: TREE PRINTING
 // ==========================================
 
-void BTree::_print_tree(uint32_t page_num, uint32_t level) {
-    void* node_raw = pager.get_page(page_num);
+// Nodes are snapshot copies, one per level of the recursion: no latch or pin
+// is held, so a dump of a large tree holds neither writers nor the pool up.
+void BTree::_print_tree(const Snapshot& snap, uint32_t page_num, uint32_t level) {
+    std::vector<uint8_t> copy(PAGE_SIZE);
+    snap.read(page_num, copy.data());
+    void* node_raw = copy.data();
     Node node(node_raw);
 
-    for (uint32_t i = 0; i < level; i++) std::cout << "  ";
+    for (uint32_t i = 0; i < level; i++) output() << "  ";
 
     if (node.get_type() == NODE_LEAF) {
         LeafNode leaf(node_raw);
         uint16_t used = LEAF_USABLE_SPACE - leaf.get_total_free();
-        std::cout << "- LEAF (Page " << page_num << ") | " << leaf.get_num_cells()
+        output() << "- LEAF (Page " << page_num << ") | " << leaf.get_num_cells()
                   << " rows, " << used << "B used | next->"
                   << (leaf.get_next_leaf() ? std::to_string(leaf.get_next_leaf()) : "nil") << "\n";
         for(uint32_t i=0; i<leaf.get_num_cells(); i++) {
-             for (uint32_t j = 0; j < level+1; j++) std::cout << "  ";
-             std::cout << leaf.get_key(i) << " [" << leaf.slot_length(i) << "B]\n";
+             for (uint32_t j = 0; j < level+1; j++) output() << "  ";
+             output() << leaf.get_key(i) << " [" << leaf.slot_length(i) << "B]\n";
         }
     } else {
         InternalNode internal(node_raw);
-        std::cout << "- INTERNAL (Page " << page_num << ") | " << internal.get_num_keys() << " keys\n";
+        output() << "- INTERNAL (Page " << page_num << ") | " << internal.get_num_keys() << " keys ("
+                 << internal.key_width() << "B each)\n";
         for(uint32_t i=0; i<internal.get_num_keys(); i++) {
-            _print_tree(internal.get_child(i), level + 1);
-            for (uint32_t j = 0; j < level+1; j++) std::cout << "  ";
-            std::cout << "Key: " << internal.get_key(i) << "\n";
+            _print_tree(snap, internal.get_child(i), level + 1);
+            for (uint32_t j = 0; j < level+1; j++) output() << "  ";
+            output() << "Key: " << internal.get_key(i) << "\n";
         }
-        _print_tree(internal.get_right_child(), level + 1);
+        _print_tree(snap, internal.get_right_child(), level + 1);
     }
 }
 
-void BTree::_print_json(uint32_t page_num) {
-    void* node_raw = pager.get_page(page_num);
+void BTree::_print_json(const Snapshot& snap, uint32_t page_num, OutputBuffer& out) {
+    std::vector<uint8_t> copy(PAGE_SIZE);
+    snap.read(page_num, copy.data());
+    void* node_raw = copy.data();
     Node node(node_raw);
 
     if (node.get_type() == NODE_LEAF) {
         LeafNode leaf(node_raw);
-        std::cout << "{\"type\": \"leaf\", \"page\": " << page_num << ", \"cells\": [";
+        out << "{\"type\": \"leaf\", \"page\": " << page_num << ", \"cells\": [";
         for(uint32_t i=0; i<leaf.get_num_cells(); i++) {
-            std::cout << leaf.get_key(i);
-            if (i < leaf.get_num_cells() - 1) std::cout << ",";
+            out << leaf.get_key(i);
+            if (i < leaf.get_num_cells() - 1) out << ",";
         }
-        std::cout << "]}";
+        out << "]}";
     } else {
         InternalNode internal(node_raw);
-        std::cout << "{\"type\": \"internal\", \"page\": " << page_num << ", \"children\": [";
+        out << "{\"type\": \"internal\", \"page\": " << page_num << ", \"children\": [";
         for(uint32_t i=0; i<internal.get_num_keys(); i++) {
-            _print_json(internal.get_child(i));
-            std::cout << ",";
+            _print_json(snap, internal.get_child(i), out);
+            out << ",";
         }
-        _print_json(internal.get_right_child());
-        std::cout << "], \"keys\": [";
+        _print_json(snap, internal.get_right_child(), out);
+        out << "], \"keys\": [";
          for(uint32_t i=0; i<internal.get_num_keys(); i++) {
-            std::cout << internal.get_key(i);
-            if (i < internal.get_num_keys() - 1) std::cout << ",";
+            out << internal.get_key(i);
+            if (i < internal.get_num_keys() - 1) out << ",";
+        }
+        out << "]}";
+    }
+}
+
+// --- Bloom Filter maintenance ---
+
+// Before the filter is attached (still loading, or not built yet) keys are
+// queued, and the persisted filter stops being trusted until they are in it.
+// While a rebuild scans they are queued as well, for the new table.
+void BTree::bloom_add(uint64_t key) {
+    if (bloom.attached()) {
+        bloom.add(key);
+        if (bloom_recording) pending_bloom_keys.push_back(key);  // For the table being rebuilt
+        return;
+    }
+    pending_bloom_keys.push_back(key);
+    pager.header.flags &= ~DB_FLAG_BLOOM_VALID;
+}
+
+// A table of a different size moves to a new contiguous run (a hole in the
+// free-space map, or the end of the file); the old run is freed.
+void BTree::install_bloom(std::unique_ptr<BloomFilter::Table> table) {
+    uint32_t pages = table->num_pages;
+    uint32_t first = pager.header.bloom_first_page;
+    if (pages != pager.header.bloom_pages) {
+        uint32_t old_first = first;
+        first = pager.allocate_run(pages);
+        pager.free_run(old_first, pager.header.bloom_pages);
+    }
+    bloom.install(std::move(table), first, true);
+    pager.header.bloom_first_page = first;
+    pager.header.bloom_pages = pages;
+    pager.header.bloom_capacity = BloomFilter::capacity_of(pages);
+}
+
+void BTree::wait_for_bloom_load() {
+    std::unique_lock<std::mutex> lock(bloom_mutex);
+    bloom_cv.wait(lock, [this] { return !bloom_loading; });
+}
+
+// Reads the persisted run without holding the writer lock; only attaching it
+// (and folding in keys queued meanwhile) is a write operation.
+bool BTree::load_bloom(uint32_t first_page, uint32_t num_pages) {
+    auto table = BloomFilter::make_table(num_pages);
+    std::vector<uint8_t> page(PAGE_SIZE);
+    for (uint32_t i = 0; i < num_pages; i++) {
+        if (rebuild_stop) return false;
+        if (!pager.read_uncached(first_page + i, page.data()) ||
+            !BloomFilter::read_page(*table, i, page.data())) {
+            std::cerr << "WARNING: Bloom filter page " << first_page + i
+                      << " is unreadable; rebuilding the filter.\n";
+            WriteOp op(pager);
+            pager.header.flags &= ~DB_FLAG_BLOOM_VALID;  // Shutdown now waits for the rebuild
+            return false;
         }
-        std::cout << "]}";
     }
+    WriteOp op(pager);
+    if (bloom.attached()) return true;  // A rebuild got there first
+    bloom.install(std::move(table), first_page, false);
+    for (uint64_t key : pending_bloom_keys) bloom.add(key);
+    pending_bloom_keys.clear();
+    pager.header.flags |= DB_FLAG_BLOOM_VALID;
+    bloom_ready = true;
+    return true;
 }
 
-// --- Bloom Filter rebuild (walks leaf linked list) ---
-void BTree::rebuild_bloom() {
-    bloom.clear();
-    uint32_t curr = get_leftmost_leaf();
-    while (curr != 0) {
-        LeafNode leaf(pager.get_page(curr));
-        for (uint32_t i = 0; i < leaf.get_num_cells(); i++)
-            bloom.add(leaf.get_key(i));
-        curr = leaf.get_next_leaf();
+// Rebuild (walks leaf linked list).  Built off to the side from a snapshot,
+// without the writer lock: keys inserted meanwhile are also queued in
+// pending_bloom_keys and folded in when the table is installed, a write
+// operation.  Onto the same run it is copied over the live bits, and every
+// key in the tree is set in both, so a concurrent lookup never sees a false
+// negative.  Also refreshes the header's row count (by the scan, plus the
+// inserts and deletes made while it ran).
+bool BTree::rebuild_bloom() {
+    // Keep the current run while it holds the rows with room to spare,
+    // otherwise size a new one with BLOOM_HEADROOM over the row count
+    auto pages_for_rows = [this](uint32_t rows) {
+        uint32_t current = pager.header.bloom_pages;
+        uint32_t wanted = BloomFilter::pages_for((uint64_t)rows * BLOOM_HEADROOM);
+        if (current && BloomFilter::capacity_of(current) >= rows && current <= wanted * 4) return current;
+        return wanted;
+    };
+
+    // The snapshot and the counts it agrees with are taken in one operation
+    std::optional<Snapshot> snapshot;
+    uint32_t pages, base_rows, base_stale;
+    size_t recorded_from;
+    {
+        WriteOp op(pager);
+        snapshot.emplace(pager);  // Our own operation: nothing to wait for, no latch held
+        base_rows = pager.header.row_count;
+        base_stale = pager.header.bloom_stale;
+        pages = pages_for_rows(base_rows);
+        recorded_from = pending_bloom_keys.size();
+        bloom_recording = true;
+    }
+    auto abandon = [&] {
+        WriteOp op(pager);
+        bloom_recording = false;
+        pending_bloom_keys.resize(recorded_from);  // Those are in the live filter
+        return false;
+    };
+
+    std::unique_ptr<BloomFilter::Table> fresh;
+    std::vector<uint8_t> leaf_copy(PAGE_SIZE);
+    uint32_t rows;
+    while (true) {
+        fresh = BloomFilter::make_table(pages);
+        rows = 0;
+        find_in_snapshot(*snapshot, 0, leaf_copy.data());
+        while (true) {
+            if (rebuild_stop) return abandon();
+            LeafNode leaf(leaf_copy.data());
+            for (uint32_t i = 0; i < leaf.get_num_cells(); i++)
+                BloomFilter::add_to(*fresh, leaf.get_key(i));
+            rows += leaf.get_num_cells();
+            uint32_t next = leaf.get_next_leaf();
+            if (next == 0) break;
+            snapshot->read(next, leaf_copy.data());
+        }
+
+        // The header's count was unknown (a migrated file): size it again
+        if (BloomFilter::capacity_of(pages) >= rows) break;
+        pages = pages_for_rows(rows);
     }
+    snapshot.reset();
+
+    WriteOp op(pager);
+    for (uint64_t key : pending_bloom_keys) BloomFilter::add_to(*fresh, key);
+    pending_bloom_keys.clear();  // All in the tree at the snapshot, or added since
+    bloom_recording = false;
+    install_bloom(std::move(fresh));
+    pager.header.flags |= DB_FLAG_BLOOM_VALID;
+    pager.header.row_count = rows + (pager.header.row_count - base_rows);
+    pager.header.bloom_stale -= base_stale;  // Keys deleted since are still set
+    bloom_ready = true;
+    if (!pager.in_batch) pager.commit();  // An open batch commits it with its own pages
+    return true;
+}
+
+// Due once the tree has outgrown the filter (its FPR heads past the target)
+// or enough of its keys were deleted
+bool BTree::bloom_rebuild_due() const {
+    const DbHeader& h = pager.header;
+    if (h.row_count > h.bloom_capacity) return true;
+    return h.bloom_stale >= BLOOM_STALE_MIN &&
+           (uint64_t)h.bloom_stale * 100 >= (uint64_t)h.row_count * BLOOM_STALE_PERCENT;
+}
+
+void BTree::schedule_bloom_rebuild(bool load_first) {
+    if (rebuild_running.exchange(true)) return;
+    if (rebuild_thread.joinable()) rebuild_thread.join();  // Previous run, already finished
+    uint32_t first = pager.header.bloom_first_page;
+    uint32_t pages = pager.header.bloom_pages;
+    rebuild_thread = std::thread([this, load_first, first, pages] {
+        if (load_first) {
+            load_bloom(first, pages);
+            std::lock_guard<std::mutex> lock(bloom_mutex);
+            bloom_loading = false;
+            bloom_cv.notify_all();
+        }
+        if (!rebuild_stop) {
+            bool due;
+            {
+                WriteOp op(pager);
+                due = !bloom_ready || bloom_rebuild_due();
+            }
+            if (due) rebuild_bloom();
+        }
+        rebuild_running = false;
+    });
 }
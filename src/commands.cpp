@@ -0,0 +1,490 @@
+#include "commands.h"
+#include "utils.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "cursor.h"
+#include "scan.h"
+#include "vacuum.h"
+#include "backup.h"
+#include "metrics.h"
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+
+// ==========================================
+// HELPER: Read a bulk-load file
+// ==========================================
+// Blank lines and lines starting with '#' are skipped.
+bool read_rows_file(const char* path, std::vector<Row>& rows) {
+    std::ifstream in(path);
+    if (!in.good()) {
+        output() << "Error: Cannot open " << path << "\n";
+        return false;
+    }
+    std::string line;
+    uint32_t line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (line.empty() || line[0] == '#') continue;
+        Row row;
+        std::memset(&row, 0, sizeof(Row));
+        char key[32];
+        if (std::sscanf(line.c_str(), "%31s %31s %254s", key, row.username, row.email) != 3 ||
+            !parse_key(key, row.id)) {
+            output() << "Error: " << path << ":" << line_no << ": expected <id> <username> <email>\n";
+            return false;
+        }
+        rows.push_back(row);
+    }
+    return true;
+}
+
+// ==========================================
+// HELPER: Batched lookups (lookup a b c, SELECT ... WHERE id IN)
+// ==========================================
+// Whitespace-separated ids; FALSE if there are none or one does not parse.
+static bool parse_ids(const char* text, std::vector<uint64_t>& ids) {
+    while (true) {
+        while (std::isspace((unsigned char)*text)) text++;
+        if (*text == '\0') return !ids.empty();
+        const char* end = text;
+        while (*end != '\0' && !std::isspace((unsigned char)*end)) end++;
+        uint64_t id;
+        if (!parse_key(std::string_view(text, end - text), id)) return false;
+        ids.push_back(id);
+        text = end;
+    }
+}
+
+static void print_lookup(BTree& tree, const std::vector<uint64_t>& ids,
+                         bool descending = false, uint64_t limit = UINT64_MAX) {
+    LookupStats stats;
+    std::vector<Row> rows = tree.find_rows(ids, &stats);
+    if (descending) std::reverse(rows.begin(), rows.end());
+    if (rows.size() > limit) rows.resize(limit);
+    for (const Row& row : rows)
+        output() << "  (" << row.id << ", " << row.username << ", " << row.email << ")\n";
+    output() << "Found " << rows.size() << " of " << stats.requested << " key(s) ("
+             << stats.bloom_rejected << " rejected by bloom, " << stats.pages_visited
+             << " page(s) / " << stats.leaves_visited << " leaf visit(s)).\n";
+}
+
+// ==========================================
+// HELPER: Streaming scans (select, range)
+// ==========================================
+// Trailing modifiers, in any order: [desc] [limit <n>]
+static bool parse_scan_modifiers(const char* text, ScanOptions& opts) {
+    char word[16];
+    int used = 0;
+    while (std::sscanf(text, " %15s%n", word, &used) == 1) {
+        text += used;
+        if (std::strcmp(word, "desc") == 0) {
+            opts.reverse = true;
+        } else if (std::strcmp(word, "limit") == 0) {
+            unsigned long long n = 0;
+            if (std::sscanf(text, " %llu%n", &n, &used) != 1) return false;
+            text += used;
+            opts.limit = n;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Without a limit the scan is split across the workers; a limited one
+// usually ends within a few leaves, so one cursor reads it.  Both read a
+// snapshot and never hold writers up.
+static void print_scan(BTree& tree, const ScanOptions& opts) {
+    if (opts.limit == UINT64_MAX) {
+        ParallelScan(tree, opts).print();
+        return;
+    }
+    Snapshot snapshot(tree.get_pager());
+    ScanOptions read = opts;
+    read.snapshot = &snapshot;
+    RowCursor cursor(tree, read);
+    OutputBuffer out;
+    std::vector<RowView> batch;
+    while (cursor.next_batch(batch) > 0) {
+        for (const RowView& row : batch)
+            out << "  (" << row.id << ", " << row.username << ", " << row.email << ")\n";
+    }
+}
+
+// ==========================================
+// HELPER: Lookups by column value (WHERE username / email = ...)
+// ==========================================
+// Through the column's index when it has one, else by a parallel scan of
+// every row with the comparison pushed down to the workers
+static std::vector<uint64_t> ids_matching(BTree& tree, IndexColumn column, std::string_view value) {
+    if (tree.has_index(column)) return tree.index_lookup(column, value);
+    return ParallelScan(tree, ScanOptions(), ScanFilter{true, column, value}).ids();
+}
+
+static void print_matches(BTree& tree, IndexColumn column, std::string_view value,
+                          bool descending, uint64_t limit) {
+    if (!tree.has_index(column)) {
+        ScanOptions opts;
+        opts.reverse = descending;
+        opts.limit = limit;
+        uint64_t found = ParallelScan(tree, opts, ScanFilter{true, column, value}).print();
+        output() << "Found " << found << " row(s) by a full scan (no index on " << column_name(column) << ").\n";
+        return;
+    }
+    std::vector<uint64_t> ids = tree.index_lookup(column, value);
+    LookupStats stats;
+    std::vector<Row> rows = tree.find_rows(ids, &stats);
+    if (descending) std::reverse(rows.begin(), rows.end());
+    if (rows.size() > limit) rows.resize(limit);
+    for (const Row& row : rows)
+        output() << "  (" << row.id << ", " << row.username << ", " << row.email << ")\n";
+    output() << "Found " << rows.size() << " row(s) through the " << column_name(column) << " index.\n";
+}
+
+// SELECT COUNT(*) / MIN / MAX: lookups fetch their rows first, scans fold
+// them on the workers (with a column comparison pushed down to them)
+static void print_aggregates(BTree& tree, const Statement& statement) {
+    if (statement.access == ACCESS_POINTS) {
+        print_aggregates(statement.aggregates, tree.find_rows(statement.target_ids));
+    } else if (statement.access == ACCESS_INDEX && tree.has_index(statement.column)) {
+        std::vector<uint64_t> ids = tree.index_lookup(statement.column, statement.match_value);
+        print_aggregates(statement.aggregates, tree.find_rows(ids));
+    } else {
+        ScanOptions opts;
+        ScanFilter filter;
+        if (statement.access == ACCESS_RANGE) {
+            opts.start = statement.range_start;
+            opts.end = statement.range_end;
+        } else if (statement.access == ACCESS_INDEX) {
+            filter = ScanFilter{true, statement.column, statement.match_value};
+        }
+        ParallelScan(tree, opts, filter).print_aggregates(statement.aggregates);
+    }
+}
+
+// ==========================================
+// HELPER: SQL execution and prepared statements
+// ==========================================
+// Prepared statements belong to the calling thread: the REPL, or one server
+// connection.  Each owns its SQL text, which its operands view.
+struct PreparedStatement {
+    std::unique_ptr<std::string> sql;
+    Statement statement;
+};
+static thread_local std::unordered_map<std::string, PreparedStatement> prepared;
+
+// The token buffer is reused by every query on this thread
+static bool parse_sql(std::string_view query, Statement& statement) {
+    static thread_local std::vector<Token> tokens;
+    Tokenizer(query).tokenize(tokens);
+    Parser parser(tokens);
+    if (parser.parse_statement(statement)) return true;
+    output() << "Syntax Error in SQL query.\n";
+    return false;
+}
+
+static void execute_statement(Statement& statement, BTree& tree) {
+    if (statement.type == STATEMENT_INSERT) {
+        tree.insert(statement.row_to_insert.id, statement.row_to_insert);
+    } else if (statement.type == STATEMENT_SELECT) {
+        if (!statement.aggregates.empty()) {
+            print_aggregates(tree, statement);
+        } else if (statement.access == ACCESS_POINTS) {
+            print_lookup(tree, statement.target_ids, statement.descending, statement.row_limit);
+        } else if (statement.access == ACCESS_INDEX) {
+            print_matches(tree, statement.column, statement.match_value, statement.descending,
+                          statement.row_limit);
+        } else {
+            ScanOptions opts;
+            opts.start = statement.range_start;
+            opts.end = statement.range_end;
+            opts.reverse = statement.descending;
+            opts.limit = statement.row_limit;
+            print_scan(tree, opts);
+        }
+    } else if (statement.type == STATEMENT_DELETE) {
+        std::vector<uint64_t> ids = statement.target_ids;
+        if (statement.access == ACCESS_INDEX) {
+            ids = ids_matching(tree, statement.column, statement.match_value);
+        } else if (statement.access == ACCESS_RANGE) {
+            // Collect first: the tree cannot change under an open scan
+            ScanOptions opts;
+            opts.start = statement.range_start;
+            opts.end = statement.range_end;
+            ids = ParallelScan(tree, opts).ids();
+        }
+        uint32_t deleted = 0;
+        for (uint64_t id : ids) deleted += tree.remove(id);
+        LOG_AT(LOG_INFO) << "Deleted " << deleted << " row(s).\n";
+    } else if (statement.type == STATEMENT_BEGIN) {
+        tree.begin_batch();
+    } else if (statement.type == STATEMENT_COMMIT) {
+        tree.commit_batch();
+    }
+}
+
+static void bind_and_execute(Statement& statement, const std::vector<std::string_view>& params, BTree& tree) {
+    std::string error;
+    if (!statement.bind(params, error)) {
+        output() << "Error: " << error << "\n";
+        return;
+    }
+    execute_statement(statement, tree);
+}
+
+// Whitespace-separated values; '...' keeps spaces.  Views into text.
+static bool parse_params(const char* text, std::vector<std::string_view>& params) {
+    while (true) {
+        while (std::isspace((unsigned char)*text)) text++;
+        if (*text == '\0') return true;
+        const char* begin = text;
+        if (*text == '\'') {
+            const char* close = std::strchr(++begin, '\'');
+            if (!close) return false;
+            params.emplace_back(begin, close - begin);
+            text = close + 1;
+        } else {
+            while (*text && !std::isspace((unsigned char)*text)) text++;
+            params.emplace_back(begin, text - begin);
+        }
+    }
+}
+
+// ==========================================
+// HELPER: Handle a single command string
+// ==========================================
+void handle_command(const std::string& input, BTree& tree, Pager& pager) {
+    if (input.substr(0, 6) == "insert") {
+        Row row;
+        std::memset(&row, 0, sizeof(Row));
+        char buf[100], key[32] = "0";
+        std::sscanf(input.c_str(), "%99s %31s %31s %254s", buf, key, row.username, row.email);
+        if (parse_key(key, row.id)) {
+            tree.insert(row.id, row);
+        } else {
+            output() << "Error: '" << key << "' is not a valid key.\n";
+        }
+    } else if (input.substr(0, 6) == "delete") {
+        uint64_t id = 0;
+        char buf[100], key[32];
+        if (std::sscanf(input.c_str(), "%99s %31s", buf, key) == 2 && parse_key(key, id)) {
+            tree.remove(id);
+        } else {
+            output() << "Usage: delete <id>\n";
+        }
+    } else if (input == "begin") {
+        tree.begin_batch();
+    } else if (input == "commit") {
+        tree.commit_batch();
+    } else if (input.substr(0, 6) == "select") {
+        ScanOptions opts;
+        if (parse_scan_modifiers(input.c_str() + 6, opts)) {
+            print_scan(tree, opts);
+        } else {
+            output() << "Usage: select [desc] [limit <n>]\n";
+        }
+    } else if (input.substr(0, 5) == "range") {
+        ScanOptions opts;
+        char buf[100], start[32], end[32];
+        int used = 0;
+        if (std::sscanf(input.c_str(), "%99s %31s %31s%n", buf, start, end, &used) == 3 &&
+            parse_key(start, opts.start) && parse_key(end, opts.end) &&
+            parse_scan_modifiers(input.c_str() + used, opts)) {
+            print_scan(tree, opts);
+        } else {
+            output() << "Usage: range <start_id> <end_id> [desc] [limit <n>]\n";
+        }
+    } else if (input.substr(0, 6) == "lookup") {
+        std::vector<uint64_t> ids;
+        if (!parse_ids(input.c_str() + 6, ids)) {
+            output() << "Usage: lookup <id> [<id> ...]\n";
+        } else if (ids.size() == 1) {
+            Row row;
+            if (tree.find_row(ids[0], row)) {
+                output() << "Found: (" << row.id << ", " << row.username << ", " << row.email << ")\n";
+            } else {
+                output() << "Not found: " << ids[0] << "\n";
+            }
+        } else {
+            print_lookup(tree, ids);
+        }
+    } else if (input.substr(0, 4) == "sql ") {
+        // Tokenize, parse into a plan, bind (no parameters), execute
+        static thread_local Statement statement;
+        static const std::vector<std::string_view> no_params;
+        if (parse_sql(std::string_view(input).substr(4), statement)) bind_and_execute(statement, no_params, tree);
+    } else if (input.substr(0, 8) == "prepare ") {
+        char name[64];
+        int used = 0;
+        PreparedStatement entry;
+        if (std::sscanf(input.c_str(), "prepare %63s %n", name, &used) != 1 || used == 0 ||
+            input.size() <= (size_t)used) {
+            output() << "Usage: prepare <name> <sql with ? placeholders>\n";
+        } else {
+            entry.sql = std::make_unique<std::string>(input.substr(used));
+            if (parse_sql(*entry.sql, entry.statement)) {
+                LOG_AT(LOG_INFO) << "Prepared " << name << " (" << entry.statement.num_params << " parameter(s)).\n";
+                prepared[name] = std::move(entry);
+            }
+        }
+    } else if (input.substr(0, 8) == "execute ") {
+        char name[64];
+        int used = 0;
+        std::vector<std::string_view> params;
+        if (std::sscanf(input.c_str(), "execute %63s%n", name, &used) != 1 ||
+            !parse_params(input.c_str() + used, params)) {
+            output() << "Usage: execute <name> [value ...]\n";
+        } else if (prepared.count(name) == 0) {
+            output() << "Error: No prepared statement " << name << "\n";
+        } else {
+            bind_and_execute(prepared[name].statement, params, tree);
+        }
+    } else if (input.substr(0, 11) == "deallocate ") {
+        char name[64];
+        if (std::sscanf(input.c_str(), "deallocate %63s", name) == 1 && prepared.erase(name)) {
+            LOG_AT(LOG_INFO) << "Deallocated " << name << ".\n";
+        } else {
+            output() << "Error: No prepared statement " << input.substr(11) << "\n";
+        }
+    } else if (input == ".tree") {
+        tree.print_tree();
+    } else if (input == ".json") {
+        tree.print_json();
+    } else if (input == ".stats") {
+        pager.print_stats();
+    } else if (input == ".pool") {
+        pager.print_pool_stats();
+    } else if (input == ".wal") {
+        pager.print_wal_stats();
+    } else if (input == ".metrics") {
+        print_metrics(output());
+    } else if (input == ".checkpoint") {
+        if (pager.in_batch) {
+            output() << "Error: Cannot checkpoint inside a batch; commit it first.\n";  // It would commit half the batch
+        } else {
+            pager.checkpoint();
+            LOG_AT(LOG_INFO) << "Checkpoint complete.\n";
+        }
+    } else if (input == ".freelist") {
+        pager.print_free_list();
+    } else if (input == ".bloom rebuild") {
+        tree.do_rebuild_bloom();
+        LOG_AT(LOG_INFO) << "Bloom filter rebuilt from B+Tree.\n";
+    } else if (input == ".bloom") {
+        tree.print_bloom_stats();
+    } else if (input.substr(0, 6) == ".load ") {
+        char path[256];
+        uint32_t fill = BULK_FILL_DEFAULT;
+        if (std::sscanf(input.c_str(), ".load %255s %u", path, &fill) >= 1) {
+            std::vector<Row> rows;
+            if (read_rows_file(path, rows)) tree.bulk_load(rows, fill);
+        } else {
+            output() << "Usage: .load <file> [fill_percent]  (rows: <id> <username> <email>)\n";
+        }
+    } else if (input == ".vacuum" || input.substr(0, 8) == ".vacuum ") {
+        uint32_t max_steps = UINT32_MAX;
+        if (input.size() > 7 && std::sscanf(input.c_str(), ".vacuum %u", &max_steps) != 1) {
+            output() << "Usage: .vacuum [max_steps]\n";
+        } else {
+            Vacuum vacuum(tree);
+            vacuum.run(max_steps);
+            const VacuumStats& st = vacuum.stats();
+            output() << "Vacuum: moved " << st.pages_moved << " page(s) and " << st.runs_moved
+                     << " run(s) in " << st.steps << " step(s); " << st.leaves_in_order
+                     << " leaves in key order.\n";
+            output() << "File: " << st.pages_before << " -> " << st.pages_after << " pages";
+            if (!vacuum.done()) output() << " (stopped early; run .vacuum again to continue)";
+            else if (pager.in_batch) output() << " (not truncated inside a batch)";
+            output() << ".\n";
+        }
+    } else if (input.substr(0, 8) == ".backup ") {
+        // .backup <path> [incremental]
+        char path[256], mode[16] = "";
+        int fields = std::sscanf(input.c_str(), ".backup %255s %15s", path, mode);
+        bool incremental = fields == 2 && std::strcmp(mode, "incremental") == 0;
+        if (fields < 1 || (fields == 2 && !incremental)) {
+            output() << "Usage: .backup <path> [incremental]\n";
+        } else {
+            Backup backup(pager);
+            if (incremental ? backup.incremental(path) : backup.full(path)) {
+                const BackupStats& st = backup.stats();
+                output() << (incremental ? "Incremental backup" : "Backup") << " at LSN " << st.lsn;
+                if (incremental) output() << " (changes since LSN " << st.base_lsn << ")";
+                output() << ": " << st.pages_copied << " page(s) to " << path << ", " << st.pages_free
+                         << " free page(s) skipped";
+                if (incremental) output() << ", " << st.pages_unchanged << " unchanged";
+                output() << "; " << st.reads << " read(s)";
+                if (st.rereads) output() << " (" << st.rereads << " repeated after a checkpoint)";
+                output() << ", " << st.from_versions
+                         << " page(s) changed during the copy, " << st.seconds << " s.\n";
+            }
+        }
+    } else if (input == ".index") {
+        tree.print_indexes();
+    } else if (input.substr(0, 7) == ".index ") {
+        // .index <column>  |  .index drop <column>
+        std::string_view args = std::string_view(input).substr(7);
+        bool drop = args.substr(0, 5) == "drop ";
+        IndexColumn column;
+        if (!parse_column(drop ? args.substr(5) : args, column)) {
+            output() << "Usage: .index [[drop] username|email]\n";
+        } else if (drop) {
+            tree.drop_index(column);
+        } else {
+            tree.create_index(column);
+        }
+    } else if (input.substr(0, 6) == ".free ") {
+        uint32_t pg = 0;
+        if (std::sscanf(input.c_str(), ".free %u", &pg) == 1 && pg > ROOT_PAGE) {
+            pager.free_page(pg);
+            LOG_AT(LOG_INFO) << "Freed page " << pg << ".\n";
+        } else {
+            output() << "Usage: .free <page_num>  (page must be > " << ROOT_PAGE << ")\n";
+        }
+    } else if (input == "exit") {
+        // Handled in main loop — break ensures Pager destructor flushes pages
+    } else {
+        output() << "Unrecognized command.\n";
+    }
+
+    // Autocommit: outside a batch each command is its own unit of work
+    if (!pager.in_batch && !is_read_command(input) && !is_stepwise_command(input)) pager.commit();
+}
+
+bool is_stepwise_command(const std::string& input) {
+    return input == ".vacuum" || input.substr(0, 8) == ".vacuum " || input.substr(0, 8) == ".backup ";
+}
+
+bool is_read_command(const std::string& input) {
+    static const char* const exact[] = {
+        ".tree", ".json", ".stats", ".pool", ".wal", ".freelist", ".bloom", ".index", ".metrics"
+    };
+    for (const char* cmd : exact) {
+        if (input == cmd) return true;
+    }
+    if (input.substr(0, 6) == "select" || input.substr(0, 5) == "range" ||
+        input.substr(0, 6) == "lookup") return true;
+    if (input.substr(0, 8) == "prepare " || input.substr(0, 11) == "deallocate ") return true;
+
+    // execute <name> of a prepared SELECT
+    if (input.substr(0, 8) == "execute ") {
+        char name[64];
+        if (std::sscanf(input.c_str(), "execute %63s", name) != 1) return true;  // Usage error only
+        auto it = prepared.find(name);
+        return it == prepared.end() || it->second.statement.type == STATEMENT_SELECT;
+    }
+
+    // sql SELECT ...
+    if (input.substr(0, 4) != "sql ") return false;
+    size_t start = input.find_first_not_of(' ', 4);
+    if (start == std::string::npos || input.size() - start < 6) return false;
+    std::string verb = input.substr(start, 6);
+    for (auto& c : verb) c = std::toupper((unsigned char)c);
+    return verb == "SELECT";
+}
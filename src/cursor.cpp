@@ -0,0 +1,117 @@
+#include "cursor.h"
+
+// ==========================================
+// ROW CURSOR IMPLEMENTATION
+// ==========================================
+
+RowCursor::RowCursor(BTree& t, const ScanOptions& options)
+    : tree(t), opts(options), last(options.end), remaining(options.limit) {
+    if (opts.start > opts.end || remaining == 0) finished = true;
+    if (opts.snapshot && !finished) copy.resize(PAGE_SIZE);
+}
+
+void RowCursor::close() {
+    drop_leaf();
+    finished = true;
+}
+
+void RowCursor::drop_leaf() {
+    if (leaf.valid()) tree.pager.release(leaf);
+    leaf = PageHandle();
+    leaf_page = 0;
+    leaf_data = nullptr;
+}
+
+// Leaf that may hold key: S-latched, or copied through the snapshot
+void RowCursor::descend(uint64_t key, uint64_t* fence) {
+    if (opts.snapshot) {
+        leaf_page = tree.find_in_snapshot(*opts.snapshot, key, copy.data(), fence);
+        leaf_data = copy.data();
+    } else {
+        leaf = tree.find_shared(key, fence);
+        leaf_page = leaf.page_num;
+        leaf_data = leaf.data;
+    }
+}
+
+// FALSE (leaf dropped) at the end of the chain
+bool RowCursor::step_right() {
+    if (!opts.snapshot) {
+        if (!tree.step_right(leaf)) {  // Released
+            leaf = PageHandle();
+            drop_leaf();
+            return false;
+        }
+        leaf_page = leaf.page_num;
+        leaf_data = leaf.data;
+        return true;
+    }
+    uint32_t next = LeafNode(leaf_data).get_next_leaf();
+    if (next == 0) {
+        drop_leaf();
+        return false;
+    }
+    opts.snapshot->read(next, copy.data());
+    leaf_page = next;
+    return true;
+}
+
+// Leaves the cursor on a leaf with a slot left to read; FALSE at the end
+bool RowCursor::position_forward() {
+    if (!started) {
+        started = true;
+        descend(opts.start);
+        tree.read_ahead(leaf_page, leaf_data, ra);
+        pos = LeafNode(leaf_data).lower_bound(opts.start);
+    }
+    while (pos >= LeafNode(leaf_data).get_num_cells()) {
+        if (!step_right()) return false;
+        tree.read_ahead(leaf_page, leaf_data, ra);
+        pos = 0;
+    }
+    return true;
+}
+
+bool RowCursor::position_reverse() {
+    while (leaf_data == nullptr || pos == 0) {
+        if (leaf_data != nullptr) {
+            drop_leaf();
+            if (fence == 0) return false;  // Leftmost leaf done
+            last = fence - 1;
+        }
+        if (last < opts.start) return false;
+        descend(last, &fence);
+        LeafNode node(leaf_data);
+        pos = last == UINT64_MAX ? node.get_num_cells() : node.lower_bound(last + 1);
+    }
+    return true;
+}
+
+size_t RowCursor::next_batch(std::vector<RowView>& out, size_t max) {
+    out.clear();
+    if (finished) {
+        close();  // The previous batch's views are no longer needed
+        return 0;
+    }
+
+    if (!opts.reverse) {
+        if (!position_forward()) { finished = true; return 0; }
+        LeafNode node(leaf_data);
+        uint32_t n = node.get_num_cells();
+        while (pos < n && out.size() < max && remaining > 0) {
+            if (node.get_key(pos) > opts.end) { finished = true; break; }
+            out.push_back(node.view(pos++));
+            remaining--;
+        }
+    } else {
+        if (!position_reverse()) { finished = true; return 0; }
+        LeafNode node(leaf_data);
+        while (pos > 0 && out.size() < max && remaining > 0) {
+            if (node.get_key(pos - 1) < opts.start) { finished = true; break; }
+            out.push_back(node.view(--pos));
+            remaining--;
+        }
+    }
+    if (remaining == 0) finished = true;  // The leaf stays held for these views
+    return out.size();
+}
@@ -0,0 +1,116 @@
+#include "fsm.h"
+#include <algorithm>
+
+// ==========================================
+// FREE-SPACE MAP IMPLEMENTATION
+// ==========================================
+
+// Bits per map page are a multiple of 64, so a map page holds whole words
+static inline uint32_t words_per_map_page() { return FreeSpaceMap::pages_per_map_page() / 64; }
+
+uint32_t FreeSpaceMap::map_pages_for(uint64_t total_pages) {
+    uint64_t per = pages_per_map_page();
+    return (uint32_t)std::max<uint64_t>((total_pages + per - 1) / per, 1);
+}
+
+// --- Bits ---
+
+void FreeSpaceMap::mark_dirty(uint32_t page_num) {
+    uint32_t index = page_num / pages_per_map_page();
+    if (index >= dirty.size()) dirty.resize(index + 1, 0);
+    dirty[index] = 1;
+}
+
+bool FreeSpaceMap::is_free(uint32_t page_num) const {
+    uint32_t w = page_num / 64;
+    return w < words.size() && (words[w] >> (page_num % 64) & 1);
+}
+
+bool FreeSpaceMap::set_free(uint32_t page_num, bool free) {
+    if (is_free(page_num) == free) return false;
+    uint32_t w = page_num / 64;
+    if (w >= words.size()) words.resize(w + 1, 0);
+    words[w] ^= 1ull << (page_num % 64);
+    free_count += free ? 1 : -1;
+    mark_dirty(page_num);
+    return true;
+}
+
+uint32_t FreeSpaceMap::find_free(uint32_t from, uint32_t to) const {
+    to = std::min<uint64_t>(to, (uint64_t)words.size() * 64);
+    if (from >= to) return INVALID_PAGE;
+    uint32_t w = from / 64;
+    uint64_t bits = words[w] & (~0ull << (from % 64));
+    while (true) {
+        if (bits) {
+            uint32_t pg = w * 64 + __builtin_ctzll(bits);
+            return pg < to ? pg : INVALID_PAGE;
+        }
+        if (++w * 64 >= to) return INVALID_PAGE;
+        bits = words[w];
+    }
+}
+
+uint32_t FreeSpaceMap::find_run(uint32_t count, uint32_t from, uint32_t to) const {
+    uint32_t start = find_free(from, to);
+    while (start != INVALID_PAGE && (uint64_t)start + count <= to) {
+        uint32_t pg = start + 1;
+        while (pg < start + count && is_free(pg)) pg++;
+        if (pg == start + count) return start;
+        start = find_free(pg + 1, to);  // pg is in use: no run can include it
+    }
+    return INVALID_PAGE;
+}
+
+void FreeSpaceMap::truncate(uint32_t total_pages) {
+    uint32_t end = (uint32_t)std::min<uint64_t>((uint64_t)words.size() * 64, UINT32_MAX);
+    for (uint32_t pg = find_free(total_pages, end); pg != INVALID_PAGE; pg = find_free(pg + 1, end))
+        set_free(pg, false);
+}
+
+// --- Persistence ---
+
+bool FreeSpaceMap::read_page(uint32_t index, const void* page, uint32_t total_pages) {
+    if (*(const uint8_t*)page != NODE_FSM) return false;
+    uint32_t per_page = words_per_map_page();
+    if (words.size() < (size_t)(index + 1) * per_page) words.resize((size_t)(index + 1) * per_page, 0);
+    uint64_t* dest = words.data() + (size_t)index * per_page;
+    std::memcpy(dest, (const char*)page + FSM_PAGE_HEADER, per_page * sizeof(uint64_t));
+
+    // Never trust bits past the end of the file
+    uint64_t first = (uint64_t)index * pages_per_map_page();
+    for (uint32_t i = 0; i < per_page; i++) {
+        uint64_t base = first + (uint64_t)i * 64;
+        if (base >= total_pages) dest[i] = 0;
+        else if (base + 64 > total_pages) dest[i] &= ~0ull >> (base + 64 - total_pages);
+        free_count += __builtin_popcountll(dest[i]);
+    }
+    return true;
+}
+
+void FreeSpaceMap::mark_all_dirty(uint32_t num_pages) {
+    dirty.assign(std::max<size_t>(num_pages, dirty.size()), 1);
+}
+
+void FreeSpaceMap::collect_dirty(uint32_t first_page, uint32_t num_pages,
+                                 std::vector<std::pair<uint32_t, const void*>>& out) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < num_pages && i < dirty.size(); i++) count += dirty[i];
+    if (count == 0) return;
+
+    images.assign((size_t)count * PAGE_SIZE, 0);
+    uint32_t per_page = words_per_map_page();
+    uint8_t* image = images.data();
+    for (uint32_t i = 0; i < num_pages && i < dirty.size(); i++) {
+        if (!dirty[i]) continue;
+        dirty[i] = 0;
+        image[OFFSET_TYPE] = NODE_FSM;
+        size_t begin = (size_t)i * per_page;
+        if (begin < words.size()) {
+            size_t n = std::min<size_t>(per_page, words.size() - begin);
+            std::memcpy(image + FSM_PAGE_HEADER, words.data() + begin, n * sizeof(uint64_t));
+        }
+        out.push_back({first_page + i, image});
+        image += PAGE_SIZE;
+    }
+}
@@ -1,121 +1,227 @@
 #include "btree.h"
 #include "pager.h"
+#include "commands.h"
+#include "server.h"
+#include "backup.h"
+#include "utils.h"
 #include <iostream>
+#include <fstream>
 #include <string>
-#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
-#include <tokenizer.h>
-#include <parser.h>
+#include <unistd.h>
 
 // ==========================================
-// HELPER: Handle a single command string
+// HELPER: Startup options
 // ==========================================
-void handle_command(const std::string& input, BTree& tree, Pager& pager) {
-    if (input.substr(0, 6) == "insert") {
-        Row row;
-        std::memset(&row, 0, sizeof(Row));
-        char buf[100];
-        std::sscanf(input.c_str(), "%99s %u %31s %254s", buf, &row.id, row.username, row.email);
-        tree.insert(row.id, row);
-    } else if (input.substr(0, 6) == "delete") {
-        uint32_t id = 0;
-        char buf[100];
-        if (std::sscanf(input.c_str(), "%99s %u", buf, &id) == 2) {
-            tree.remove(id);
-        } else {
-            std::cout << "Usage: delete <id>\n";
-        }
-    } else if (input == "select") {
-        tree.select_all();
-    } else if (input.substr(0, 5) == "range") {
-        uint32_t start = 0, end = 0;
-        char buf[100];
-        if (std::sscanf(input.c_str(), "%99s %u %u", buf, &start, &end) == 3) {
-            tree.range_scan(start, end);
-        } else {
-            std::cout << "Usage: range <start_id> <end_id>\n";
-        }
-    } else if (input.substr(0, 6) == "lookup") {
-        uint32_t id = 0;
-        char buf[100];
-        if (std::sscanf(input.c_str(), "%99s %u", buf, &id) == 2) {
-            Row row;
-            if (tree.find_row(id, row)) {
-                std::cout << "Found: (" << row.id << ", " << row.username << ", " << row.email << ")\n";
-            }
-        } else {
-            std::cout << "Usage: lookup <id>\n";
-        }
-    } else if (input.substr(0, 4) == "sql ") {
-        std::string query = input.substr(4);
-        
-        // 1. Tokenize
-        Tokenizer tokenizer(query);
-        std::vector<Token> tokens = tokenizer.tokenize();
-        
-        // 2. Parse
-        Parser parser(tokens);
-        Statement statement;
-        if (parser.parse_statement(statement)) {
-            
-            // 3. Execute (Virtual Machine Phase)
-            if (statement.type == STATEMENT_INSERT) {
-                tree.insert(statement.row_to_insert.id, statement.row_to_insert);
-                // "Executed." will be printed by the BTree
-            }
-        } else {
-            std::cout << "Syntax Error in SQL query.\n";
-        }
-    } else if (input == ".tree") {
-        tree.print_tree();
-    } else if (input == ".json") {
-        tree.print_json();
-    } else if (input == ".stats") {
-        pager.print_stats();
-    } else if (input == ".pool") {
-        pager.print_pool_stats();
-    } else if (input == ".freelist") {
-        pager.print_free_list();
-    } else if (input == ".bloom rebuild") {
-        tree.do_rebuild_bloom();
-        std::cout << "Bloom filter rebuilt from B+Tree.\n";
-    } else if (input == ".bloom") {
-        tree.print_bloom_stats();
-    } else if (input.substr(0, 6) == ".free ") {
-        uint32_t pg = 0;
-        if (std::sscanf(input.c_str(), ".free %u", &pg) == 1 && pg > ROOT_PAGE) {
-            pager.free_page(pg);
-            std::cout << "Freed page " << pg << ".\n";
-        } else {
-            std::cout << "Usage: .free <page_num>  (page must be > " << ROOT_PAGE << ")\n";
+// --pool <n>        buffer pool: n frames, or bytes with a K/M/G suffix (512M)
+// --page-size <n>   page size for a NEW database (1024..32768, power of two)
+// --mmap            serve clean page reads from a read-only file mapping
+// --readahead <n>   leaves prefetched ahead of a scan (0 disables)
+// --scan-threads <n>  worker threads per parallel scan (0 = one per core)
+// --verify <when>   page checksum checks: always, first (first read of each
+//                   page only) or background (on a verifier thread)
+// --listen [[host:]port]  run as a TCP server (default 127.0.0.1:7070)
+// --socket <path>   run as a Unix-socket server
+// --script <path>   run the commands in a file ("-" for stdin), one per line,
+//                   with output through one large buffer; quiet by default
+// --log <level>     engine messages: quiet, info or debug (the default)
+// --restore <path>  rebuild the database from a .backup, then from each
+//                   further --restore increment in order, and exit
+// Environment: FORGEDB_POOL, FORGEDB_PAGE_SIZE, FORGEDB_MMAP=1, FORGEDB_READAHEAD,
+// FORGEDB_SCAN_THREADS, FORGEDB_VERIFY, FORGEDB_LOG (flags take precedence).
+static bool parse_pool(const char* text, PagerConfig& config) {
+    char* end = nullptr;
+    unsigned long long n = std::strtoull(text, &end, 10);
+    if (end == text || n == 0) return false;
+    uint64_t unit = 0;
+    switch (*end) {
+        case '\0': config.pool_frames = (uint32_t)std::min(n, 0xFFFFFFFFull); config.pool_bytes = 0; return true;
+        case 'K': case 'k': unit = 1ull << 10; break;
+        case 'M': case 'm': unit = 1ull << 20; break;
+        case 'G': case 'g': unit = 1ull << 30; break;
+        default: return false;
+    }
+    if (end[1] != '\0' && !(end[1] == 'B' && end[2] == '\0')) return false;
+    config.pool_bytes = n * unit;
+    return true;
+}
+
+static bool parse_page_size(const char* text, PagerConfig& config) {
+    char* end = nullptr;
+    unsigned long n = std::strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || !valid_page_size(n)) return false;
+    config.page_size = n;
+    return true;
+}
+
+static bool parse_count(const char* text, uint32_t& out) {
+    char* end = nullptr;
+    unsigned long n = std::strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || n > 1024) return false;
+    out = n;
+    return true;
+}
+
+static bool parse_verify(const char* text, PagerConfig& config) {
+    if (std::strcmp(text, "always") == 0)          config.verify = VERIFY_ALWAYS;
+    else if (std::strcmp(text, "first") == 0)      config.verify = VERIFY_FIRST;
+    else if (std::strcmp(text, "background") == 0) config.verify = VERIFY_BACKGROUND;
+    else return false;
+    return true;
+}
+
+struct ServerOptions {
+    std::string host = "127.0.0.1";
+    uint32_t port = 0;  // 0 = no TCP listener
+    std::string socket_path;
+    bool enabled() const { return port != 0 || !socket_path.empty(); }
+};
+
+struct ScriptOptions {
+    std::string path;        // Empty = no script mode
+    bool log_set = false;    // --log / FORGEDB_LOG given: overrides script mode's quiet
+    std::vector<std::string> restore;  // Full backup, then increments
+};
+
+static bool parse_log(const char* text, ScriptOptions& script) {
+    LogLevel level;
+    if (!parse_log_level(text, level)) return false;
+    set_log_level(level);
+    script.log_set = true;
+    return true;
+}
+
+// An empty port (no value, or "host:") is SERVER_PORT_DEFAULT
+static bool parse_listen(const std::string& text, ServerOptions& server) {
+    size_t colon = text.rfind(':');
+    std::string port = colon == std::string::npos ? text : text.substr(colon + 1);
+    if (colon != std::string::npos) server.host = text.substr(0, colon);
+    if (port.empty()) {
+        server.port = SERVER_PORT_DEFAULT;
+        return true;
+    }
+    char* end = nullptr;
+    unsigned long n = std::strtoul(port.c_str(), &end, 10);
+    if (*end != '\0' || n == 0 || n > 65535) return false;
+    server.port = n;
+    return true;
+}
+
+// Consumes leading option flags; returns the index of the first non-option argument.
+static int parse_options(int argc, char* argv[], PagerConfig& config, ServerOptions& server,
+                         ScriptOptions& script) {
+    if (const char* env = std::getenv("FORGEDB_POOL")) {
+        if (!parse_pool(env, config)) std::cerr << "WARNING: Ignoring FORGEDB_POOL=" << env << "\n";
+    }
+    if (const char* env = std::getenv("FORGEDB_PAGE_SIZE")) {
+        if (!parse_page_size(env, config)) std::cerr << "WARNING: Ignoring FORGEDB_PAGE_SIZE=" << env << "\n";
+    }
+    if (const char* env = std::getenv("FORGEDB_MMAP")) config.use_mmap = std::strcmp(env, "0") != 0;
+    if (const char* env = std::getenv("FORGEDB_READAHEAD")) {
+        if (!parse_count(env, config.readahead)) std::cerr << "WARNING: Ignoring FORGEDB_READAHEAD=" << env << "\n";
+    }
+    if (const char* env = std::getenv("FORGEDB_SCAN_THREADS")) {
+        if (!parse_count(env, config.scan_threads)) std::cerr << "WARNING: Ignoring FORGEDB_SCAN_THREADS=" << env << "\n";
+    }
+    if (const char* env = std::getenv("FORGEDB_VERIFY")) {
+        if (!parse_verify(env, config)) std::cerr << "WARNING: Ignoring FORGEDB_VERIFY=" << env << "\n";
+    }
+    if (const char* env = std::getenv("FORGEDB_LOG")) {
+        if (!parse_log(env, script)) std::cerr << "WARNING: Ignoring FORGEDB_LOG=" << env << "\n";
+    }
+    int i = 1;
+    for (; i < argc; i++) {
+        std::string flag = argv[i];
+        bool ok = true;
+        if (flag == "--mmap")                           config.use_mmap = true;
+        else if (flag == "--pool" && i + 1 < argc)           ok = parse_pool(argv[++i], config);
+        else if (flag == "--page-size" && i + 1 < argc) ok = parse_page_size(argv[++i], config);
+        else if (flag == "--readahead" && i + 1 < argc) ok = parse_count(argv[++i], config.readahead);
+        else if (flag == "--scan-threads" && i + 1 < argc) ok = parse_count(argv[++i], config.scan_threads);
+        else if (flag == "--verify" && i + 1 < argc)    ok = parse_verify(argv[++i], config);
+        else if (flag == "--listen")                    ok = parse_listen(i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "", server);
+        else if (flag == "--socket" && i + 1 < argc)    server.socket_path = argv[++i];
+        else if (flag == "--script" && i + 1 < argc)    script.path = argv[++i];
+        else if (flag == "--log" && i + 1 < argc)       ok = parse_log(argv[++i], script);
+        else if (flag == "--restore" && i + 1 < argc)   script.restore.push_back(argv[++i]);
+        else break;
+        if (!ok) {
+            std::cerr << "ERROR: Invalid value for " << flag << ": " << argv[i] << "\n"
+                      << "Usage: forgedb [--pool <frames|bytes K/M/G>] [--page-size <bytes>] [--mmap] [--readahead <n>]\n"
+                      << "               [--scan-threads <n>] [--verify always|first|background]\n"
+                      << "               [--log quiet|info|debug] [--restore <backup> [--restore <increment>]...]\n"
+                      << "               [--listen [[host:]port] | --socket <path> | --script <path|-> | command]\n";
+            std::exit(1);
         }
-    } else if (input == "exit") {
-        // Handled in main loop — break ensures Pager destructor flushes pages
-    } else {
-        std::cout << "Unrecognized command.\n";
     }
+    return i;
 }
 
 // ==========================================
 // MAIN DRIVER
 // ==========================================
 int main(int argc, char* argv[]) {
-    Pager pager("my_database.db");
+    PagerConfig config;
+    ServerOptions server_opts;
+    ScriptOptions script_opts;
+    int first_arg = parse_options(argc, argv, config, server_opts, script_opts);
+    if (!script_opts.restore.empty()) {
+        return restore_backup("my_database.db", script_opts.restore) ? 0 : 1;
+    }
+
+    Pager pager("my_database.db", config);
     BTree tree(pager);
 
-    // MODE 1: Script Mode (For Web Visualizer)
+    // MODE 0: Server Mode — one open database, many clients and commands
+    // Usage: ./forgedb --listen [7070]    ./forgedb --socket /tmp/forgedb.sock
+    if (server_opts.enabled()) {
+        Server server(tree, pager);
+        if (server_opts.port != 0 && !server.listen_tcp(server_opts.host, server_opts.port)) return 1;
+        if (!server_opts.socket_path.empty() && !server.listen_unix(server_opts.socket_path)) return 1;
+        server.run();
+        return 0;
+    }
+
+    // MODE 1: Batch Mode — replay a file of commands without per-line output
+    // Usage: ./forgedb --script load.txt      ./forgedb --script - < load.txt
+    if (!script_opts.path.empty()) {
+        std::ifstream file;
+        if (script_opts.path != "-") {
+            file.open(script_opts.path);
+            if (!file) {
+                std::cerr << "ERROR: Cannot open script " << script_opts.path << "\n";
+                return 1;
+            }
+        }
+        std::ios::sync_with_stdio(false);  // Lets getline on std::cin read ahead
+        std::istream& in = script_opts.path == "-" ? std::cin : file;
+        if (!script_opts.log_set) set_log_level(LOG_QUIET);
+
+        FdOutputStream out(STDOUT_FILENO, SCRIPT_OUTPUT_BUFFER);
+        OutputCapture capture(out);
+        std::string input;
+        while (std::getline(in, input) && input != "exit") {
+            if (!input.empty() && input.back() == '\r') input.pop_back();
+            if (!input.empty()) handle_command(input, tree, pager);
+        }
+        return 0;
+    }
+
+    // MODE 2: Script Mode (For Web Visualizer)
     // Usage: ./forgedb "insert 1 alice alice@example.com"
     //        ./forgedb .json
-    if (argc > 1) {
-        std::string command = argv[1];
-        for (int i = 2; i < argc; i++) {
+    if (first_arg < argc) {
+        std::string command = argv[first_arg];
+        for (int i = first_arg + 1; i < argc; i++) {
             command += " " + std::string(argv[i]);
         }
         handle_command(command, tree, pager);
         return 0;
     }
 
-    // MODE 2: Interactive Mode (CLI)
+    // MODE 3: Interactive Mode (CLI)
     std::cout << "ForgeDB v1.7 (Buffer Pool Edition)\n";
     std::string input;
     while (true) {
@@ -0,0 +1,179 @@
+#include "metrics.h"
+#include <cstdio>
+#include <string>
+
+// ==========================================
+// METRICS IMPLEMENTATION
+// ==========================================
+
+namespace {
+struct CounterInfo {
+    const char* name;  // Prometheus name, without the forgedb_ prefix
+    const char* help;
+};
+
+const CounterInfo COUNTERS[MET_COUNTER_COUNT] = {
+    {"leaf_splits_total",           "Leaf page splits"},
+    {"internal_splits_total",       "Internal page splits"},
+    {"leaf_merges_total",           "Leaf page merges"},
+    {"internal_merges_total",       "Internal page merges"},
+    {"leaf_borrows_total",          "Rows moved in from a leaf sibling on underflow"},
+    {"internal_borrows_total",      "Keys rotated in from an internal sibling on underflow"},
+    {"defragments_total",           "Leaf pages compacted in place"},
+    {"read_bytes_total",            "Bytes read from the database file and the WAL"},
+    {"written_bytes_total",         "Bytes written to the database file and the WAL"},
+    {"mapped_page_reads_total",     "Pages copied in from the file mapping"},
+    {"bloom_negatives_total",       "Keys the bloom filter ruled out"},
+    {"bloom_true_positives_total",  "Keys the bloom filter passed that were present"},
+    {"bloom_false_positives_total", "Keys the bloom filter passed that were absent"},
+};
+
+struct HistogramInfo {
+    const char* name;
+    const char* help;
+    bool seconds;  // Recorded in nanoseconds, exported in seconds
+};
+
+const HistogramInfo HISTOGRAMS[MET_HISTOGRAM_COUNT] = {
+    {"descent_seconds",    "Root-to-leaf descents, latch waits included", true},
+    {"descent_depth",      "Levels visited per root-to-leaf descent", false},
+    {"latch_wait_seconds", "Waits for a page latch held by another thread", true},
+    {"frame_wait_seconds", "Waits for a buffer pool frame while every frame is pinned", true},
+    {"drain_wait_seconds", "Writer waits for readers to release the tree", true},
+    {"crc_seconds",        "Page checksum computations and verifications", true},
+    {"sync_seconds",       "fsync / fdatasync calls", true},
+};
+
+#ifndef FORGEDB_NO_METRICS
+MetricShard shards[METRIC_SHARDS];
+std::atomic<uint32_t> next_shard{0};
+#endif
+
+// Upper bound of bucket b: 0, 1, 3, 7, ... (2^b - 1)
+uint64_t bucket_limit(uint32_t b) {
+    return (1ull << b) - 1;
+}
+
+std::string format_ns(uint64_t ns) {
+    char buf[32];
+    if (ns < 1000)             std::snprintf(buf, sizeof(buf), "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)     std::snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)  std::snprintf(buf, sizeof(buf), "%.1fms", ns / 1e6);
+    else                       std::snprintf(buf, sizeof(buf), "%.2fs", ns / 1e9);
+    return buf;
+}
+}  // namespace
+
+#ifndef FORGEDB_NO_METRICS
+// Threads take shards round-robin on first use
+MetricShard& metric_shard() {
+    thread_local MetricShard* shard = &shards[next_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS];
+    return *shard;
+}
+#endif
+
+bool metrics_enabled() {
+#ifndef FORGEDB_NO_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+MetricsSnapshot metrics_snapshot() {
+    MetricsSnapshot snap;
+#ifndef FORGEDB_NO_METRICS
+    for (const MetricShard& shard : shards) {
+        for (uint32_t c = 0; c < MET_COUNTER_COUNT; c++)
+            snap.counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+        for (uint32_t h = 0; h < MET_HISTOGRAM_COUNT; h++) {
+            MetricsSnapshot::Histogram& out = snap.histograms[h];
+            for (uint32_t b = 0; b < METRIC_BUCKETS; b++) {
+                uint64_t n = shard.histograms[h].buckets[b].load(std::memory_order_relaxed);
+                out.buckets[b] += n;
+                out.count += n;
+            }
+            out.sum += shard.histograms[h].sum.load(std::memory_order_relaxed);
+        }
+    }
+#endif
+    return snap;
+}
+
+uint64_t MetricsSnapshot::Histogram::quantile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * count);
+    if (rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < METRIC_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) return bucket_limit(b);
+    }
+    return bucket_limit(METRIC_BUCKETS - 1);
+}
+
+// Counters, then each histogram as count / mean / p50 / p99 / p999 (bucket
+// upper bounds, so within a factor of two)
+void print_metrics(std::ostream& out) {
+    out << "=== Metrics ===\n";
+    if (!metrics_enabled()) {
+        out << "Not built in (compiled with FORGEDB_NO_METRICS).\n";
+        return;
+    }
+    MetricsSnapshot snap = metrics_snapshot();
+    char line[160];
+    for (uint32_t c = 0; c < MET_COUNTER_COUNT; c++) {
+        std::snprintf(line, sizeof(line), "%-30s %llu\n", COUNTERS[c].name, (unsigned long long)snap.counters[c]);
+        out << line;
+    }
+    out << "--- Histograms (count, mean, p50 / p99 / p999) ---\n";
+    for (uint32_t h = 0; h < MET_HISTOGRAM_COUNT; h++) {
+        const MetricsSnapshot::Histogram& hist = snap.histograms[h];
+        double mean = hist.count ? (double)hist.sum / hist.count : 0;
+        auto fmt = [&](uint64_t v) { return HISTOGRAMS[h].seconds ? format_ns(v) : std::to_string(v); };
+        char mean_text[32];
+        if (HISTOGRAMS[h].seconds) std::snprintf(mean_text, sizeof(mean_text), "%s", format_ns((uint64_t)mean).c_str());
+        else std::snprintf(mean_text, sizeof(mean_text), "%.2f", mean);
+        std::snprintf(line, sizeof(line), "%-30s %llu, %s, %s / %s / %s\n", HISTOGRAMS[h].name,
+                      (unsigned long long)hist.count, mean_text, fmt(hist.quantile(0.5)).c_str(),
+                      fmt(hist.quantile(0.99)).c_str(), fmt(hist.quantile(0.999)).c_str());
+        out << line;
+    }
+}
+
+// Counters as counters, histograms as cumulative le buckets (empty trailing
+// buckets dropped; +Inf always present)
+void write_prometheus(std::ostream& out) {
+    out << "# HELP forgedb_metrics_enabled 1 if this build collects metrics\n"
+        << "# TYPE forgedb_metrics_enabled gauge\n"
+        << "forgedb_metrics_enabled " << (metrics_enabled() ? 1 : 0) << "\n";
+    if (!metrics_enabled()) return;
+    MetricsSnapshot snap = metrics_snapshot();
+    for (uint32_t c = 0; c < MET_COUNTER_COUNT; c++) {
+        out << "# HELP forgedb_" << COUNTERS[c].name << " " << COUNTERS[c].help << "\n"
+            << "# TYPE forgedb_" << COUNTERS[c].name << " counter\n"
+            << "forgedb_" << COUNTERS[c].name << " " << snap.counters[c] << "\n";
+    }
+    char value[32];
+    for (uint32_t h = 0; h < MET_HISTOGRAM_COUNT; h++) {
+        const HistogramInfo& info = HISTOGRAMS[h];
+        const MetricsSnapshot::Histogram& hist = snap.histograms[h];
+        auto scaled = [&](uint64_t v) {
+            if (info.seconds) std::snprintf(value, sizeof(value), "%.9g", v / 1e9);
+            else std::snprintf(value, sizeof(value), "%llu", (unsigned long long)v);
+            return value;
+        };
+        out << "# HELP forgedb_" << info.name << " " << info.help << "\n"
+            << "# TYPE forgedb_" << info.name << " histogram\n";
+        uint32_t last = METRIC_BUCKETS;
+        while (last > 0 && hist.buckets[last - 1] == 0) last--;
+        uint64_t cumulative = 0;
+        for (uint32_t b = 0; b < last; b++) {
+            cumulative += hist.buckets[b];
+            out << "forgedb_" << info.name << "_bucket{le=\"" << scaled(bucket_limit(b)) << "\"} " << cumulative << "\n";
+        }
+        out << "forgedb_" << info.name << "_bucket{le=\"+Inf\"} " << hist.count << "\n"
+            << "forgedb_" << info.name << "_sum " << scaled(hist.sum) << "\n"
+            << "forgedb_" << info.name << "_count " << hist.count << "\n";
+    }
+}
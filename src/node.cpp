@@ -1,5 +1,188 @@
 #include "node.h"
 #include "utils.h"
+#include "metrics.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// ==========================================
+// SEARCH KERNELS
+// ==========================================
+// Both node types search the same way: a branchless binary search narrows the
+// range to NODE_SEARCH_WINDOW keys, then a kernel counts the keys below the
+// target in one pass.  In a sorted range that count is the search result, so
+// the kernel need not keep lane order.  Internal keys are 1, 2, 4 or 8-byte
+// deltas with one kernel per width; leaf keys are 64-bit, 12 bytes apart.
+// Keys are unsigned: x86 compares 8 and 16-bit lanes through an unsigned
+// max (a ≤ t ⟺ max(a, t) = t), and 32 and 64-bit lanes signed, with both
+// sides biased by 2^31 / 2^63 first.
+
+template <typename T>
+static uint32_t count_le_scalar(const T* keys, uint32_t n, T key) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) count += keys[i] <= key;
+    return count;
+}
+
+static uint32_t count_lt_slots_scalar(const uint8_t* slots, uint32_t n, uint64_t key) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t k;
+        std::memcpy(&k, slots + i * SLOT_SIZE + SLOT_KEY, 8);
+        count += k < key;
+    }
+    return count;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static uint32_t count_le_avx2(const uint8_t* keys, uint32_t n, uint8_t key) {
+    __m256i target = _mm256_set1_epi8((char)key);
+    uint32_t count = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(keys + i));
+        __m256i le = _mm256_cmpeq_epi8(_mm256_max_epu8(v, target), target);
+        count += __builtin_popcount(_mm256_movemask_epi8(le));
+    }
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2")))
+static uint32_t count_le_avx2(const uint16_t* keys, uint32_t n, uint16_t key) {
+    __m256i target = _mm256_set1_epi16((short)key);
+    uint32_t count = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(keys + i));
+        __m256i le = _mm256_cmpeq_epi16(_mm256_max_epu16(v, target), target);
+        count += __builtin_popcount(_mm256_movemask_epi8(le)) / 2;  // Two mask bits per lane
+    }
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2")))
+static uint32_t count_le_avx2(const uint32_t* keys, uint32_t n, uint32_t key) {
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    __m256i target = _mm256_xor_si256(_mm256_set1_epi32((int)key), bias);
+    uint32_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), bias);
+        __m256i gt = _mm256_cmpgt_epi32(v, target);
+        count += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+    }
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2")))
+static uint32_t count_le_avx2(const uint64_t* keys, uint32_t n, uint64_t key) {
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    __m256i target = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), bias);
+    uint32_t count = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), bias);
+        __m256i gt = _mm256_cmpgt_epi64(v, target);
+        count += 4 - __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+    }
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+// Four 12-byte slots per gather of their keys
+__attribute__((target("avx2")))
+static uint32_t count_lt_slots_avx2(const uint8_t* slots, uint32_t n, uint64_t key) {
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    const __m128i stride = _mm_setr_epi32(0, SLOT_SIZE, 2 * SLOT_SIZE, 3 * SLOT_SIZE);
+    __m256i target = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), bias);
+    uint32_t count = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const long long* base = (const long long*)(slots + i * SLOT_SIZE + SLOT_KEY);
+        __m256i k = _mm256_xor_si256(_mm256_i32gather_epi64(base, stride, 1), bias);
+        __m256i lt = _mm256_cmpgt_epi64(target, k);
+        count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+    }
+    return count + count_lt_slots_scalar(slots + i * SLOT_SIZE, n - i, key);
+}
+#elif defined(__aarch64__)
+static uint32_t count_le_neon(const uint8_t* keys, uint32_t n, uint8_t key) {
+    uint8x16_t target = vdupq_n_u8(key);
+    uint32_t count = 0, i = 0;
+    for (; i + 16 <= n; i += 16)
+        count += vaddvq_u8(vshrq_n_u8(vcleq_u8(vld1q_u8(keys + i), target), 7));
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+static uint32_t count_le_neon(const uint16_t* keys, uint32_t n, uint16_t key) {
+    uint16x8_t target = vdupq_n_u16(key);
+    uint32_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8)
+        count += vaddvq_u16(vshrq_n_u16(vcleq_u16(vld1q_u16(keys + i), target), 15));
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+static uint32_t count_le_neon(const uint32_t* keys, uint32_t n, uint32_t key) {
+    uint32x4_t target = vdupq_n_u32(key);
+    uint32_t count = 0, i = 0;
+    for (; i + 4 <= n; i += 4)
+        count += vaddvq_u32(vshrq_n_u32(vcleq_u32(vld1q_u32(keys + i), target), 31));
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+static uint32_t count_le_neon(const uint64_t* keys, uint32_t n, uint64_t key) {
+    uint64x2_t target = vdupq_n_u64(key);
+    uint32_t count = 0, i = 0;
+    for (; i + 2 <= n; i += 2)
+        count += vaddvq_u64(vshrq_n_u64(vcleq_u64(vld1q_u64(keys + i), target), 63));
+    return count + count_le_scalar(keys + i, n - i, key);
+}
+
+// Two slots' keys per vector
+static uint32_t count_lt_slots_neon(const uint8_t* slots, uint32_t n, uint64_t key) {
+    uint64x2_t target = vdupq_n_u64(key);
+    uint32_t count = 0, i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const uint8_t* p = slots + i * SLOT_SIZE + SLOT_KEY;
+        uint64x2_t k = vcombine_u64(vld1_u64((const uint64_t*)p), vld1_u64((const uint64_t*)(p + SLOT_SIZE)));
+        count += vaddvq_u64(vshrq_n_u64(vcltq_u64(k, target), 63));
+    }
+    return count + count_lt_slots_scalar(slots + i * SLOT_SIZE, n - i, key);
+}
+#endif
+
+template <typename T>
+static uint32_t count_le(const T* keys, uint32_t n, T key) {
+#if defined(__x86_64__)
+    if (cpu_has_avx2()) return count_le_avx2(keys, n, key);
+#elif defined(__aarch64__)
+    return count_le_neon(keys, n, key);
+#endif
+    return count_le_scalar(keys, n, key);
+}
+
+static uint32_t count_lt_slots(const uint8_t* slots, uint32_t n, uint64_t key) {
+#if defined(__x86_64__)
+    if (cpu_has_avx2()) return count_lt_slots_avx2(slots, n, key);
+#elif defined(__aarch64__)
+    return count_lt_slots_neon(slots, n, key);
+#endif
+    return count_lt_slots_scalar(slots, n, key);
+}
+
+// Keys ≤ key in a sorted array of deltas
+template <typename T>
+static uint32_t upper_bound_in(const T* keys, uint32_t n, T key) {
+    uint32_t lo = 0;
+    while (n > NODE_SEARCH_WINDOW) {
+        uint32_t half = n / 2;
+        bool le = keys[lo + half] <= key;
+        lo = le ? lo + half + 1 : lo;
+        n = le ? n - half - 1 : half;
+    }
+    return lo + count_le(keys + lo, n, key);
+}
 
 // ==========================================
 // LEAF NODE IMPLEMENTATION
@@ -14,14 +197,28 @@ void LeafNode::initialize() {
     set_next_leaf(0);
 }
 
-uint32_t LeafNode::get_key(uint32_t i) const {
-    uint32_t key;
-    std::memcpy(&key, record_ptr(i), 4);
-    return key;
+Row LeafNode::get_row(uint32_t i) const {
+    return deserialize_row(get_key(i), record_ptr(i));
 }
 
-Row LeafNode::get_row(uint32_t i) const {
-    return deserialize_row(record_ptr(i));
+RowView LeafNode::view(uint32_t i) const {
+    return view_row(get_key(i), record_ptr(i));
+}
+
+uint32_t LeafNode::lower_bound(uint64_t key, uint32_t from) const {
+    uint32_t lo = from, n = get_num_cells() - from;
+    while (n > NODE_SEARCH_WINDOW) {
+        uint32_t half = n / 2;
+        bool below = get_key(lo + half) < key;
+        lo = below ? lo + half + 1 : lo;
+        n = below ? n - half - 1 : half;
+    }
+    return lo + count_lt_slots(slot_ptr(lo), n, key);
+}
+
+bool LeafNode::find(uint64_t key, uint32_t& idx) const {
+    idx = lower_bound(key);
+    return idx < get_num_cells() && get_key(idx) == key;
 }
 
 bool LeafNode::can_fit(uint16_t record_size) const {
@@ -40,36 +237,91 @@ bool LeafNode::leaf_underflow() const {
     return used < LEAF_USABLE_SPACE / 2;
 }
 
-// Compact records towards end of page, eliminating holes
+// Exact post-removal check (uses the record's own length), so a deleting
+// writer can release every ancestor latch above a leaf that stays full enough.
+bool LeafNode::safe_to_remove(uint64_t key) const {
+    uint32_t idx;
+    if (!find(key, idx)) return true;  // Key absent: nothing is removed
+    if (get_num_cells() - 1 < LEAF_MIN_CELLS) return false;
+    uint16_t used = LEAF_USABLE_SPACE - get_total_free() - slot_length(idx) - SLOT_SIZE;
+    return used >= LEAF_USABLE_SPACE / 2;
+}
+
+// Compact records towards the end of the page, in place.  Visiting records
+// from the highest offset down, each one slides up into the space above it and
+// never overwrites a record not yet moved.  Slot order usually is offset order
+// (appends, splits, merges); only otherwise are the slots sorted first.
 void LeafNode::defragment() {
+    METRIC_INC(MET_DEFRAGMENTS);
     uint32_t n = get_num_cells();
-    if (n == 0) return;
-    uint8_t tmp[PAGE_SIZE];
     uint16_t new_end = PAGE_SIZE;
-    for (uint32_t i = 0; i < n; i++) {
-        uint16_t len = slot_length(i);
-        new_end -= len;
-        std::memcpy(tmp + new_end, record_ptr(i), len);
-        set_slot_offset(i, new_end);
+    bool ordered = true;
+    for (uint32_t i = 1; i < n && ordered; i++) ordered = slot_offset(i) < slot_offset(i - 1);
+
+    if (ordered) {
+        for (uint32_t i = 0; i < n; i++) {
+            uint16_t len = slot_length(i);
+            new_end -= len;
+            if (new_end != slot_offset(i)) std::memmove((char*)data + new_end, record_ptr(i), len);
+            set_slot_offset(i, new_end);
+        }
+    } else {
+        static thread_local std::vector<uint32_t> order;  // offset << 16 | slot
+        order.resize(n);
+        for (uint32_t i = 0; i < n; i++) order[i] = (uint32_t)slot_offset(i) << 16 | i;
+        std::sort(order.begin(), order.end(), std::greater<uint32_t>());
+        for (uint32_t entry : order) {
+            uint32_t i = entry & 0xFFFF;
+            uint16_t len = slot_length(i);
+            new_end -= len;
+            if (new_end != slot_offset(i)) std::memmove((char*)data + new_end, record_ptr(i), len);
+            set_slot_offset(i, new_end);
+        }
     }
-    std::memcpy((char*)data + new_end, tmp + new_end, PAGE_SIZE - new_end);
     set_data_end(new_end);
 }
 
-// Insert in sorted position (binary search)
-void LeafNode::insert(uint32_t key, const Row& row) {
+// Slots [from, from + count) become dst's slots [at, at + count).  Each slot
+// directory is shifted once and each record copied once, straight into dst's
+// free gap; dst is compacted first only if that gap is too small.  The holes
+// left on this page are reclaimed lazily, by defragment().
+void LeafNode::move_slots(uint32_t from, uint32_t count, LeafNode& dst, uint32_t at) {
     uint32_t n = get_num_cells();
+    uint32_t dn = dst.get_num_cells();
+    uint32_t bytes = 0;
+    for (uint32_t i = from; i < from + count; i++) bytes += slot_length(i);
+    uint32_t needed = bytes + count * SLOT_SIZE;
+    if (dst.contiguous_free() < needed) dst.defragment();
+
+    std::memmove(dst.slot_ptr(at + count), dst.slot_ptr(at), (dn - at) * SLOT_SIZE);
+    std::memcpy(dst.slot_ptr(at), slot_ptr(from), count * SLOT_SIZE);
+    uint16_t end = dst.get_data_end();
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t len = slot_length(from + i);
+        end -= len;
+        std::memcpy((char*)dst.data + end, record_ptr(from + i), len);
+        dst.set_slot_offset(at + i, end);
+    }
+    dst.set_data_end(end);
+    dst.set_num_cells(dn + count);
+    dst.set_total_free(dst.get_total_free() - needed);
+
+    std::memmove(slot_ptr(from), slot_ptr(from + count), (n - from - count) * SLOT_SIZE);
+    set_num_cells(n - count);
+    set_total_free(get_total_free() + needed);
+    if (n == count) set_data_end((uint16_t)PAGE_SIZE);  // Nothing left: the whole gap is free
+}
+
+// Insert in sorted position
+void LeafNode::insert(uint64_t key, const Row& row) {
     uint8_t buf[512];
     uint16_t rec_size = serialize_row(row, buf);
+    insert_record(key, buf, rec_size);
+}
 
-    // Binary search for sorted insert position (upper_bound)
-    uint32_t lo = 0, hi = n;
-    while (lo < hi) {
-        uint32_t mid = (lo + hi) / 2;
-        if (get_key(mid) < key) lo = mid + 1;
-        else hi = mid;
-    }
-    uint32_t idx = lo;
+void LeafNode::insert_record(uint64_t key, const uint8_t* rec, uint16_t rec_size) {
+    uint32_t n = get_num_cells();
+    uint32_t idx = lower_bound(key);
 
     // Ensure contiguous space (defrag if needed)
     if (contiguous_free() < rec_size + SLOT_SIZE) {
@@ -78,145 +330,374 @@ void LeafNode::insert(uint32_t key, const Row& row) {
 
     // Write record at data_end - rec_size
     uint16_t new_end = get_data_end() - rec_size;
-    std::memcpy((char*)data + new_end, buf, rec_size);
+    std::memcpy((char*)data + new_end, rec, rec_size);
     set_data_end(new_end);
 
     // Shift slot entries right to open slot at idx
-    for (uint32_t i = n; i > idx; i--) {
-        set_slot_offset(i, slot_offset(i - 1));
-        set_slot_length(i, slot_length(i - 1));
-    }
+    std::memmove(slot_ptr(idx + 1), slot_ptr(idx), (n - idx) * SLOT_SIZE);
 
     // Write new slot
     set_slot_offset(idx, new_end);
     set_slot_length(idx, rec_size);
+    set_slot_key(idx, key);
+
+    set_num_cells(n + 1);
+    set_total_free(get_total_free() - rec_size - SLOT_SIZE);
+}
+
+// Append after the last slot — no search, no slot shifting (bulk load path)
+void LeafNode::append(const Row& row) {
+    uint32_t n = get_num_cells();
+    uint16_t rec_size = serialized_row_size(row);
+    uint16_t new_end = get_data_end() - rec_size;
+    serialize_row(row, (uint8_t*)data + new_end);
+    set_data_end(new_end);
+
+    set_slot_offset(n, new_end);
+    set_slot_length(n, rec_size);
+    set_slot_key(n, row.id);
 
     set_num_cells(n + 1);
     set_total_free(get_total_free() - rec_size - SLOT_SIZE);
 }
 
+void LeafNode::append_record(uint64_t key, const uint8_t* rec, uint16_t len) {
+    uint32_t n = get_num_cells();
+    uint16_t new_end = get_data_end() - len;
+    std::memcpy((char*)data + new_end, rec, len);
+    set_data_end(new_end);
+
+    set_slot_offset(n, new_end);
+    set_slot_length(n, len);
+    set_slot_key(n, key);
+
+    set_num_cells(n + 1);
+    set_total_free(get_total_free() - len - SLOT_SIZE);
+}
+
 // Remove by slot index
 void LeafNode::remove_at(uint32_t idx) {
     uint32_t n = get_num_cells();
     uint16_t freed = slot_length(idx);
 
     // Shift slot entries left
-    for (uint32_t i = idx; i < n - 1; i++) {
-        set_slot_offset(i, slot_offset(i + 1));
-        set_slot_length(i, slot_length(i + 1));
-    }
+    std::memmove(slot_ptr(idx), slot_ptr(idx + 1), (n - 1 - idx) * SLOT_SIZE);
 
     set_num_cells(n - 1);
     set_total_free(get_total_free() + freed + SLOT_SIZE);
     // Record data stays as a hole until defragment()
 }
 
-// Remove by key (binary search)
-bool LeafNode::remove(uint32_t key) {
-    uint32_t n = get_num_cells();
-    uint32_t lo = 0, hi = n;
-    while (lo < hi) {
-        uint32_t mid = (lo + hi) / 2;
-        uint32_t mk = get_key(mid);
-        if (mk < key) lo = mid + 1;
-        else if (mk > key) hi = mid;
-        else { remove_at(mid); return true; }
-    }
-    return false;
+// Remove by key
+bool LeafNode::remove(uint64_t key) {
+    uint32_t idx;
+    if (!find(key, idx)) return false;
+    remove_at(idx);
+    return true;
 }
 
 // ==========================================
 // INTERNAL NODE IMPLEMENTATION
 // ==========================================
 
+static uint64_t max_delta(uint32_t width) {
+    return width >= 8 ? UINT64_MAX : (1ull << (8 * width)) - 1;
+}
+
 void InternalNode::initialize() {
     set_type(NODE_INTERNAL);
     set_num_keys(0);
     set_root(false);
+    set_coding(0, 1);
+}
+
+uint32_t InternalNode::width_for(uint64_t lo, uint64_t hi) {
+    uint64_t span = hi - lo;
+    return span <= UINT8_MAX ? 1 : span <= UINT16_MAX ? 2 : span <= UINT32_MAX ? 4 : 8;
+}
+
+bool InternalNode::fits(uint32_t count, uint64_t lo, uint64_t hi) {
+    return count <= internal_capacity(width_for(lo, hi));
+}
+
+void InternalNode::set_coding(uint64_t base, uint32_t width) {
+    *((uint8_t*)((char*)data + OFFSET_INTERNAL_KEY_WIDTH)) = (uint8_t)width;
+    *((uint64_t*)((char*)data + OFFSET_INTERNAL_BASE)) = base;
+}
+
+uint64_t InternalNode::delta_at(uint32_t index) const {
+    const uint8_t* keys = key_bytes();
+    switch (key_width()) {
+        case 1:  return keys[index];
+        case 2:  return ((const uint16_t*)keys)[index];
+        case 4:  return ((const uint32_t*)keys)[index];
+        default: return ((const uint64_t*)keys)[index];
+    }
 }
 
-uint32_t InternalNode::get_child(uint32_t index) {
+void InternalNode::set_delta_at(uint32_t index, uint64_t delta) {
+    uint8_t* keys = key_bytes();
+    switch (key_width()) {
+        case 1:  keys[index] = (uint8_t)delta; break;
+        case 2:  ((uint16_t*)keys)[index] = (uint16_t)delta; break;
+        case 4:  ((uint32_t*)keys)[index] = (uint32_t)delta; break;
+        default: ((uint64_t*)keys)[index] = delta; break;
+    }
+}
+
+bool InternalNode::covers(uint64_t key) const {
+    return key >= key_base() && key - key_base() <= max_delta(key_width());
+}
+
+uint32_t InternalNode::get_child(uint32_t index) const {
     if (index == get_num_keys()) return get_right_child();
-    return *get_cell(index);
+    return child_at(index);
 }
 
 void InternalNode::set_child(uint32_t index, uint32_t child_page) {
     if (index == get_num_keys()) {
         set_right_child(child_page);
     } else {
-        *get_cell(index) = child_page;
+        set_child_at(index, child_page);
+    }
+}
+
+uint64_t InternalNode::get_key(uint32_t index) const {
+    return key_base() + delta_at(index);
+}
+
+void InternalNode::set_key(uint32_t index, uint64_t key) {
+    if (covers(key)) {
+        set_delta_at(index, key - key_base());
+        return;
+    }
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> children;
+    read_all(keys, children);
+    keys[index] = key;
+    assign(keys.data(), children.data(), keys.size());
+}
+
+void InternalNode::assign(const uint64_t* keys, const uint32_t* children, uint32_t num_keys) {
+    uint64_t base = num_keys ? keys[0] : 0;
+    set_coding(base, num_keys ? width_for(base, keys[num_keys - 1]) : 1);
+    for (uint32_t i = 0; i < num_keys; i++) {
+        set_delta_at(i, keys[i] - base);
+        set_child_at(i, children[i]);
+    }
+    set_num_keys(num_keys);
+    set_right_child(children[num_keys]);
+}
+
+void InternalNode::read_all(std::vector<uint64_t>& keys, std::vector<uint32_t>& children) const {
+    uint32_t n = get_num_keys();
+    keys.resize(n);
+    children.resize(n + 1);
+    for (uint32_t i = 0; i < n; i++) {
+        keys[i] = get_key(i);
+        children[i] = child_at(i);
     }
+    children[n] = get_right_child();
 }
 
-uint32_t InternalNode::get_key(uint32_t index) {
-    return *(get_cell(index) + 1);
+bool InternalNode::can_insert(uint64_t key) const {
+    uint32_t n = get_num_keys();
+    if (n == 0) return true;
+    return fits(n + 1, std::min(key, get_key(0)), std::max(key, get_key(n - 1)));
 }
 
-void InternalNode::set_key(uint32_t index, uint32_t key) {
-    *(get_cell(index) + 1) = key;
+// Separators keep their order, so only the first and last can move the range
+bool InternalNode::can_set_key(uint32_t index, uint64_t key) const {
+    uint32_t n = get_num_keys();
+    return fits(n, index == 0 ? key : get_key(0), index == n - 1 ? key : get_key(n - 1));
 }
 
-// Returns the child page where 'key' belongs  (binary search — O(log N))
-uint32_t InternalNode::find_child(uint32_t key) {
-    uint32_t lo = 0, hi = get_num_keys();
-    while (lo < hi) {
-        uint32_t mid = (lo + hi) / 2;
-        if (get_key(mid) <= key) lo = mid + 1;
-        else hi = mid;
+// Returns the child page where 'key' belongs
+uint32_t InternalNode::find_child(uint64_t key) const {
+    return get_child(child_index_for(key));  // num_keys → right_child via get_child()
+}
+
+// Child i holds keys in [key(i-1), key(i)); the last index is the right child.
+// A key below the base precedes every key; one beyond the widest delta
+// follows them all.  Otherwise the search runs on the deltas themselves.
+uint32_t InternalNode::child_index_for(uint64_t key) const {
+    uint32_t n = get_num_keys();
+    if (n == 0 || key < key_base()) return 0;
+    uint64_t d = key - key_base();
+    if (d > max_delta(key_width())) return n;
+    switch (key_width()) {
+        case 1:  return upper_bound_in(key_bytes(), n, (uint8_t)d);
+        case 2:  return upper_bound_in((const uint16_t*)key_bytes(), n, (uint16_t)d);
+        case 4:  return upper_bound_in((const uint32_t*)key_bytes(), n, (uint32_t)d);
+        default: return upper_bound_in((const uint64_t*)key_bytes(), n, d);
     }
-    return get_child(lo);  // lo == num_keys → right_child via get_child()
 }
 
-// Correct B+Tree Internal Node Insertion
-void InternalNode::insert_child(uint32_t index, uint32_t key, uint32_t new_child_page) {
+// Correct B+Tree Internal Node Insertion.  A key the coding cannot hold (or
+// no room left at the current width) re-codes the node; the caller has
+// checked can_insert().
+void InternalNode::insert_child(uint32_t index, uint64_t key, uint32_t new_child_page) {
     uint32_t num = get_num_keys();
+    if (!covers(key) || num + 1 > capacity()) {
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> children;
+        read_all(keys, children);
+        keys.insert(keys.begin() + index, key);
+        children.insert(children.begin() + index + 1, new_child_page);
+        assign(keys.data(), children.data(), keys.size());
+        return;
+    }
 
     // 1. Updating Right-Most Child (Simpler case)
     if (index == num) {
-        *get_cell(num) = get_right_child();
-        set_key(num, key);
+        set_child_at(num, get_right_child());
+        set_delta_at(num, key - key_base());
         set_right_child(new_child_page);
     }
     // 2. Middle Insertion
     else {
-        // Move Right Child to end cell
-        *get_cell(num) = get_right_child();
-        set_key(num, get_key(num - 1));
-
-        // Shift everything right to make space at index+1
-        for (uint32_t i = num - 1; i > index + 1; i--) {
-            std::memcpy(get_cell(i), get_cell(i - 1), INTERNAL_CELL_SIZE);
-        }
-
         // Logic:
         // Parent: ... [Child_i] [Key_Old] [Child_i+1] ...
         // Split Child_i -> Left, Key_New, Right.
         // Result: ... [Child_i(Left)] [Key_New] [Child_New(Right)] [Key_Old] [Child_i+1] ...
-        uint32_t key_old = get_key(index);
-        set_key(index, key);
+        // Keys shift right from index, children from index + 1; right_child is unchanged
+        uint32_t w = key_width();
+        std::memmove(key_bytes() + (index + 1) * w, key_bytes() + index * w, (num - index) * w);
+        std::memmove(child_array() + index + 2, child_array() + index + 1,
+                     (num - index - 1) * INTERNAL_CHILD_SIZE);
+        set_delta_at(index, key - key_base());
+        set_child_at(index + 1, new_child_page);
+    }
+    set_num_keys(num + 1);
+}
 
-        *get_cell(index + 1) = new_child_page;
-        set_key(index + 1, key_old);
+void InternalNode::push_front(uint32_t child_page, uint64_t key) {
+    uint32_t num = get_num_keys();
+    if (!covers(key) || num + 1 > capacity()) {
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> children;
+        read_all(keys, children);
+        keys.insert(keys.begin(), key);
+        children.insert(children.begin(), child_page);
+        assign(keys.data(), children.data(), keys.size());
+        return;
     }
+    uint32_t w = key_width();
+    std::memmove(key_bytes() + w, key_bytes(), num * w);
+    std::memmove(child_array() + 1, child_array(), num * INTERNAL_CHILD_SIZE);
+    set_delta_at(0, key - key_base());
+    set_child_at(0, child_page);
     set_num_keys(num + 1);
 }
 
 // Remove key at key_index and the child to its RIGHT (used after a merge).
+// Fewer keys never need a wider coding, so the node is not re-coded.
 void InternalNode::remove_key(uint32_t key_index) {
     uint32_t num = get_num_keys();
 
     if (key_index == num - 1) {
         // Removing last key: left child becomes the new right_child
-        set_right_child(*get_cell(key_index));
+        set_right_child(child_at(key_index));
         set_num_keys(num - 1);
         return;
     }
 
-    // General: save the left child (merged node), shift cells left, restore it
-    uint32_t merged_child = *get_cell(key_index);
-    for (uint32_t i = key_index; i < num - 1; i++) {
-        std::memcpy(get_cell(i), get_cell(i + 1), INTERNAL_CELL_SIZE);
-    }
-    *get_cell(key_index) = merged_child;
+    // General: keys shift left onto key_index, children onto key_index + 1
+    // (the left child, the merged node, stays)
+    uint32_t w = key_width();
+    std::memmove(key_bytes() + key_index * w, key_bytes() + (key_index + 1) * w,
+                 (num - key_index - 1) * w);
+    std::memmove(child_array() + key_index + 1, child_array() + key_index + 2,
+                 (num - key_index - 2) * INTERNAL_CHILD_SIZE);
     set_num_keys(num - 1);
 }
+
+void InternalNode::remove_first() {
+    uint32_t num = get_num_keys();
+    uint32_t w = key_width();
+    std::memmove(key_bytes(), key_bytes() + w, (num - 1) * w);
+    std::memmove(child_array(), child_array() + 1, (num - 1) * INTERNAL_CHILD_SIZE);
+    set_num_keys(num - 1);
+}
+
+// ==========================================
+// FORMAT UPGRADE
+// ==========================================
+// Format 6 node layout: leaf slots [offset:2][length:2][key:4]; internal
+// header of 16 bytes, then keys[] and children[] of u32, each array sized for
+// (page size - 16) / 8 cells.  Leaf headers and the internal num_keys /
+// right_child fields sit where they still do.
+static const uint32_t V6_SLOT_SIZE = 8;
+static const uint32_t V6_INTERNAL_HEADER_SIZE = 16;
+
+static uint32_t v6_internal_max_cells() { return (PAGE_SIZE - V6_INTERNAL_HEADER_SIZE) / 8; }
+
+static uint32_t load_u32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+static void store_u32(uint8_t* p, uint32_t v) { std::memcpy(p, &v, 4); }
+
+uint32_t NarrowNode::num_keys() const { return load_u32(data + OFFSET_INTERNAL_NUM_KEYS); }
+
+uint32_t NarrowNode::child(uint32_t index) const {
+    if (index == num_keys()) return load_u32(data + OFFSET_INTERNAL_RIGHT_CHILD);
+    return load_u32(data + V6_INTERNAL_HEADER_SIZE + (v6_internal_max_cells() + index) * 4);
+}
+
+uint32_t NarrowNode::next_leaf() const { return load_u32(data + OFFSET_LEAF_NEXT); }
+
+uint32_t NarrowNode::key(uint32_t index) const {
+    if (type() == NODE_INTERNAL) return load_u32(data + V6_INTERNAL_HEADER_SIZE + index * 4);
+    return load_u32(data + LEAF_HEADER_SIZE + index * V6_SLOT_SIZE + 4);
+}
+
+const uint8_t* NarrowNode::record(uint32_t index, uint16_t& len) const {
+    const uint8_t* slot = data + LEAF_HEADER_SIZE + index * V6_SLOT_SIZE;
+    uint16_t off;
+    std::memcpy(&off, slot, 2);
+    std::memcpy(&len, slot + 2, 2);
+    return data + off;
+}
+
+// Format 3 node layout: 14-byte internal header followed by [child:4][key:4]
+// cells; 4-byte leaf slots [offset:2][length:2] over [id:4][row] records.
+static const uint32_t V3_INTERNAL_HEADER_SIZE = 14;
+static const uint32_t V3_SLOT_SIZE = 4;
+
+void upgrade_node_layout(void* page) {
+    uint8_t old[PAGE_SIZE_MAX];
+    std::memcpy(old, page, PAGE_SIZE);
+    uint8_t* p = (uint8_t*)page;
+    uint8_t type = old[OFFSET_TYPE];
+    if (type != NODE_INTERNAL && type != NODE_LEAF) return;
+
+    // Both types keep their count and right child / next leaf field in place
+    std::memset(p + HEADER_SIZE, 0, PAGE_SIZE - HEADER_SIZE);
+    uint32_t num = load_u32(old + HEADER_SIZE);
+    store_u32(p + HEADER_SIZE, num);
+    if (type == NODE_INTERNAL) {
+        uint32_t max_cells = v6_internal_max_cells();
+        store_u32(p + OFFSET_INTERNAL_RIGHT_CHILD, load_u32(old + OFFSET_INTERNAL_RIGHT_CHILD));
+        for (uint32_t i = 0; i < num; i++) {
+            const uint8_t* cell = old + V3_INTERNAL_HEADER_SIZE + i * 8;
+            store_u32(p + V6_INTERNAL_HEADER_SIZE + (max_cells + i) * 4, load_u32(cell));
+            store_u32(p + V6_INTERNAL_HEADER_SIZE + i * 4, load_u32(cell + 4));
+        }
+    } else {
+        store_u32(p + OFFSET_LEAF_NEXT, load_u32(old + OFFSET_LEAF_NEXT));
+        uint16_t end = PAGE_SIZE;
+        for (uint32_t i = 0; i < num; i++) {
+            uint16_t off, len;
+            std::memcpy(&off, old + LEAF_HEADER_SIZE + i * V3_SLOT_SIZE, 2);
+            std::memcpy(&len, old + LEAF_HEADER_SIZE + i * V3_SLOT_SIZE + 2, 2);
+            uint16_t rec = len - 4;  // The id moves into the slot
+            end -= rec;
+            std::memcpy(p + end, old + off + 4, rec);
+            uint8_t* slot = p + LEAF_HEADER_SIZE + i * V6_SLOT_SIZE;
+            std::memcpy(slot, &end, 2);
+            std::memcpy(slot + 2, &rec, 2);
+            std::memcpy(slot + 4, old + off, 4);
+        }
+        uint16_t free_bytes = end - LEAF_HEADER_SIZE - num * V6_SLOT_SIZE;
+        std::memcpy(p + OFFSET_LEAF_DATA_END, &end, 2);
+        std::memcpy(p + OFFSET_LEAF_TOTAL_FREE, &free_bytes, 2);
+    }
+}
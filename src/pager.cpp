@@ -1,25 +1,124 @@
 #include "pager.h"
 #include "utils.h"
+#include "node.h"
+#include "metrics.h"
 #include <iostream>
 #include <cstdlib>
+#include <cstddef>
 #include <cstdio>
+#include <algorithm>
+#include <unordered_set>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 // ==========================================
 // PAGER IMPLEMENTATION
 // ==========================================
 
-Pager::Pager(std::string filename) {
+static bool has_checksum(uint32_t page_num, const void* data) {
+    uint8_t page_type = *((const uint8_t*)data);
+    return page_num > HEADER_PAGE &&
+           (page_type == NODE_LEAF || page_type == NODE_INTERNAL || page_type == NODE_BLOOM ||
+            page_type == NODE_FSM);
+}
+
+void stamp_checksum(uint32_t page_num, void* data, uint32_t algo) {
+    if (has_checksum(page_num, data)) {
+        METRIC_TIMER(HIST_CRC_NS);
+        uint32_t* crc_field = (uint32_t*)((char*)data + OFFSET_CHECKSUM);
+        *crc_field = 0;
+        *crc_field = checksum_compute(algo, (uint8_t*)data, PAGE_SIZE);
+    }
+}
+
+bool verify_checksum(uint32_t page_num, void* data, uint32_t algo) {
+    if (!has_checksum(page_num, data)) return true;
+    uint32_t stored;
+    std::memcpy(&stored, (char*)data + OFFSET_CHECKSUM, 4);
+    if (stored == 0) return true;
+    uint32_t* crc_field = (uint32_t*)((char*)data + OFFSET_CHECKSUM);
+    uint32_t computed;
+    {
+        METRIC_TIMER(HIST_CRC_NS);
+        *crc_field = 0;
+        computed = checksum_compute(algo, (uint8_t*)data, PAGE_SIZE);
+        *crc_field = stored;
+    }
+    if (stored == computed) return true;
+    std::cerr << "WARNING: " << (algo == CHECKSUM_CRC32C ? "CRC32C" : "CRC32")
+              << " mismatch on Page " << page_num
+              << " (stored=0x" << std::hex << stored
+              << " computed=0x" << computed << std::dec << ")\n";
+    return false;
+}
+
+Pager::Pager(std::string filename, const PagerConfig& config) {
     // Open / Create file
-    std::ifstream check(filename);
-    if (!check.good()) {
-        std::ofstream create(filename);
-        create.close();
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: Cannot open database file " << filename << ".\n";
+        std::exit(1);
+    }
+    struct stat st;
+    ::fstat(fd, &st);
+    file_length = st.st_size;
+
+    // Page size: from the header of an existing file, else from the config
+    uint32_t page_size = config.page_size;
+    uint64_t file_lsn = 0;
+    if (file_length >= sizeof(DbHeader)) {
+        DbHeader on_disk;
+        pread_full(fd, &on_disk, sizeof(DbHeader), 0);
+        if (on_disk.magic == DB_MAGIC || on_disk.magic == DB_MAGIC_V1) page_size = on_disk.page_size;
+        file_lsn = on_disk.commit_lsn;
+    }
+    if (!valid_page_size(page_size)) {
+        std::cerr << "ERROR: Unsupported page size " << page_size << " (power of two, "
+                  << PAGE_SIZE_MIN << ".." << PAGE_SIZE_MAX << ").\n";
+        std::exit(1);
+    }
+    set_page_size(page_size);
+
+    // Buffer pool: one aligned arena, page table at ≥ 2× frames (load ≤ 50%)
+    uint64_t pool_frames = config.pool_bytes ? config.pool_bytes / PAGE_SIZE : config.pool_frames;
+    uint32_t pool_size = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(pool_frames, BUFFER_POOL_MIN),
+                                                      UINT32_MAX / 2);
+    arena = (uint8_t*)std::aligned_alloc(PAGE_SIZE, (size_t)pool_size * PAGE_SIZE);
+    if (!arena) {
+        std::cerr << "ERROR: Cannot allocate a " << pool_size << "-frame buffer pool.\n";
+        std::exit(1);
+    }
+    frames.resize(pool_size);
+    latches.reset(new std::shared_mutex[pool_size]);
+    free_frames.reserve(pool_size);
+    for (uint32_t i = pool_size; i > 0; i--) free_frames.push_back(i - 1);
+    uint32_t table_bits = 1;
+    while ((1ull << table_bits) < (uint64_t)pool_size * 2) table_bits++;
+    page_table.assign(1ull << table_bits, INVALID_FRAME);
+    table_shift = 32 - table_bits;
+    a1_target = std::max(1u, pool_size / 4);
+
+    // Recovery: replay committed frames left by a previous run
+    changes_path = filename + "-changes";
+    bool tracked = file_length > 0 && load_changes(file_lsn);
+    wal.open(filename + "-wal");
+    std::vector<uint32_t> recovered;
+    if (wal.num_frames() > 0) {
+        std::cerr << "Recovering " << wal.num_frames() << " committed frame(s) from "
+                  << filename << "-wal.\n";
+        for (auto& [pg, offset] : wal.checkpoint_list()) recovered.push_back(pg);
+        write_back_wal();
     }
-    check.close();
 
-    file_stream.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-    file_stream.seekp(0, std::ios::end);
-    file_length = file_stream.tellp();
+    use_mmap = config.use_mmap;
+    remap();
+    readahead = config.readahead;
+    if (readahead > 0 && !use_mmap) reader.start(fd, readahead * 2, config.io_threads);
+    scan_threads = config.scan_threads ? config.scan_threads : std::thread::hardware_concurrency();
+    scan_threads = std::max(1u, std::min(scan_threads, pool_size / 8));
 
     if (file_length == 0) {
         // --- New database: initialize header at page 0 ---
@@ -28,236 +127,1139 @@ Pager::Pager(std::string filename) {
         header.total_pages = 1;  // Only the header page itself
         header.free_pages = 0;
         header.first_free_page = 0;
+        header.format_version = DB_FORMAT_VERSION;
+        header.flags = DB_FLAG_BLOOM_VALID;  // Empty tree, empty filter
+        header.row_count = 0;
+        header.bloom_stale = 0;
+        header.bloom_first_page = 0;  // Created by the BTree
+        header.bloom_pages = 0;
+        header.bloom_capacity = 0;
+        header.checksum_algo = CHECKSUM_CRC32C;
+        header.fsm_first_page = 0;  // Written by the first commit
+        header.fsm_pages = 0;
+        std::memset(header.index_roots, 0, sizeof(header.index_roots));
+        header.commit_lsn = 0;
+        header.backup_lsn = 0;
         write_header();
     } else {
         // --- Existing database: read & validate header ---
         void* page0 = get_page(HEADER_PAGE);
         std::memcpy(&header, page0, sizeof(DbHeader));
 
+        bool v1 = header.magic == DB_MAGIC_V1;
+        uint32_t old_format = v1 ? 1 : header.format_version;
+        // Up to format 6 here; the BTree then rebuilds a format 6 tree with 64-bit keys
+        bool upgrade = v1 || (header.magic == DB_MAGIC && old_format < DB_FORMAT_NARROW_KEYS);
+        if (upgrade) {
+            if (old_format < 3) {
+                // Format 1 had only the first five header fields, format 2 the
+                // first nine; both kept the bloom bits right behind them.  Widen
+                // the header over the old bits; the filter is marked invalid and
+                // rebuilt once, on its own pages, by the BTree.
+                uint32_t old_size = v1 ? offsetof(DbHeader, format_version)
+                                       : offsetof(DbHeader, bloom_first_page);
+                std::memset((char*)page0 + old_size, 0, PAGE_SIZE - old_size);
+                std::memset((char*)&header + old_size, 0, sizeof(DbHeader) - old_size);
+                header.flags &= ~DB_FLAG_BLOOM_VALID;
+            }
+            header.magic = DB_MAGIC;
+            header.format_version = DB_FORMAT_NARROW_KEYS;
+            if (old_format < 5) header.checksum_algo = CHECKSUM_CRC32;  // Existing pages keep their CRC32
+            mark_dirty(HEADER_PAGE);
+            std::cerr << "Upgrading " << filename << " to format " << DB_FORMAT_NARROW_KEYS << ".\n";
+            if (old_format < 4) upgrade_node_pages();
+            import_free_list();
+            commit();
+        } else if (header.magic == DB_MAGIC && header.format_version > DB_FORMAT_VERSION) {
+            std::cerr << "ERROR: " << filename << " uses format " << header.format_version
+                      << "; this build reads up to format " << DB_FORMAT_VERSION << ".\n";
+            std::exit(1);
+        }
+
         if (header.magic != DB_MAGIC) {
             std::cerr << "ERROR: Invalid database file (bad magic 0x"
                       << std::hex << header.magic << std::dec << ").\n"
                       << "Delete the old .db file and restart.\n";
             std::exit(1);
         }
+        if (header.checksum_algo > CHECKSUM_CRC32C) {
+            std::cerr << "ERROR: " << filename << " uses unknown checksum algorithm "
+                      << header.checksum_algo << ".\n";
+            std::exit(1);
+        }
+        if (!upgrade) load_fsm();
     }
-    // Pin page 0 permanently — header + bloom filter always in RAM
+    // Pin page 0 permanently — header always in RAM
     pin_page(HEADER_PAGE);
+    if (!tracked) {
+        page_lsn.clear();
+        tracked_from = header.commit_lsn;
+    } else if (!recovered.empty()) {
+        for (uint32_t pg : recovered) note_logged(pg, header.commit_lsn);
+        save_changes();
+    }
+
+    verify_policy = config.verify;
+    if (verify_policy == VERIFY_BACKGROUND) {
+        uint32_t algo = header.checksum_algo;
+        verifier.start(VERIFY_QUEUE_SLOTS, [algo](uint32_t pg, void* data) {
+            return verify_checksum(pg, data, algo);
+        });
+    }
 }
 
-Pager::~Pager() {
-    write_header();  // Persist latest header state
-    // Flush every cached page and release memory
-    for (auto& [pg, data] : pool) {
-        flush(pg);
-        std::free(data);
+// Rewrites every leaf and internal page into the format 6 node layout.  The
+// pages go through the pool like any other change; the caller commits them
+// with the free-list import and the new header as one group, so a crash
+// part-way leaves the old file intact.  Pages on the free list may still
+// carry a stale tree type from older formats and are skipped.
+void Pager::upgrade_node_pages() {
+    std::unordered_set<uint32_t> free_set;
+    for (uint32_t pg = header.first_free_page; pg != 0 && pg < header.total_pages && !free_set.count(pg);) {
+        free_set.insert(pg);
+        pg = *((uint32_t*)((char*)get_page(pg) + HEADER_SIZE));
+    }
+    for (uint32_t pg = HEADER_PAGE + 1; pg < header.total_pages; pg++) {
+        if (free_set.count(pg)) continue;
+        void* page = get_page(pg);
+        uint8_t type = *((uint8_t*)page);
+        if (type != NODE_LEAF && type != NODE_INTERNAL) continue;
+        upgrade_node_layout(page);
+        mark_dirty(pg);
     }
-    pool.clear();
-    lru_order.clear();
-    lru_map.clear();
-    file_stream.close();
+}
+
+Pager::~Pager() {
+    checkpoint();  // Commit outstanding changes, fold the WAL into the main file
+    reader.stop();
+    verifier.stop();
+    if (map_base) ::munmap(map_base, (size_t)map_pages * PAGE_SIZE);
+    for (auto& [addr, len] : retired_maps) ::munmap(addr, len);
+    std::free(arena);
+    ::close(fd);
 }
 
 // --- Page Cache ---
 
 void* Pager::get_page(uint32_t page_num) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    uint32_t idx = fetch_frame(lock, page_num);
+    op_pin(idx);
+    return frame_data(idx);
+}
+
+// Writer pages stay pinned for the rest of the WriteOp
+void Pager::op_pin(uint32_t idx) {
+    if (op_depth == 0 || !op_pin_pages || frames[idx].op_pinned ||
+        op_thread != std::this_thread::get_id()) return;
+    frames[idx].op_pinned = true;
+    frames[idx].pin_count++;
+    op_frames.push_back(idx);
+}
+
+// Returns the frame holding page_num, reading it in on a miss (pool_mutex held)
+// load = false installs a zeroed frame without reading (a newly allocated page)
+uint32_t Pager::fetch_frame(std::unique_lock<std::mutex>& lock, uint32_t page_num, bool load) {
     // --- Cache HIT: page already in buffer pool ---
-    auto it = pool.find(page_num);
-    if (it != pool.end()) {
+    uint32_t idx = lookup_frame(page_num);
+    if (idx != INVALID_FRAME) {
         stat_hits++;
-        // Promote to MRU position
-        lru_order.erase(lru_map[page_num]);
-        lru_order.push_front(page_num);
-        lru_map[page_num] = lru_order.begin();
-        return it->second;
+        // Second reference: A1 → Am.  Am hits move to the MRU end.
+        queue_unlink(idx);
+        queue_push_head(am, QUEUE_AM, idx);
+        return idx;
     }
 
     // --- Cache MISS ---
-    stat_misses++;
-
-    // Evict LRU page(s) if pool is full
-    while (pool.size() >= BUFFER_POOL_SIZE) {
-        evict_lru();
-    }
+    idx = allocate_frame(lock);
+    void* page = frame_data(idx);
+    std::memset(page, 0, PAGE_SIZE);
+    if (load) stat_misses++;
 
-    // Allocate frame and read from disk if page exists on file
-    void* page = std::calloc(1, PAGE_SIZE);
+    // Newest copy is in the WAL if logged, else in the main file
     uint32_t file_pages = file_length / PAGE_SIZE;
     if (file_length % PAGE_SIZE) file_pages++;
 
-    if (page_num < file_pages) {
-        file_stream.seekg(page_num * PAGE_SIZE);
-        file_stream.read((char*)page, PAGE_SIZE);
-        file_stream.clear();  // Clear EOF flags
-
-        // Verify CRC32 for tree pages (skip header page 0 and freed pages)
-        if (page_num > HEADER_PAGE) {
-            uint8_t page_type = *((uint8_t*)page);
-            if (page_type == NODE_LEAF || page_type == NODE_INTERNAL) {
-                uint32_t stored;
-                std::memcpy(&stored, (char*)page + OFFSET_CHECKSUM, 4);
-                if (stored != 0) {
-                    uint32_t* crc_field = (uint32_t*)((char*)page + OFFSET_CHECKSUM);
-                    *crc_field = 0;
-                    uint32_t computed = crc32_compute((uint8_t*)page, PAGE_SIZE);
-                    *crc_field = stored;
-                    if (stored != computed) {
-                        std::cerr << "WARNING: CRC32 mismatch on Page " << page_num
-                                  << " (stored=0x" << std::hex << stored
-                                  << " computed=0x" << computed << std::dec << ")\n";
-                    }
-                }
+    uint64_t wal_offset;
+    bool logged = load && wal.lookup(page_num, wal_offset);
+    if (logged || (load && page_num < file_pages)) {
+        if (logged) {
+            wal.read_frame(wal_offset, page);
+        } else if (reader.take(page_num, page)) {
+            stat_prefetch_hits++;
+        } else if (page_num < map_pages) {
+            std::memcpy(page, map_base + (size_t)page_num * PAGE_SIZE, PAGE_SIZE);
+            METRIC_INC(MET_MAPPED_READS);
+        } else if (!pread_full(fd, page, PAGE_SIZE, (uint64_t)page_num * PAGE_SIZE)) {
+            std::cerr << "ERROR: Read failed on Page " << page_num << "\n";
+        }
+
+        verify_read(page_num, page);
+    }
+
+    // Install: page table + A1 (first reference)
+    Frame& f = frames[idx];
+    f.page_num = page_num;
+    f.pin_count = 0;
+    f.dirty = false;
+    table_insert(page_num, idx);
+    queue_push_head(a1, QUEUE_A1, idx);
+    return idx;
+}
+
+void Pager::verify_read(uint32_t page_num, void* data) {
+    switch (verify_policy) {
+        case VERIFY_FIRST:
+            if (page_num >= page_verified.size())
+                page_verified.resize(std::max<size_t>(page_num + 1, page_verified.size() * 2));
+            if (page_verified[page_num]) {
+                stat_verify_skips++;
+                return;
             }
+            page_verified[page_num] = true;
+            break;
+        case VERIFY_BACKGROUND:
+            stat_verify_skips++;
+            verifier.submit(page_num, data);
+            return;
+        case VERIFY_ALWAYS:
+            break;
+    }
+    stat_verified++;
+    if (!verify_checksum(page_num, data, header.checksum_algo)) stat_crc_failures++;
+}
+
+// --- Latched Access ---
+
+PageHandle Pager::acquire(uint32_t page_num, LatchMode mode) {
+    PageHandle h;
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        h.frame = fetch_frame(lock, page_num);
+        frames[h.frame].pin_count++;
+        handles_out++;
+    }
+    std::shared_mutex& latch = latches[h.frame];
+    if (!(mode == LATCH_SHARED ? latch.try_lock_shared() : latch.try_lock())) {
+        METRIC_TIMER(HIST_LATCH_WAIT_NS);
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            latch_waiters++;
+            if (draining) frame_cv.notify_all();
         }
+        if (mode == LATCH_SHARED) latch.lock_shared();
+        else latch.lock();
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        latch_waiters--;
+    }
+    h.page_num = page_num;
+    h.mode = mode;
+    h.data = frame_data(h.frame);
+    return h;
+}
+
+bool Pager::try_acquire(uint32_t page_num, LatchMode mode, PageHandle& out) {
+    out = acquire_pinned_only(page_num);
+    bool locked = (mode == LATCH_SHARED) ? latches[out.frame].try_lock_shared()
+                                         : latches[out.frame].try_lock();
+    if (!locked) {
+        unpin_handle(out);
+        return false;
     }
+    out.mode = mode;
+    return true;
+}
 
-    // Insert into pool + LRU list
-    pool[page_num] = page;
-    lru_order.push_front(page_num);
-    lru_map[page_num] = lru_order.begin();
-    return page;
+void Pager::release(PageHandle& h) {
+    if (!h.valid()) return;
+    if (h.mode == LATCH_SHARED) latches[h.frame].unlock_shared();
+    else latches[h.frame].unlock();
+    unpin_handle(h);
 }
 
-void Pager::flush(uint32_t page_num) {
-    auto it = pool.find(page_num);
-    if (it == pool.end()) return;
-    void* data = it->second;
-    // Stamp CRC32 into tree pages before writing (skip header and free pages)
-    if (page_num > HEADER_PAGE) {
-        uint8_t page_type = *((uint8_t*)data);
-        if (page_type == NODE_LEAF || page_type == NODE_INTERNAL) {
-            uint32_t* crc_field = (uint32_t*)((char*)data + OFFSET_CHECKSUM);
-            *crc_field = 0;
-            *crc_field = crc32_compute((uint8_t*)data, PAGE_SIZE);
+PageHandle Pager::acquire_pinned_only(uint32_t page_num) {
+    PageHandle h;
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    h.frame = fetch_frame(lock, page_num);
+    frames[h.frame].pin_count++;
+    handles_out++;
+    h.page_num = page_num;
+    h.data = frame_data(h.frame);
+    return h;
+}
+
+void Pager::unpin_handle(PageHandle& h) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (--frames[h.frame].pin_count == 0 || draining) frame_cv.notify_all();
+    handles_out--;
+    h.frame = INVALID_FRAME;
+}
+
+void Pager::wait_for_readers(uint32_t own) {
+    METRIC_TIMER(HIST_DRAIN_WAIT_NS);
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    draining++;
+    frame_cv.wait(lock, [&] { return handles_out - latch_waiters <= own; });
+    draining--;
+}
+
+// --- Write Operations ---
+
+void Pager::begin_write_op(bool pin_pages) {
+    write_mutex.lock();
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (op_depth++ == 0) {
+        op_thread = std::this_thread::get_id();
+        op_pin_pages = pin_pages;
+        op_seq++;
+    }
+}
+
+void Pager::end_write_op() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (--op_depth == 0) {
+            for (uint32_t idx : op_frames) {
+                frames[idx].op_pinned = false;
+                frames[idx].pin_count--;
+            }
+            op_frames.clear();
+            for (auto& [addr, len] : retired_maps) ::munmap(addr, len);  // No reader can point into them now
+            retired_maps.clear();
+            frame_cv.notify_all();
+        }
+    }
+    write_mutex.unlock();
+}
+
+// --- Snapshots ---
+
+// write_mutex waits out a running operation, so the epoch's pages are final
+uint64_t Pager::open_snapshot() {
+    std::lock_guard<std::recursive_mutex> op(write_mutex);
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    open_snapshots[op_seq]++;
+    return op_seq;
+}
+
+// A version made by operation m and replaced by u is seen by epochs in [m, u)
+void Pager::close_snapshot(uint64_t epoch) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto it = open_snapshots.find(epoch);
+    if (it == open_snapshots.end()) return;
+    if (--it->second == 0) open_snapshots.erase(it);
+    if (open_snapshots.empty()) {
+        page_versions.clear();
+        page_written.clear();
+        versions_live = 0;
+        return;
+    }
+    for (auto pv = page_versions.begin(); pv != page_versions.end();) {
+        std::vector<PageVersion>& list = pv->second;
+        uint64_t made = 0;
+        size_t kept = 0;
+        for (PageVersion& v : list) {
+            uint64_t from = made;
+            made = v.until;
+            auto seen = open_snapshots.lower_bound(from);
+            if (seen == open_snapshots.end() || seen->first >= v.until) {
+                versions_live--;
+                continue;
+            }
+            list[kept++] = std::move(v);
+        }
+        list.resize(kept);
+        pv = list.empty() ? page_versions.erase(pv) : std::next(pv);
+    }
+}
+
+void Pager::keep_version(uint32_t page_num, uint32_t idx) {
+    if (page_num == HEADER_PAGE) return;
+    uint64_t& written = page_written[page_num];
+    uint64_t made = written;
+    if (made == op_seq) return;  // Already kept (or not needed) for this operation
+    written = op_seq;
+    if (open_snapshots.rbegin()->first < made) return;  // Made after every open snapshot
+
+    PageVersion v{op_seq, std::make_unique<uint8_t[]>(PAGE_SIZE)};
+    std::memcpy(v.image.get(), frame_data(idx), PAGE_SIZE);
+    page_versions[page_num].push_back(std::move(v));
+    stat_versions_kept++;
+    versions_peak = std::max(versions_peak, ++versions_live);
+}
+
+// The oldest version replaced after the epoch, else the live page.  The live
+// frame is copied pinned, without pool_mutex, so parallel snapshot readers do
+// not queue behind each other's copies.  A writer keeps a version before its
+// first change to a page (under pool_mutex); if one for this epoch appeared
+// during the copy, the copy may be torn and the kept image is taken instead.
+void Pager::read_snapshot(uint64_t epoch, uint32_t page_num, void* dest) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    stat_snapshot_reads++;
+    const uint8_t* image = version_image(epoch, page_num);
+    if (!image) {
+        uint32_t idx = fetch_frame(lock, page_num);
+        image = version_image(epoch, page_num);  // Kept while fetch_frame waited for a frame
+        if (!image) {
+            frames[idx].pin_count++;
+            handles_out++;
+            lock.unlock();
+            std::memcpy(dest, frame_data(idx), PAGE_SIZE);
+            lock.lock();
+            if (--frames[idx].pin_count == 0 || draining) frame_cv.notify_all();
+            handles_out--;
+            image = version_image(epoch, page_num);
+            if (!image) return;
         }
     }
-    file_stream.seekp(page_num * PAGE_SIZE);
-    file_stream.write((char*)data, PAGE_SIZE);
-    file_stream.flush();
-    // Track file growth so re-reads after eviction find the data
-    uint32_t write_end = (page_num + 1) * PAGE_SIZE;
-    if (write_end > file_length) file_length = write_end;
-}
-
-// --- LRU Eviction ---
-
-void Pager::evict_lru() {
-    // Walk from LRU end toward MRU, skip pinned pages
-    for (auto it = lru_order.end(); it != lru_order.begin(); ) {
-        --it;
-        uint32_t candidate = *it;
-        if (pin_counts.count(candidate) == 0) {
-            lru_order.erase(it);
-            lru_map.erase(candidate);
-            flush(candidate);
-            std::free(pool[candidate]);
-            pool.erase(candidate);
-            stat_evicts++;
+    stat_version_reads++;
+    std::memcpy(dest, image, PAGE_SIZE);
+}
+
+const uint8_t* Pager::version_image(uint64_t epoch, uint32_t page_num) const {
+    auto pv = page_versions.find(page_num);
+    if (pv == page_versions.end()) return nullptr;
+    for (const PageVersion& v : pv->second)
+        if (v.until > epoch) return v.image.get();
+    return nullptr;
+}
+
+void Pager::note_logged(uint32_t page_num, uint64_t lsn) {
+    if (page_num >= page_lsn.size()) page_lsn.resize(std::max<size_t>(page_num + 1, page_lsn.size() * 2));
+    page_lsn[page_num] = lsn;
+}
+
+// Cached or logged pages go through the pool (the newest image lives there);
+// anything else that lies inside the mapping is returned in place.
+void* Pager::read_page(uint32_t page_num) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (page_num < map_pages && lookup_frame(page_num) == INVALID_FRAME) {
+        uint64_t wal_offset;
+        if (!wal.lookup(page_num, wal_offset)) {
+            stat_map_reads++;
+            return map_base + (size_t)page_num * PAGE_SIZE;
+        }
+    }
+    uint32_t idx = fetch_frame(lock, page_num);
+    op_pin(idx);
+    return frame_data(idx);
+}
+
+// Pages kept outside the pool: the WAL, then the main file.  Done under
+// pool_mutex so a concurrent checkpoint cannot move the page underneath.
+bool Pager::read_uncached(uint32_t page_num, void* dest) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    uint64_t wal_offset;
+    if (wal.lookup(page_num, wal_offset)) {
+        wal.read_frame(wal_offset, dest);
+    } else if (!pread_full(fd, dest, PAGE_SIZE, (uint64_t)page_num * PAGE_SIZE)) {
+        std::cerr << "ERROR: Read failed on Page " << page_num << "\n";
+        return false;
+    }
+    if (verify_checksum(page_num, dest, header.checksum_algo)) return true;
+    stat_crc_failures++;
+    return false;
+}
+
+void Pager::remap() {
+    uint32_t file_pages = file_length / PAGE_SIZE;
+    if (!use_mmap || file_pages <= map_pages) return;
+    void* addr = ::mmap(nullptr, (size_t)file_pages * PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        std::cerr << "WARNING: mmap failed; continuing with buffered reads.\n";
+        use_mmap = false;
+        return;
+    }
+    if (map_base) retired_maps.push_back({map_base, (size_t)map_pages * PAGE_SIZE});
+    map_base = (uint8_t*)addr;
+    map_pages = file_pages;
+}
+
+// Only main-file pages are worth prefetching: cached ones are already here and
+// logged ones would be read from the WAL.
+void Pager::prefetch(const std::vector<uint32_t>& pages) {
+    if (readahead == 0) return;
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    uint32_t file_pages = file_length / PAGE_SIZE;
+    for (uint32_t pg : pages) {
+        uint64_t wal_offset;
+        if (pg >= file_pages || lookup_frame(pg) != INVALID_FRAME || wal.lookup(pg, wal_offset)) continue;
+        if (pg < map_pages) {
+            ::madvise(map_base + (size_t)pg * PAGE_SIZE, PAGE_SIZE, MADV_WILLNEED);
+            stat_prefetch_issued++;
+        } else if (reader.submit(pg)) {
+            stat_prefetch_issued++;
+        }
+    }
+}
+
+void Pager::flush(uint32_t page_num) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    uint32_t idx = lookup_frame(page_num);
+    if (idx != INVALID_FRAME) write_frame(idx);
+}
+
+void Pager::write_frame(uint32_t idx) {
+    write_frames({idx});
+}
+
+// Resident frames are never modified by the pager itself (readers may hold
+// them): checksums are stamped into copies on their way to the log.
+void Pager::write_frames(const std::vector<uint32_t>& idxs) {
+    std::vector<uint8_t> images((size_t)idxs.size() * PAGE_SIZE);
+    std::vector<std::pair<uint32_t, const void*>> group;
+    for (uint32_t idx : idxs) {
+        Frame& f = frames[idx];
+        if (!f.dirty) continue;
+        f.dirty = false;
+        uint8_t* image = images.data() + group.size() * PAGE_SIZE;
+        std::memcpy(image, frame_data(idx), PAGE_SIZE);
+        stamp_checksum(f.page_num, image, header.checksum_algo);
+        group.push_back({f.page_num, image});
+        note_logged(f.page_num, header.commit_lsn + 1);  // Committed by the next group
+    }
+    wal.append(group, 0);
+}
+
+// Callers mark a page dirty after fetching it for modification and before
+// changing it, so an open snapshot can keep the image it sees.
+// Clean frames are dropped on eviction without any I/O or CRC work.
+void Pager::mark_dirty(uint32_t page_num) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    uint32_t idx = fetch_frame(lock, page_num);
+    op_pin(idx);
+    if (!open_snapshots.empty()) keep_version(page_num, idx);
+    mark_frame_dirty(idx);
+}
+
+void Pager::mark_frame_dirty(uint32_t idx) {
+    if (frames[idx].dirty) return;
+    frames[idx].dirty = true;
+    dirty_frames.push_back(idx);
+}
+
+void Pager::drop_frame(uint32_t idx) {
+    queue_unlink(idx);
+    table_erase(frames[idx].page_num);
+    frames[idx].page_num = INVALID_PAGE;
+    frames[idx].dirty = false;
+    free_frames.push_back(idx);
+}
+
+// --- Durability ---
+
+void Pager::commit() {
+    WriteOp op(*this);
+
+    // Header and free-space map changes are applied once per commit
+    prepare_fsm();
+    write_header();
+    std::vector<std::pair<uint32_t, const void*>> external;
+    if (commit_hook) commit_hook(external);
+    fsm.collect_dirty(header.fsm_first_page, header.fsm_pages, external);
+
+    bool need_checkpoint;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+
+        // Nothing dirty in the pool and no evicted frames awaiting a commit mark
+        bool any_dirty = false;
+        for (uint32_t idx : dirty_frames) {
+            if (frames[idx].dirty) { any_dirty = true; break; }
+        }
+        if (!any_dirty && external.empty() && wal.num_frames() == wal.num_committed()) {
+            dirty_frames.clear();
             return;
         }
+
+        // Every group carries the header, with its LSN
+        header.commit_lsn++;
+        uint32_t header_idx = lookup_frame(HEADER_PAGE);
+        std::memcpy(frame_data(header_idx), &header, sizeof(DbHeader));
+        mark_frame_dirty(header_idx);
+
+        // Collect frames still dirty (entries of evicted or reused frames are stale)
+        std::vector<std::pair<uint32_t, uint32_t>> pages;  // (page, frame)
+        for (uint32_t idx : dirty_frames) {
+            if (frames[idx].dirty) {
+                frames[idx].dirty = false;
+                pages.push_back({frames[idx].page_num, idx});
+            }
+        }
+        dirty_frames.clear();
+        std::sort(pages.begin(), pages.end());
+
+        std::vector<uint8_t> images((pages.size() + external.size()) * PAGE_SIZE);
+        std::vector<std::pair<uint32_t, const void*>> group;
+        group.reserve(pages.size() + external.size());
+        auto add_image = [&](uint32_t pg, const void* data) {
+            uint8_t* image = images.data() + group.size() * PAGE_SIZE;
+            std::memcpy(image, data, PAGE_SIZE);
+            stamp_checksum(pg, image, header.checksum_algo);
+            group.push_back({pg, image});
+            note_logged(pg, header.commit_lsn);
+        };
+        for (auto& [pg, idx] : pages) add_image(pg, frame_data(idx));
+        for (auto& [pg, data] : external) add_image(pg, data);
+        wal.append(group, header.total_pages);
+        need_checkpoint = wal.num_frames() >= WAL_CHECKPOINT_FRAMES;
+    }
+    wal.sync();  // Readers keep running while the commit reaches the disk
+
+    if (need_checkpoint) checkpoint();
+}
+
+bool Pager::begin_batch() {
+    if (in_batch) return false;
+    in_batch = true;
+    return true;
+}
+
+bool Pager::end_batch() {
+    if (!in_batch) return false;
+    in_batch = false;
+    commit();
+    return true;
+}
+
+void Pager::checkpoint() {
+    WriteOp op(*this);
+    commit();  // Never fold uncommitted frames into the main file
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (wal.num_frames() > 0) write_back_wal();
+}
+
+// Copy the newest image of every logged page into the main file, in page order.
+// After a commit every resident frame is clean, i.e. identical to its newest
+// WAL frame, so only non-resident pages are read back from the log.
+void Pager::write_back_wal() {
+    checkpoint_gen++;  // Before the first write: an overlapping pread() sees it changed
+    reader.discard();  // Staged reads are about to go stale
+    std::vector<uint8_t> buf(PAGE_SIZE);
+    for (auto& [pg, offset] : wal.checkpoint_list()) {
+        uint32_t idx = lookup_frame(pg);
+        if (idx != INVALID_FRAME) {
+            std::memcpy(buf.data(), frame_data(idx), PAGE_SIZE);
+            stamp_checksum(pg, buf.data(), header.checksum_algo);
+        } else {
+            wal.read_frame(offset, buf.data());
+        }
+        if (!pwrite_full(fd, buf.data(), PAGE_SIZE, (uint64_t)pg * PAGE_SIZE)) {
+            std::cerr << "ERROR: Checkpoint write failed on Page " << pg << "\n";
+            std::exit(1);
+        }
+        uint32_t write_end = (pg + 1) * PAGE_SIZE;
+        if (write_end > file_length) file_length = write_end;
+    }
+    {
+        METRIC_TIMER(HIST_SYNC_NS);
+        if (::fsync(fd) != 0) {
+            std::cerr << "ERROR: Checkpoint fsync failed.\n";
+            std::exit(1);
+        }
+    }
+    wal.reset();
+    remap();
+    if (!changes_path.empty() && header.magic == DB_MAGIC) save_changes();  // Not in the recovery pass: header still zeroed
+}
+
+// --- Change Tracking ---
+// "<db>-changes": [CHANGES_MAGIC:4][words:4][base_lsn:8][lsn:8][bitmap].
+// The bitmap marks the pages changed after base_lsn (the last backup's LSN)
+// up to lsn, the main file's LSN when it was saved.  Written to a temporary
+// file and renamed, so it is either the old or the new one.
+
+bool Pager::load_changes(uint64_t file_lsn) {
+    int in = ::open(changes_path.c_str(), O_RDONLY);
+    if (in < 0) return false;
+    struct { uint32_t magic, words; uint64_t base_lsn, lsn; } head{};
+    struct stat st{};
+    bool ok = ::fstat(in, &st) == 0 && pread_full(in, &head, sizeof(head), 0) && head.magic == CHANGES_MAGIC &&
+              head.lsn == file_lsn && (uint64_t)st.st_size == sizeof(head) + (uint64_t)head.words * 8;  // Sized by the file
+    std::vector<uint64_t> bits(ok ? head.words : 0);
+    ok = ok && pread_full(in, bits.data(), bits.size() * 8, sizeof(head));
+    ::close(in);
+    if (!ok) return false;
+    for (uint32_t w = 0; w < bits.size(); w++) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) note_logged(w * 64 + __builtin_ctzll(word), head.lsn);
+    }
+    tracked_from = head.base_lsn;
+    return true;
+}
+
+void Pager::save_changes() {
+    struct { uint32_t magic, words; uint64_t base_lsn, lsn; } head{CHANGES_MAGIC, 0, header.backup_lsn, header.commit_lsn};
+    std::vector<uint64_t> bits;
+    if (tracked_from <= header.backup_lsn) {  // Else nothing to build an increment on
+        bits.resize((page_lsn.size() + 63) / 64);
+        for (uint32_t pg = 0; pg < page_lsn.size(); pg++)
+            if (page_lsn[pg] > header.backup_lsn) bits[pg / 64] |= 1ull << (pg % 64);
+    } else {
+        head.base_lsn = header.commit_lsn;  // Tracked from here on, nothing changed yet
+    }
+    head.words = bits.size();
+    std::string tmp = changes_path + ".tmp";
+    int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = out >= 0 && pwrite_full(out, &head, sizeof(head), 0) &&
+              pwrite_full(out, bits.data(), bits.size() * 8, sizeof(head)) && ::fsync(out) == 0;
+    if (out >= 0) ::close(out);
+    if (!ok || ::rename(tmp.c_str(), changes_path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        ::unlink(changes_path.c_str());  // A stale one must not be trusted
+    }
+}
+
+// --- Frame Table (open addressing, linear probing) ---
+
+static inline uint32_t page_hash(uint32_t page_num) { return page_num * 0x9E3779B1u; }
+
+uint32_t Pager::lookup_frame(uint32_t page_num) const {
+    uint32_t mask = page_table.size() - 1;
+    for (uint32_t slot = page_hash(page_num) >> table_shift; ; slot = (slot + 1) & mask) {
+        uint32_t idx = page_table[slot];
+        if (idx == INVALID_FRAME) return INVALID_FRAME;
+        if (frames[idx].page_num == page_num) return idx;
+    }
+}
+
+void Pager::table_insert(uint32_t page_num, uint32_t idx) {
+    uint32_t mask = page_table.size() - 1;
+    uint32_t slot = page_hash(page_num) >> table_shift;
+    while (page_table[slot] != INVALID_FRAME) slot = (slot + 1) & mask;
+    page_table[slot] = idx;
+}
+
+// Backward-shift deletion: no tombstones, probe chains stay short
+void Pager::table_erase(uint32_t page_num) {
+    uint32_t mask = page_table.size() - 1;
+    uint32_t slot = page_hash(page_num) >> table_shift;
+    while (frames[page_table[slot]].page_num != page_num) slot = (slot + 1) & mask;
+
+    uint32_t hole = slot;
+    for (uint32_t next = (hole + 1) & mask; page_table[next] != INVALID_FRAME; next = (next + 1) & mask) {
+        uint32_t home = page_hash(frames[page_table[next]].page_num) >> table_shift;
+        // Move the entry back unless its home lies cyclically in (hole, next]
+        bool stays = (hole < next) ? (home > hole && home <= next)
+                                   : (home > hole || home <= next);
+        if (!stays) {
+            page_table[hole] = page_table[next];
+            hole = next;
+        }
+    }
+    page_table[hole] = INVALID_FRAME;
+}
+
+// --- 2Q Queues ---
+
+void Pager::queue_push_head(Queue& q, FrameQueue id, uint32_t idx) {
+    Frame& f = frames[idx];
+    f.queue = id;
+    f.prev = INVALID_FRAME;
+    f.next = q.head;
+    if (q.head != INVALID_FRAME) frames[q.head].prev = idx;
+    q.head = idx;
+    if (q.tail == INVALID_FRAME) q.tail = idx;
+    q.size++;
+}
+
+void Pager::queue_unlink(uint32_t idx) {
+    Frame& f = frames[idx];
+    Queue& q = (f.queue == QUEUE_A1) ? a1 : am;
+    if (f.prev != INVALID_FRAME) frames[f.prev].next = f.next; else q.head = f.next;
+    if (f.next != INVALID_FRAME) frames[f.next].prev = f.prev; else q.tail = f.prev;
+    f.prev = f.next = INVALID_FRAME;
+    f.queue = QUEUE_FREE;
+    q.size--;
+}
+
+uint32_t Pager::allocate_frame(std::unique_lock<std::mutex>& lock) {
+    while (free_frames.empty() && !evict()) {
+        // Every frame is pinned.  Other threads' pins drop as they finish;
+        // with no handles outstanding nobody else will ever unpin.
+        METRIC_TIMER(HIST_FRAME_WAIT_NS);
+        if (handles_out == 0 ||
+            frame_cv.wait_for(lock, std::chrono::seconds(10)) == std::cv_status::timeout) {
+            std::cerr << "ERROR: Buffer pool exhausted — all " << frames.size() << " pages are pinned!\n";
+            std::exit(1);
+        }
+    }
+    uint32_t idx = free_frames.back();
+    free_frames.pop_back();
+    return idx;
+}
+
+// Victim: oldest unpinned A1 page while A1 is over its share (or Am has
+// nothing evictable), otherwise the least recently used unpinned Am page.
+bool Pager::evict() {
+    auto oldest_unpinned = [this](const Queue& q) {
+        uint32_t idx = q.tail;
+        while (idx != INVALID_FRAME && frames[idx].pin_count > 0) idx = frames[idx].prev;
+        return idx;
+    };
+    uint32_t victim = INVALID_FRAME;
+    if (a1.size > a1_target || am.size == 0) victim = oldest_unpinned(a1);
+    if (victim == INVALID_FRAME) victim = oldest_unpinned(am);
+    if (victim == INVALID_FRAME) victim = oldest_unpinned(a1);
+    if (victim == INVALID_FRAME) return false;
+
+    // A dirty victim is written together with the next few dirty frames in
+    // line for eviction; those then leave the pool later without any I/O.
+    if (frames[victim].dirty) {
+        std::vector<uint32_t> batch = {victim};
+        for (uint32_t idx = frames[victim].prev;
+             idx != INVALID_FRAME && batch.size() < EVICT_WRITE_BATCH; idx = frames[idx].prev) {
+            if (frames[idx].dirty && frames[idx].pin_count == 0) batch.push_back(idx);
+        }
+        write_frames(batch);
     }
-    std::cerr << "ERROR: Buffer pool exhausted — all " << pool.size() << " pages are pinned!\n";
+    queue_unlink(victim);
+    table_erase(frames[victim].page_num);
+    frames[victim].page_num = INVALID_PAGE;
+    free_frames.push_back(victim);
+    stat_evicts++;
+    return true;
 }
 
 // --- Page Pinning ---
 
-void Pager::pin_page(uint32_t page_num)   { pin_counts[page_num]++; }
+void Pager::pin_page(uint32_t page_num) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    frames[fetch_frame(lock, page_num)].pin_count++;
+}
+
 void Pager::unpin_page(uint32_t page_num) {
-    auto it = pin_counts.find(page_num);
-    if (it != pin_counts.end() && --it->second == 0) pin_counts.erase(it);
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    uint32_t idx = lookup_frame(page_num);
+    if (idx != INVALID_FRAME && frames[idx].pin_count > 0) {
+        if (--frames[idx].pin_count == 0) frame_cv.notify_all();
+    }
 }
-bool Pager::is_pinned(uint32_t page_num) const { return pin_counts.count(page_num) > 0; }
 
-// --- Free List Management ---
+bool Pager::is_pinned(uint32_t page_num) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    uint32_t idx = lookup_frame(page_num);
+    return idx != INVALID_FRAME && frames[idx].pin_count > 0;
+}
 
-uint32_t Pager::get_unused_page_num() {
-    // 1. Try to reuse a page from the free list
-    if (header.first_free_page != 0) {
-        uint32_t reused = header.first_free_page;
-        void* page = get_page(reused);
+// --- Page Allocation ---
 
-        // Read the "next" pointer stored at offset 6 of the free page
-        header.first_free_page = *((uint32_t*)((char*)page + HEADER_SIZE));
+uint32_t Pager::get_unused_page_num(uint32_t hint) {
+    // 1. A free page just after the hint; near the end of the file, growing
+    //    the file is as close as it gets
+    uint32_t total = header.total_pages;
+    uint32_t pg = INVALID_PAGE;
+    if (hint != 0) {
+        pg = fsm.find_free(hint + 1, std::min<uint64_t>((uint64_t)hint + 1 + FSM_HINT_WINDOW, total));
+        if (pg == INVALID_PAGE && hint + FSM_HINT_WINDOW >= total) pg = total;
+    }
+    // 2. Else the lowest free page, which keeps the file compact
+    if (pg == INVALID_PAGE) pg = fsm.find_free(ROOT_PAGE + 1, total);
+
+    if (pg == INVALID_PAGE || pg == total) {
+        // 3. No free pages available — grow the file
+        pg = total;
+        header.total_pages++;
+    } else {
+        fsm.set_free(pg, false);
         header.free_pages--;
+        LOG_AT(LOG_DEBUG) << "DEBUG: Reused free page " << pg << "\n";
+    }
 
-        // Zero the page so the caller gets a clean slate
-        std::memset(page, 0, PAGE_SIZE);
+    // Its old contents are dead: the frame is zeroed, never read in (and a
+    // snapshot that saw the page in use has its version from free_page)
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (!open_snapshots.empty()) page_written[pg] = op_seq;
+    uint32_t idx = fetch_frame(lock, pg, false);
+    std::memset(frame_data(idx), 0, PAGE_SIZE);
+    op_pin(idx);
+    mark_frame_dirty(idx);
+    return pg;
+}
 
-        write_header();
-        std::cout << "DEBUG: Reused free page " << reused << "\n";
-        return reused;
+// Runs (bloom filter, free-space map) are written outside the pool, so a
+// stale frame of a reused page could be written back over the run: unpinned
+// frames of its free pages are dropped, and a page someone still has pinned
+// rules the run out.  Else it goes at the end of the file.
+uint32_t Pager::allocate_run(uint32_t count, uint32_t from, uint32_t below) {
+    uint32_t total = header.total_pages;
+    uint32_t limit = std::min(total, below);
+    uint32_t first = fsm.find_run(count, from, limit);
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        while (first != INVALID_PAGE) {
+            uint32_t pg = first;
+            for (; pg < first + count; pg++) {
+                uint32_t idx = lookup_frame(pg);
+                if (idx == INVALID_FRAME) continue;
+                if (frames[idx].pin_count > 0) break;
+                drop_frame(idx);
+            }
+            if (pg == first + count) break;
+            first = fsm.find_run(count, pg + 1, limit);
+        }
     }
-
-    // 2. No free pages available — grow the file
-    uint32_t new_page = header.total_pages;
-    header.total_pages++;
-    write_header();
-    return new_page;
+    if (first == INVALID_PAGE) {
+        if (below != INVALID_PAGE) return INVALID_PAGE;
+        first = total;
+        header.total_pages += count;
+    } else {
+        for (uint32_t pg = first; pg < first + count; pg++) fsm.set_free(pg, false);
+        header.free_pages -= count;
+    }
+    return first;
 }
 
+// Only the map bit changes: the page itself is not rewritten, and a dirty
+// frame of it no longer needs writing.  It is read only to keep its image
+// for open snapshots, which still see it in the tree.
 void Pager::free_page(uint32_t page_num) {
     if (page_num <= ROOT_PAGE) {
-        std::cout << "ERROR: Cannot free the header or root page.\n";
+        output() << "ERROR: Cannot free the header or root page.\n";
         return;
     }
+    if (page_num >= header.total_pages || !fsm.set_free(page_num, true)) return;
+    header.free_pages++;
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    uint32_t idx = lookup_frame(page_num);
+    if (!open_snapshots.empty()) {
+        if (idx == INVALID_FRAME) idx = fetch_frame(lock, page_num);
+        keep_version(page_num, idx);
+    }
+    if (idx != INVALID_FRAME) frames[idx].dirty = false;
+}
 
-    void* page = get_page(page_num);
+void Pager::free_run(uint32_t first, uint32_t count) {
+    for (uint32_t pg = first; pg < first + count; pg++) {
+        if (fsm.set_free(pg, true)) header.free_pages++;
+    }
+}
 
-    // Clear the page, mark as free, store next-pointer at offset 6
-    // (offset 6 is after the 6-byte common header, avoiding CRC overlap at bytes 2-5)
-    std::memset(page, 0, PAGE_SIZE);
-    *((uint8_t*)page) = NODE_FREE;
-    *((uint32_t*)((char*)page + HEADER_SIZE)) = header.first_free_page;
+// --- Free-Space Map Persistence ---
 
-    // Push this page to the front of the free list
-    header.first_free_page = page_num;
-    header.free_pages++;
-    write_header();
+// An unreadable map page leaves the pages it covers in use: space is leaked
+// until a vacuum, never handed out twice.
+void Pager::load_fsm() {
+    std::vector<uint8_t> buf(PAGE_SIZE);
+    for (uint32_t i = 0; i < header.fsm_pages; i++) {
+        uint32_t pg = header.fsm_first_page + i;
+        if (!read_uncached(pg, buf.data()) || !fsm.read_page(i, buf.data(), header.total_pages))
+            std::cerr << "WARNING: Free-space map Page " << pg << " is unreadable; its free pages stay in use.\n";
+    }
+    header.free_pages = fsm.num_free();
+}
+
+// Reads the old free list once; from here on the map is the only record of it
+void Pager::import_free_list() {
+    std::unordered_set<uint32_t> seen;
+    uint32_t pg = header.first_free_page;
+    while (pg > ROOT_PAGE && pg < header.total_pages && seen.insert(pg).second) {
+        uint32_t next = *((uint32_t*)((char*)get_page(pg) + HEADER_SIZE));
+        fsm.set_free(pg, true);
+        pg = next;
+    }
+    header.first_free_page = 0;
+    header.free_pages = fsm.num_free();
+}
+
+// The run must also cover its own pages, which may extend the file
+void Pager::prepare_fsm() {
+    uint64_t per = FreeSpaceMap::pages_per_map_page();
+    if (header.fsm_pages > 0 && header.fsm_pages * per >= header.total_pages) return;
+    uint32_t pages = std::max(1u, header.fsm_pages * 2);
+    while (pages * per < (uint64_t)header.total_pages + pages) pages *= 2;
+
+    uint32_t old_first = header.fsm_first_page, old_pages = header.fsm_pages;
+    header.fsm_first_page = allocate_run(pages);
+    header.fsm_pages = pages;
+    free_run(old_first, old_pages);
+    fsm.mark_all_dirty(pages);
+}
+
+bool Pager::move_fsm(uint32_t from, uint32_t below) {
+    if (header.fsm_pages == 0) return false;
+    uint32_t first = allocate_run(header.fsm_pages, from, below);
+    if (first == INVALID_PAGE) return false;
+    free_run(header.fsm_first_page, header.fsm_pages);
+    header.fsm_first_page = first;
+    fsm.mark_all_dirty(header.fsm_pages);
+    return true;
+}
+
+// --- Vacuum Support ---
+
+void Pager::move_page(uint32_t from, uint32_t to) {
+    if (to >= header.total_pages) {
+        header.total_pages = to + 1;
+    } else {
+        fsm.set_free(to, false);
+        header.free_pages--;
+    }
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        uint32_t src = fetch_frame(lock, from);
+        frames[src].pin_count++;  // Held while the destination frame is found
+        if (!open_snapshots.empty()) page_written[to] = op_seq;  // Free until now
+        uint32_t dst = fetch_frame(lock, to, false);
+        std::memcpy(frame_data(dst), frame_data(src), PAGE_SIZE);
+        op_pin(dst);
+        mark_frame_dirty(dst);
+        if (--frames[src].pin_count == 0) frame_cv.notify_all();
+    }
+    free_page(from);
+}
+
+// The shorter header is committed first, then the log is folded into the
+// main file (it may still hold images of the cut pages) and only then is
+// the file truncated.  A crash in between leaves a file longer than its
+// header says, which is harmless: pages past total_pages are never read.
+uint32_t Pager::truncate_free_tail() {
+    WriteOp op(*this);
+    if (in_batch) return 0;  // The batch's commit must not be forced early
+    uint32_t total = header.total_pages;
+    uint32_t end = total;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        while (end > ROOT_PAGE + 1 && fsm.is_free(end - 1)) {
+            uint32_t idx = lookup_frame(end - 1);
+            if (idx != INVALID_FRAME) {
+                if (frames[idx].pin_count > 0) break;
+                drop_frame(idx);
+            }
+            end--;
+        }
+    }
+    if (end == total) return 0;
+
+    fsm.truncate(end);
+    header.total_pages = end;
+    header.free_pages = fsm.num_free();
+    commit();
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (wal.num_frames() > 0) write_back_wal();
+    if (::ftruncate(fd, (off_t)end * PAGE_SIZE) != 0 || ::fsync(fd) != 0) {
+        std::cerr << "WARNING: Cannot truncate the database file; its tail stays allocated.\n";
+        return 0;
+    }
+    file_length = end * PAGE_SIZE;
+    page_verified.resize(std::min<size_t>(page_verified.size(), end));
+    if (map_base && map_pages > end) {
+        // Unmapped when this operation ends (see end_write_op)
+        retired_maps.push_back({map_base, (size_t)map_pages * PAGE_SIZE});
+        map_base = nullptr;
+        map_pages = 0;
+        remap();
+    }
+    return total - end;
 }
 
 // --- Header Persistence ---
 
+// Page 0 is only dirtied when the header actually changed
 void Pager::write_header() {
     void* page0 = get_page(HEADER_PAGE);
+    if (std::memcmp(page0, &header, sizeof(DbHeader)) == 0) return;
+    mark_dirty(HEADER_PAGE);
     std::memcpy(page0, &header, sizeof(DbHeader));
 }
 
 // --- Debug Helpers ---
 
 void Pager::print_stats() {
-    std::cout << "=== ForgeDB Stats ===\n";
-    std::cout << "Magic:       0x" << std::hex << header.magic << std::dec << "\n";
-    std::cout << "Page Size:   " << header.page_size << " bytes\n";
-    std::cout << "Total Pages: " << header.total_pages << "\n";
-    std::cout << "Free Pages:  " << header.free_pages << "\n";
-    std::cout << "Free Head:   " << (header.first_free_page ? std::to_string(header.first_free_page) : "(none)") << "\n";
+    output() << "=== ForgeDB Stats ===\n";
+    output() << "Magic:       0x" << std::hex << header.magic << std::dec << "\n";
+    output() << "Format:      " << header.format_version << "\n";
+    output() << "Page Size:   " << header.page_size << " bytes\n";
+    output() << "Total Pages: " << header.total_pages << "\n";
+    output() << "Free Pages:  " << header.free_pages << "\n";
+    if (header.fsm_pages)
+        output() << "Free Map:    " << header.fsm_pages << " page(s) (from Page " << header.fsm_first_page << ")\n";
+    output() << "Rows:        " << header.row_count << "\n";
+    output() << "LSN:         " << header.commit_lsn;
+    if (header.backup_lsn) output() << " (last backup at " << header.backup_lsn << ")";
+    output() << "\n";
+    static const char* const policy_names[] = {"always", "first read", "background"};
+    output() << "Checksums:   " << checksum_name(header.checksum_algo) << ", verify "
+             << policy_names[verify_policy] << "\n";
+    if (header.bloom_pages)
+        output() << "Bloom Pages: " << header.bloom_pages << " (from Page " << header.bloom_first_page << ")\n";
+    if (in_batch)
+        output() << "Batch:       open\n";
 }
 
+// Free pages as ranges, e.g. "[Page 5-9] [Page 12]"
 void Pager::print_free_list() {
-    uint32_t pg = header.first_free_page;
-    std::cout << "Free List: ";
-    if (pg == 0) {
-        std::cout << "(empty)\n";
+    WriteOp op(*this);  // The map belongs to the writer
+    output() << "Free List: ";
+    uint32_t pg = fsm.find_free(ROOT_PAGE + 1, header.total_pages);
+    if (pg == INVALID_PAGE) {
+        output() << "(empty)\n";
         return;
     }
-    while (pg != 0) {
-        std::cout << "[Page " << pg << "]";
-        void* p = get_page(pg);
-        pg = *((uint32_t*)((char*)p + HEADER_SIZE));
-        if (pg != 0) std::cout << " -> ";
+    while (pg != INVALID_PAGE) {
+        uint32_t end = pg + 1;
+        while (end < header.total_pages && fsm.is_free(end)) end++;
+        output() << "[Page " << pg;
+        if (end - pg > 1) output() << "-" << end - 1;
+        output() << "]";
+        pg = fsm.find_free(end, header.total_pages);
+        if (pg != INVALID_PAGE) output() << " ";
     }
-    std::cout << "\n";
+    output() << "\n";
 }
 
 void Pager::print_pool_stats() {
-    std::cout << "=== Buffer Pool ===\n";
-    std::cout << "Frames:     " << pool.size() << " / " << BUFFER_POOL_SIZE << "\n";
-    std::cout << "Pinned:     " << pin_counts.size() << "\n";
-    std::cout << "Cache Hits: " << stat_hits << "\n";
-    std::cout << "Misses:     " << stat_misses << "\n";
-    std::cout << "Evictions:  " << stat_evicts << "\n";
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    uint32_t pinned = 0, dirty = 0;
+    for (const Frame& f : frames) {
+        if (f.page_num == INVALID_PAGE) continue;
+        if (f.pin_count > 0) pinned++;
+        if (f.dirty) dirty++;
+    }
+    output() << "=== Buffer Pool ===\n";
+    output() << "Frames:     " << (a1.size + am.size) << " / " << frames.size()
+              << " (A1 " << a1.size << ", Am " << am.size << ")\n";
+    output() << "Capacity:   " << ((uint64_t)frames.size() * PAGE_SIZE >> 10) << " KB ("
+              << PAGE_SIZE << "-byte pages)\n";
+    output() << "Pinned:     " << pinned << "\n";
+    output() << "Dirty:      " << dirty << "\n";
+    output() << "Cache Hits: " << stat_hits << "\n";
+    output() << "Misses:     " << stat_misses << "\n";
+    output() << "Evictions:  " << stat_evicts << "\n";
+    if (readahead > 0)
+        output() << "Prefetch:   " << stat_prefetch_issued << " issued, " << stat_prefetch_hits
+                  << " consumed" << (use_mmap ? " (madvise)" : "") << "\n";
+    if (use_mmap)
+        output() << "Mapped:     " << map_pages << " pages, " << stat_map_reads << " reads served in place\n";
+    output() << "Verified:   " << stat_verified << " inline, " << stat_verify_skips << " skipped, "
+             << stat_crc_failures << " mismatch(es)\n";
+    if (verifier.running()) {
+        uint64_t checked, failed, dropped;
+        verifier.stats(checked, failed, dropped);
+        output() << "Background: " << checked << " verified, " << dropped << " dropped, "
+                 << failed << " mismatch(es)\n";
+    }
+    if (stat_snapshot_reads > 0 || !open_snapshots.empty()) {
+        uint32_t open = 0;
+        for (const auto& s : open_snapshots) open += s.second;
+        output() << "Snapshots:  " << open << " open, " << versions_live << " page version(s) kept ("
+                 << (versions_live * PAGE_SIZE >> 10) << " KB, peak " << versions_peak << ", "
+                 << stat_versions_kept << " total), " << stat_snapshot_reads << " read(s), "
+                 << stat_version_reads << " from versions\n";
+    }
     if (stat_hits + stat_misses > 0) {
-        double ratio = (double)stat_hits / (stat_hits + stat_misses) * 100.0;
-        std::printf("Hit Ratio:  %.1f%%\n", ratio);
+        char ratio[16];
+        std::snprintf(ratio, sizeof(ratio), "%.1f%%", (double)stat_hits / (stat_hits + stat_misses) * 100.0);
+        output() << "Hit Ratio:  " << ratio << "\n";
     }
 }
+
+void Pager::print_wal_stats() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    output() << "=== Write-Ahead Log ===\n";
+    output() << "Frames:     " << wal.num_frames() << " (" << wal.num_committed() << " committed)\n";
+    output() << "Pages:      " << wal.num_pages() << " distinct\n";
+    output() << "Size:       " << wal.size_bytes() << " bytes\n";
+    output() << "Checksums:  " << checksum_name(wal.checksum_algo()) << "\n";
+    output() << "Checkpoint: at " << WAL_CHECKPOINT_FRAMES << " frames\n";
+}
@@ -1,7 +1,11 @@
 #include "parser.h"
+#include "utils.h"
 #include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <charconv>
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), pos(0) {}
+Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), pos(0), num_params(0) {}
 
 Token Parser::current_token() const {
     if (pos >= tokens.size()) return {TOKEN_EOF, ""};
@@ -20,9 +24,61 @@ bool Parser::match(TokenType expected) {
     return false;
 }
 
+// The column name "id", in any case
+bool Parser::match_id_column() {
+    std::string_view name = current_token().lexeme;
+    if (current_token().type != TOKEN_IDENTIFIER || name.size() != 2 ||
+        std::tolower((unsigned char)name[0]) != 'i' || std::tolower((unsigned char)name[1]) != 'd') {
+        return false;
+    }
+    advance();
+    return true;
+}
+
+// "username" or "email", in any case
+bool Parser::match_indexed_column(IndexColumn& column) {
+    if (current_token().type != TOKEN_IDENTIFIER || !parse_column(current_token().lexeme, column)) return false;
+    advance();
+    return true;
+}
+
+// A literal of the given type, or a ? placeholder
+bool Parser::parse_operand(TokenType literal_type, Operand& out) {
+    out = Operand();
+    if (match(TOKEN_PARAM)) {
+        out.is_param = true;
+        out.param = num_params++;
+        return true;
+    }
+    if (current_token().type != literal_type) return false;
+    out.literal = current_token().lexeme;
+    advance();
+    return true;
+}
+
+// COUNT(*) | MIN(<column>) | MAX(<column>), the function name in any case.
+// Rows have no NULLs, so COUNT(<column>) is COUNT(*).
+bool Parser::parse_aggregate(Aggregate& out) {
+    std::string_view name = current_token().lexeme;
+    if (current_token().type != TOKEN_IDENTIFIER || name.size() > 5) return false;
+    char upper[6] = {};
+    for (size_t i = 0; i < name.size(); i++) upper[i] = (char)std::toupper((unsigned char)name[i]);
+    out = Aggregate();
+    if (std::strcmp(upper, "COUNT") == 0)    out.func = AGG_COUNT;
+    else if (std::strcmp(upper, "MIN") == 0) out.func = AGG_MIN;
+    else if (std::strcmp(upper, "MAX") == 0) out.func = AGG_MAX;
+    else return false;
+    advance();
+
+    if (!match(TOKEN_LPAREN)) return false;
+    if (out.func == AGG_COUNT && match(TOKEN_ASTERISK)) return match(TOKEN_RPAREN);
+    if (match_indexed_column(out.column)) out.of_id = false;
+    else if (!match_id_column()) return false;
+    return match(TOKEN_RPAREN);
+}
+
 bool Parser::parse_insert(Statement& statement) {
     statement.type = STATEMENT_INSERT;
-    std::memset(&statement.row_to_insert, 0, sizeof(Row));
 
     // We already matched 'INSERT', so next should be 'INTO'
     if (!match(TOKEN_INTO)) return false;
@@ -33,36 +89,207 @@ bool Parser::parse_insert(Statement& statement) {
     if (!match(TOKEN_VALUES)) return false;
     if (!match(TOKEN_LPAREN)) return false;
 
-    // Parse ID (Number)
-    if (current_token().type != TOKEN_NUMBER) return false;
-    statement.row_to_insert.id = std::stoul(current_token().lexeme);
-    advance();
-
+    // ID (Number), Username (String), Email (String)
+    statement.operands.resize(3);
+    if (!parse_operand(TOKEN_NUMBER, statement.operands[0])) return false;
     if (!match(TOKEN_COMMA)) return false;
-
-    // Parse Username (String)
-    if (current_token().type != TOKEN_STRING) return false;
-    std::strncpy(statement.row_to_insert.username, current_token().lexeme.c_str(), 31);
-    advance();
-
+    if (!parse_operand(TOKEN_STRING, statement.operands[1])) return false;
     if (!match(TOKEN_COMMA)) return false;
-
-    // Parse Email (String)
-    if (current_token().type != TOKEN_STRING) return false;
-    std::strncpy(statement.row_to_insert.email, current_token().lexeme.c_str(), 254);
-    advance();
+    if (!parse_operand(TOKEN_STRING, statement.operands[2])) return false;
 
     if (!match(TOKEN_RPAREN)) return false;
 
     return true; // Successfully parsed an INSERT statement!
 }
 
+// [WHERE id = <v> | id IN (<v>, ...) | id BETWEEN <v> AND <v> | <column> = '<s>']
+bool Parser::parse_where(Statement& statement) {
+    statement.access = ACCESS_SCAN;
+    if (!match(TOKEN_WHERE)) return true;
+
+    Operand value;
+    if (match_indexed_column(statement.column)) {
+        if (!match(TOKEN_EQUALS) || !parse_operand(TOKEN_STRING, value)) return false;
+        statement.access = ACCESS_INDEX;
+        statement.operands.push_back(value);
+        return true;
+    }
+    if (!match_id_column()) return false;
+
+    if (match(TOKEN_EQUALS)) {
+        if (!parse_operand(TOKEN_NUMBER, value)) return false;
+        statement.access = ACCESS_POINTS;
+        statement.operands.push_back(value);
+        return true;
+    }
+    if (match(TOKEN_BETWEEN)) {
+        statement.access = ACCESS_RANGE;
+        if (!parse_operand(TOKEN_NUMBER, value)) return false;
+        statement.operands.push_back(value);
+        if (!match(TOKEN_AND)) return false;
+        if (!parse_operand(TOKEN_NUMBER, value)) return false;
+        statement.operands.push_back(value);
+        return true;
+    }
+
+    if (!match(TOKEN_IN)) return false;
+    if (!match(TOKEN_LPAREN)) return false;
+    statement.access = ACCESS_POINTS;
+    do {
+        if (!parse_operand(TOKEN_NUMBER, value)) return false;
+        statement.operands.push_back(value);
+    } while (match(TOKEN_COMMA));
+    return match(TOKEN_RPAREN);
+}
+
+// [ORDER BY id [ASC | DESC]] [LIMIT <v>]
+bool Parser::parse_order_limit(Statement& statement) {
+    if (match(TOKEN_ORDER)) {
+        if (!match(TOKEN_BY)) return false;
+        if (!match_id_column()) return false;
+        if (match(TOKEN_DESC)) statement.descending = true;
+        else match(TOKEN_ASC);
+    }
+    if (match(TOKEN_LIMIT)) {
+        statement.has_limit = true;
+        if (!parse_operand(TOKEN_NUMBER, statement.limit)) return false;
+    }
+    return true;
+}
+
+// SELECT * FROM <table> [WHERE ...] [ORDER BY id [ASC|DESC]] [LIMIT <n>]
+// SELECT <aggregate>, ... FROM <table> [WHERE ...]
+bool Parser::parse_select(Statement& statement) {
+    statement.type = STATEMENT_SELECT;
+
+    if (!match(TOKEN_ASTERISK)) {
+        do {
+            statement.aggregates.emplace_back();
+            if (!parse_aggregate(statement.aggregates.back())) return false;
+        } while (match(TOKEN_COMMA));
+    }
+    if (!match(TOKEN_FROM)) return false;
+    if (!match(TOKEN_IDENTIFIER)) return false;  // Single table, name ignored
+    if (!parse_where(statement)) return false;
+    return statement.aggregates.empty() ? parse_order_limit(statement) : true;  // Aggregates: one row
+}
+
+// DELETE FROM <table> WHERE ...   (the WHERE clause is required)
+bool Parser::parse_delete(Statement& statement) {
+    statement.type = STATEMENT_DELETE;
+
+    if (!match(TOKEN_FROM)) return false;
+    if (!match(TOKEN_IDENTIFIER)) return false;
+    if (current_token().type != TOKEN_WHERE) {
+        output() << "Syntax Error: DELETE requires a WHERE clause.\n";
+        return false;
+    }
+    return parse_where(statement);
+}
+
 bool Parser::parse_statement(Statement& statement) {
+    statement.reset();
+    num_params = 0;
+    bool ok;
     if (match(TOKEN_INSERT)) {
-        return parse_insert(statement);
+        ok = parse_insert(statement);
+    } else if (match(TOKEN_SELECT)) {
+        ok = parse_select(statement);
+    } else if (match(TOKEN_DELETE)) {
+        ok = parse_delete(statement);
+    } else if (match(TOKEN_BEGIN)) {
+        statement.type = STATEMENT_BEGIN;
+        ok = true;
+    } else if (match(TOKEN_COMMIT)) {
+        statement.type = STATEMENT_COMMIT;
+        ok = true;
+    } else {
+        output() << "Syntax Error: Unrecognized statement.\n";
+        return false;
     }
-    // (We will add SELECT and DELETE here later)
-    
-    std::cout << "Syntax Error: Unrecognized statement.\n";
-    return false;
-}
\ No newline at end of file
+    statement.num_params = num_params;
+    return ok && current_token().type == TOKEN_EOF;  // Nothing may trail the statement
+}
+
+// ==========================================
+// STATEMENT BINDING
+// ==========================================
+
+static bool parse_number(std::string_view text, uint64_t max, uint64_t& out) {
+    uint64_t n = 0;
+    auto res = std::from_chars(text.data(), text.data() + text.size(), n);
+    if (text.empty() || res.ec != std::errc() || res.ptr != text.data() + text.size() || n > max) return false;
+    out = n;
+    return true;
+}
+
+// Copies at most size - 1 bytes and terminates (Row fields are C strings)
+static void copy_field(char* dest, size_t size, std::string_view text) {
+    size_t len = std::min(text.size(), size - 1);
+    std::memcpy(dest, text.data(), len);
+    dest[len] = '\0';
+}
+
+void Statement::reset() {
+    type = STATEMENT_INSERT;
+    access = ACCESS_SCAN;
+    aggregates.clear();
+    operands.clear();
+    has_limit = false;
+    limit = Operand();
+    descending = false;
+    num_params = 0;
+    target_ids.clear();
+    range_start = 0;
+    range_end = UINT64_MAX;
+    row_limit = UINT64_MAX;
+}
+
+bool Statement::bind(const std::vector<std::string_view>& params, std::string& error) {
+    if (params.size() != num_params) {
+        error = "expected " + std::to_string(num_params) + " parameter(s), got " +
+                std::to_string(params.size());
+        return false;
+    }
+    auto text_of = [&](const Operand& op) -> std::string_view {
+        return op.is_param ? params[op.param] : op.literal;
+    };
+    auto number_of = [&](const Operand& op, uint64_t max, uint64_t& out) {
+        if (parse_number(text_of(op), max, out)) return true;
+        error = "'" + std::string(text_of(op)) + "' is not a valid number";
+        return false;
+    };
+    auto key_of = [&](const Operand& op, uint64_t& out) {
+        if (parse_key(text_of(op), out)) return true;
+        error = "'" + std::string(text_of(op)) + "' is not a valid key";
+        return false;
+    };
+
+    uint64_t n;
+    row_limit = UINT64_MAX;
+    if (has_limit) {
+        if (!number_of(limit, UINT64_MAX, n)) return false;
+        row_limit = n;
+    }
+
+    if (type == STATEMENT_INSERT) {
+        std::memset(&row_to_insert, 0, sizeof(Row));
+        if (!key_of(operands[0], row_to_insert.id)) return false;
+        copy_field(row_to_insert.username, sizeof(row_to_insert.username), text_of(operands[1]));
+        copy_field(row_to_insert.email, sizeof(row_to_insert.email), text_of(operands[2]));
+    } else if (access == ACCESS_POINTS) {
+        target_ids.clear();
+        for (const Operand& op : operands) {
+            if (!key_of(op, n)) return false;
+            target_ids.push_back(n);
+        }
+    } else if (access == ACCESS_RANGE) {
+        if (!key_of(operands[0], range_start) || !key_of(operands[1], range_end)) return false;
+    } else if (access == ACCESS_INDEX) {
+        match_value.assign(text_of(operands[0]));
+    } else {
+        range_start = 0;
+        range_end = UINT64_MAX;
+    }
+    return true;
+}
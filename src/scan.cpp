@@ -0,0 +1,211 @@
+#include "scan.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// ==========================================
+// PARALLEL SCAN IMPLEMENTATION
+// ==========================================
+
+ParallelScan::ParallelScan(BTree& t, const ScanOptions& options, const ScanFilter& f)
+    : tree(t), snapshot(t.pager), opts(options), filter(f) {
+    uint32_t threads = tree.pager.scan_threads;
+    std::vector<uint64_t> splits;
+    if (threads > 1 && opts.limit > 0 && opts.start <= opts.end)
+        splits = tree.split_points(opts.start, opts.end, threads * SCAN_PARTITIONS_PER_THREAD);
+
+    ScanOptions part = opts;
+    part.limit = UINT64_MAX;  // Counted by run(), after the filter
+    part.snapshot = &snapshot;
+    for (uint64_t split : splits) {
+        part.end = split - 1;
+        parts.push_back(part);
+        part.start = split;
+    }
+    part.end = opts.end;
+    parts.push_back(part);
+    if (opts.reverse) std::reverse(parts.begin(), parts.end());
+    workers = std::min<uint32_t>(threads, parts.size());
+}
+
+// visit(result, row) runs on a worker for each match; take(result, n) runs on
+// the calling thread with the range's result and how many of its matches
+// fall within the limit.  Workers claim ranges in result order, so the one
+// the merge waits for is always among the first under way.
+template <class Result, class Visit, class Take>
+void ParallelScan::run(Visit visit, Take take) {
+    size_t n = parts.size();
+    std::vector<Result> results(n);
+    std::vector<uint64_t> matched(n, 0);
+    std::vector<char> done(n, 0);
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> next{0};
+    std::atomic<bool> stop{false};
+
+    auto work = [&] {
+        std::vector<RowView> batch;
+        for (size_t p; (p = next++) < n;) {
+            RowCursor cursor(tree, parts[p]);
+            uint64_t count = 0;
+            while (count < opts.limit && !stop && cursor.next_batch(batch) > 0) {
+                for (const RowView& row : batch) {
+                    if (!filter.matches(row)) continue;
+                    visit(results[p], row);
+                    if (++count == opts.limit) break;
+                }
+            }
+            cursor.close();
+            std::lock_guard<std::mutex> lock(mutex);
+            matched[p] = count;
+            done[p] = 1;
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    if (workers > 1) {
+        for (uint32_t i = 0; i < workers; i++) threads.emplace_back(work);
+    } else {
+        work();
+    }
+    uint64_t remaining = opts.limit;
+    for (size_t p = 0; p < n; p++) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return done[p] != 0; });
+        lock.unlock();
+        uint64_t taken = std::min(matched[p], remaining);
+        if (taken > 0) take(results[p], taken);
+        results[p] = Result();  // Taken: free it while the rest are read
+        remaining -= taken;
+        if (remaining == 0) stop = true;
+    }
+    for (std::thread& t : threads) t.join();
+}
+
+// --- Rows ---
+
+namespace {
+// Formatted rows of one range; row_ends only when a limit may cut it short
+struct RowText {
+    std::string text;
+    std::vector<size_t> row_ends;
+};
+
+void append_number(std::string& out, uint64_t n) {
+    char digits[20];
+    auto res = std::to_chars(digits, digits + sizeof(digits), n);
+    out.append(digits, res.ptr - digits);
+}
+}  // namespace
+
+uint64_t ParallelScan::print() {
+    bool limited = opts.limit != UINT64_MAX;
+    uint64_t printed = 0;
+    run<RowText>(
+        [limited](RowText& part, const RowView& row) {
+            part.text.append("  (");
+            append_number(part.text, row.id);
+            part.text.append(", ").append(row.username).append(", ").append(row.email).append(")\n");
+            if (limited) part.row_ends.push_back(part.text.size());
+        },
+        [&printed](RowText& part, uint64_t n) {
+            size_t len = n < part.row_ends.size() ? part.row_ends[n - 1] : part.text.size();
+            output().write(part.text.data(), len);
+            printed += n;
+        });
+    return printed;
+}
+
+std::vector<uint64_t> ParallelScan::ids() {
+    std::vector<uint64_t> out;
+    run<std::vector<uint64_t>>(
+        [](std::vector<uint64_t>& part, const RowView& row) { part.push_back(row.id); },
+        [&out](std::vector<uint64_t>& part, uint64_t n) {
+            out.insert(out.end(), part.begin(), part.begin() + n);
+        });
+    return out;
+}
+
+// --- Aggregates ---
+
+namespace {
+// COUNT / MIN / MAX folded over the rows seen so far.  ids and texts hold one
+// slot per aggregate (MIN / MAX of the id, or of a column); both are unset
+// while count is 0.
+struct AggregateState {
+    uint64_t count = 0;
+    std::vector<uint64_t> ids;
+    std::vector<std::string> texts;
+
+    void add(const std::vector<Aggregate>& aggs, const RowView& row) {
+        if (count++ == 0) {
+            ids.assign(aggs.size(), row.id);
+            texts.resize(aggs.size());
+            for (size_t i = 0; i < aggs.size(); i++)
+                if (!aggs[i].of_id) texts[i].assign(column_value(row, aggs[i].column));
+            return;
+        }
+        for (size_t i = 0; i < aggs.size(); i++) {
+            const Aggregate& a = aggs[i];
+            if (a.func == AGG_COUNT) continue;
+            bool want_less = a.func == AGG_MIN;
+            if (a.of_id) {
+                if (want_less ? row.id < ids[i] : row.id > ids[i]) ids[i] = row.id;
+            } else {
+                std::string_view v = column_value(row, a.column);
+                int cmp = v.compare(texts[i]);
+                if (want_less ? cmp < 0 : cmp > 0) texts[i].assign(v);
+            }
+        }
+    }
+
+    void merge(const std::vector<Aggregate>& aggs, const AggregateState& other) {
+        if (other.count == 0) return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        count += other.count;
+        for (size_t i = 0; i < aggs.size(); i++) {
+            if (aggs[i].func == AGG_COUNT) continue;
+            bool want_less = aggs[i].func == AGG_MIN;
+            if (aggs[i].of_id) {
+                ids[i] = want_less ? std::min(ids[i], other.ids[i]) : std::max(ids[i], other.ids[i]);
+            } else if (want_less ? other.texts[i] < texts[i] : other.texts[i] > texts[i]) {
+                texts[i] = other.texts[i];
+            }
+        }
+    }
+
+    void print(const std::vector<Aggregate>& aggs) const {
+        OutputBuffer out;
+        out << "  (";
+        for (size_t i = 0; i < aggs.size(); i++) {
+            if (i > 0) out << ", ";
+            if (aggs[i].func == AGG_COUNT) out << count;
+            else if (count == 0)           out << "NULL";
+            else if (aggs[i].of_id)        out << ids[i];
+            else                           out << std::string_view(texts[i]);
+        }
+        out << ")\n";
+    }
+};
+}  // namespace
+
+void ParallelScan::print_aggregates(const std::vector<Aggregate>& aggregates) {
+    AggregateState total;
+    run<AggregateState>(
+        [&aggregates](AggregateState& part, const RowView& row) { part.add(aggregates, row); },
+        [&](AggregateState& part, uint64_t) { total.merge(aggregates, part); });
+    total.print(aggregates);
+}
+
+void print_aggregates(const std::vector<Aggregate>& aggregates, const std::vector<Row>& rows) {
+    AggregateState total;
+    for (const Row& row : rows) total.add(aggregates, RowView{row.id, row.username, row.email});
+    total.print(aggregates);
+}
@@ -0,0 +1,234 @@
+#include "server.h"
+#include "commands.h"
+#include "utils.h"
+#include "metrics.h"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// ==========================================
+// SERVER IMPLEMENTATION
+// ==========================================
+
+static Server* signal_target = nullptr;
+
+static void on_stop_signal(int) {
+    if (signal_target) signal_target->stop();
+}
+
+static bool send_full(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+Server::Server(BTree& t, Pager& p) : tree(t), pager(p) {
+    if (::pipe(wake_pipe) != 0) {
+        std::cerr << "ERROR: Cannot create server wake-up pipe.\n";
+        std::exit(1);
+    }
+    ::fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+}
+
+Server::~Server() {
+    if (listen_fd >= 0) ::close(listen_fd);
+    if (!unix_path.empty()) ::unlink(unix_path.c_str());
+    ::close(wake_pipe[0]);
+    ::close(wake_pipe[1]);
+}
+
+bool Server::listen_tcp(const std::string& host, uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "ERROR: Invalid listen address " << host << "\n";
+        return false;
+    }
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (listen_fd < 0 || ::bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        ::listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "ERROR: Cannot listen on " << host << ":" << port << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    std::cout << "ForgeDB listening on " << host << ":" << port << "\n" << std::flush;
+    return true;
+}
+
+bool Server::listen_unix(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "ERROR: Socket path too long: " << path << "\n";
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());  // Stale socket from an earlier run
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || ::bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        ::listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "ERROR: Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    unix_path = path;
+    std::cout << "ForgeDB listening on " << path << "\n" << std::flush;
+    return true;
+}
+
+void Server::stop() {
+    char byte = 0;
+    ssize_t ignored = ::write(wake_pipe[1], &byte, 1);
+    (void)ignored;
+}
+
+void Server::run() {
+    signal_target = this;
+    struct sigaction sa{};
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+
+    pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+    while (true) {
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // No-op on Unix sockets
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex);
+            conn_fds.insert(fd);
+        }
+        std::thread(&Server::serve_connection, this, fd).detach();
+    }
+
+    // Wake every connection blocked in recv() and wait for them to finish
+    std::unique_lock<std::mutex> lock(conn_mutex);
+    for (int fd : conn_fds) ::shutdown(fd, SHUT_RDWR);
+    conn_cv.wait(lock, [this] { return conn_fds.empty(); });
+    signal_target = nullptr;
+}
+
+// One HTTP/1.0 exchange: GET /metrics is answered with the Prometheus text
+// format, anything else with 404.  The caller closes the connection.
+static void serve_http(int fd, const std::string& request) {
+    std::string path = request.substr(4, request.find(' ', 4) - 4);
+    std::string body;
+    std::string status = "200 OK";
+    if (path == "/metrics") {
+        std::ostringstream out;
+        write_prometheus(out);
+        body = out.str();
+    } else {
+        status = "404 Not Found";
+        body = "Not found: try /metrics\n";
+    }
+    std::string reply = "HTTP/1.0 " + status + "\r\n"
+                        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                        "Connection: close\r\n\r\n" + body;
+    send_full(fd, reply);
+}
+
+void Server::serve_connection(int fd) {
+    std::unique_lock<std::mutex> session(write_session, std::defer_lock);
+    std::string pending;   // Bytes received but not yet a complete line
+    std::string response;  // Frames for every command of the current read
+    std::vector<char> chunk(SERVER_READ_CHUNK);
+    bool open = true;
+    bool first_line = true;
+
+    while (open) {
+        ssize_t n = ::recv(fd, chunk.data(), chunk.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pending.append(chunk.data(), n);
+
+        // A scraper rather than a client: wait for the whole header (so
+        // closing does not reset the connection under the reply), answer, hang up
+        if (first_line && pending.compare(0, 4, "GET ") == 0) {
+            bool complete = pending.find("\r\n\r\n") != std::string::npos ||
+                            pending.find("\n\n") != std::string::npos;
+            if (!complete && pending.size() <= SERVER_MAX_LINE) continue;
+            serve_http(fd, pending);
+            break;
+        }
+
+        size_t start = 0, newline;
+        while (open && (newline = pending.find('\n', start)) != std::string::npos) {
+            std::string line = pending.substr(start, newline - start);
+            start = newline + 1;
+            first_line = false;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            if (line == "exit") open = false;
+            else run_command(line, response, session);
+        }
+        pending.erase(0, start);
+
+        if (!response.empty() && !send_full(fd, response)) break;
+        response.clear();
+        if (pending.size() > SERVER_MAX_LINE) break;
+    }
+
+    // Never leave another connection waiting on a half-done batch
+    if (session.owns_lock() && pager.in_batch) {
+        std::ostringstream discard;
+        OutputCapture capture(discard);
+        tree.commit_batch();
+    }
+    if (session.owns_lock()) session.unlock();
+
+    // Forgotten before it is closed: once closed, accept() may hand the same
+    // number to a new connection, which must stay in conn_fds
+    std::lock_guard<std::mutex> lock(conn_mutex);
+    conn_fds.erase(fd);
+    ::close(fd);
+    conn_cv.notify_all();
+}
+
+// Executes one command with its output captured, and appends its frame
+void Server::run_command(const std::string& line, std::string& response,
+                         std::unique_lock<std::mutex>& session) {
+    std::ostringstream buf;
+    {
+        OutputCapture capture(buf);
+        if (is_read_command(line) || is_stepwise_command(line)) {
+            handle_command(line, tree, pager);
+        } else {
+            if (!session.owns_lock()) session.lock();
+            handle_command(line, tree, pager);
+            if (!pager.in_batch) session.unlock();
+        }
+    }
+    std::string text = buf.str();
+    response += std::to_string(text.size());
+    response += '\n';
+    response += text;
+}
@@ -1,12 +1,12 @@
 #include "tokenizer.h"
+#include "utils.h"
 #include <cctype>
-#include <unordered_map>
 
 void Token::debug_print() const {
-    std::cout << "<Type: " << type << ", Val: \"" << lexeme << "\">\n";
+    output() << "<Type: " << type << ", Val: \"" << lexeme << "\">\n";
 }
 
-Tokenizer::Tokenizer(const std::string& query) : input(query), pos(0) {}
+Tokenizer::Tokenizer(std::string_view query) : input(query), pos(0) {}
 
 char Tokenizer::current_char() const {
     if (pos >= input.length()) return '\0';
@@ -16,79 +16,113 @@ char Tokenizer::current_char() const {
 void Tokenizer::advance() { pos++; }
 
 void Tokenizer::skip_whitespace() {
-    while (std::isspace(current_char())) advance();
+    while (std::isspace((unsigned char)current_char())) advance();
 }
 
-Token Tokenizer::read_identifier_or_keyword() {
-    std::string result;
-    while (std::isalnum(current_char()) || current_char() == '_') {
-        result += current_char();
-        advance();
+// Case-insensitive compare against an upper-case keyword of the same length
+static bool is_keyword(std::string_view word, const char* keyword) {
+    for (size_t i = 0; i < word.size(); i++) {
+        if (std::toupper((unsigned char)word[i]) != keyword[i]) return false;
     }
-    
-    // Convert to uppercase for case-insensitive keyword matching
-    std::string upper_res = result;
-    for (auto &c : upper_res) c = std::toupper(c);
+    return true;
+}
 
-    if (upper_res == "SELECT") return {TOKEN_SELECT, result};
-    if (upper_res == "INSERT") return {TOKEN_INSERT, result};
-    if (upper_res == "DELETE") return {TOKEN_DELETE, result};
-    if (upper_res == "VALUES") return {TOKEN_VALUES, result};
-    if (upper_res == "FROM")   return {TOKEN_FROM, result};
-    if (upper_res == "WHERE")  return {TOKEN_WHERE, result};
-    if (upper_res == "INTO")   return {TOKEN_INTO, result};
+// Length and first letter pick the only candidate keyword (at most two per
+// pair), so recognizing a word costs one switch and one compare
+static TokenType keyword_type(std::string_view word) {
+    char first = word.empty() ? '\0' : (char)std::toupper((unsigned char)word[0]);
+    const char* candidate = nullptr;
+    TokenType type = TOKEN_IDENTIFIER;
+    switch (word.size()) {
+        case 2:
+            if (first == 'I')      { candidate = "IN";      type = TOKEN_IN; }
+            else if (first == 'B') { candidate = "BY";      type = TOKEN_BY; }
+            break;
+        case 3:
+            if (first != 'A') break;
+            if (std::toupper((unsigned char)word[1]) == 'N') { candidate = "AND"; type = TOKEN_AND; }
+            else                                             { candidate = "ASC"; type = TOKEN_ASC; }
+            break;
+        case 4:
+            if (first == 'F')      { candidate = "FROM";    type = TOKEN_FROM; }
+            else if (first == 'I') { candidate = "INTO";    type = TOKEN_INTO; }
+            else if (first == 'D') { candidate = "DESC";    type = TOKEN_DESC; }
+            break;
+        case 5:
+            if (first == 'W')      { candidate = "WHERE";   type = TOKEN_WHERE; }
+            else if (first == 'B') { candidate = "BEGIN";   type = TOKEN_BEGIN; }
+            else if (first == 'O') { candidate = "ORDER";   type = TOKEN_ORDER; }
+            else if (first == 'L') { candidate = "LIMIT";   type = TOKEN_LIMIT; }
+            break;
+        case 6:
+            if (first == 'S')      { candidate = "SELECT";  type = TOKEN_SELECT; }
+            else if (first == 'I') { candidate = "INSERT";  type = TOKEN_INSERT; }
+            else if (first == 'D') { candidate = "DELETE";  type = TOKEN_DELETE; }
+            else if (first == 'V') { candidate = "VALUES";  type = TOKEN_VALUES; }
+            else if (first == 'C') { candidate = "COMMIT";  type = TOKEN_COMMIT; }
+            break;
+        case 7:
+            if (first == 'B')      { candidate = "BETWEEN"; type = TOKEN_BETWEEN; }
+            break;
+    }
+    return candidate && is_keyword(word, candidate) ? type : TOKEN_IDENTIFIER;
+}
 
-    return {TOKEN_IDENTIFIER, result};
+Token Tokenizer::read_identifier_or_keyword() {
+    size_t start = pos;
+    while (std::isalnum((unsigned char)current_char()) || current_char() == '_') advance();
+    std::string_view word = input.substr(start, pos - start);
+    return {keyword_type(word), word};
 }
 
+// Also a composite key, "hi:lo"
 Token Tokenizer::read_number() {
-    std::string result;
-    while (std::isdigit(current_char())) {
-        result += current_char();
+    size_t start = pos;
+    while (std::isdigit((unsigned char)current_char())) advance();
+    if (current_char() == ':' && pos + 1 < input.length() && std::isdigit((unsigned char)input[pos + 1])) {
         advance();
+        while (std::isdigit((unsigned char)current_char())) advance();
     }
-    return {TOKEN_NUMBER, result};
+    return {TOKEN_NUMBER, input.substr(start, pos - start)};
 }
 
 Token Tokenizer::read_string() {
-    std::string result;
     advance(); // Skip opening quote
-    while (current_char() != '\0' && current_char() != '\'') {
-        result += current_char();
-        advance();
-    }
+    size_t start = pos;
+    while (current_char() != '\0' && current_char() != '\'') advance();
+    std::string_view text = input.substr(start, pos - start);
     if (current_char() == '\'') advance(); // Skip closing quote
-    return {TOKEN_STRING, result};
+    return {TOKEN_STRING, text};
 }
 
-std::vector<Token> Tokenizer::tokenize() {
-    std::vector<Token> tokens;
+void Tokenizer::tokenize(std::vector<Token>& tokens) {
+    tokens.clear();
     skip_whitespace();
     
     while (current_char() != '\0') {
         char c = current_char();
         
-        if (std::isalpha(c)) {
+        if (std::isalpha((unsigned char)c)) {
             tokens.push_back(read_identifier_or_keyword());
-        } else if (std::isdigit(c)) {
+        } else if (std::isdigit((unsigned char)c)) {
             tokens.push_back(read_number());
         } else if (c == '\'') {
             tokens.push_back(read_string());
         } else {
+            TokenType type;
             switch (c) {
-                case '*': tokens.push_back({TOKEN_ASTERISK, "*"}); advance(); break;
-                case ',': tokens.push_back({TOKEN_COMMA, ","}); advance(); break;
-                case '(': tokens.push_back({TOKEN_LPAREN, "("}); advance(); break;
-                case ')': tokens.push_back({TOKEN_RPAREN, ")"}); advance(); break;
-                case '=': tokens.push_back({TOKEN_EQUALS, "="}); advance(); break;
-                default:
-                    tokens.push_back({TOKEN_ILLEGAL, std::string(1, c)});
-                    advance();
-                    break;
+                case '*': type = TOKEN_ASTERISK; break;
+                case ',': type = TOKEN_COMMA;    break;
+                case '(': type = TOKEN_LPAREN;   break;
+                case ')': type = TOKEN_RPAREN;   break;
+                case '=': type = TOKEN_EQUALS;   break;
+                case '?': type = TOKEN_PARAM;    break;
+                default:  type = TOKEN_ILLEGAL;  break;
             }
+            tokens.push_back({type, input.substr(pos, 1)});
+            advance();
         }
         skip_whitespace();
     }
-    tokens.push_back({TOKEN_EOF, ""});
-    return tokens;
-}
\ No newline at end of file
+    tokens.push_back({TOKEN_EOF, std::string_view()});
+}
@@ -0,0 +1,224 @@
+#include "vacuum.h"
+#include <algorithm>
+#include <thread>
+
+// ==========================================
+// VACUUM IMPLEMENTATION
+// ==========================================
+// Every helper runs inside step(), with the tree held exclusively, so pages
+// are read with plain get_page() calls and no latches.  The operation does
+// not pin what it touches: each page pointer is used before the next fetch.
+
+Vacuum::Vacuum(BTree& t) : tree(t), pager(t.pager) {}
+
+bool Vacuum::step() {
+    if (phase == DONE) return false;
+    tree.wait_for_bloom_load();  // The bloom run can only move once the filter is attached
+    WriteOp op(pager, false);
+    BTree::LatchScope latched{tree};
+    tree.latch_for_write(tree.root_page_num);
+    pager.wait_for_readers(1);  // Only the root latch is ours
+    if (st.steps++ == 0) st.pages_before = pager.header.total_pages;
+
+    uint32_t budget = VACUUM_STEP_PAGES;
+    if (phase == CLUSTER) cluster(budget);
+    if (phase == COMPACT && budget > 0) compact(budget);
+    if (phase == TRUNCATE && budget > 0) {
+        pager.truncate_free_tail();  // Not inside a batch: a later vacuum cuts the tail
+        phase = DONE;
+    }
+    st.pages_after = pager.header.total_pages;
+    if (!pager.in_batch) pager.commit();  // An open batch commits it with its own pages
+    return phase != DONE;
+}
+
+void Vacuum::run(uint32_t max_steps) {
+    for (uint32_t i = 0; i < max_steps && step(); i++) std::this_thread::yield();
+}
+
+// --- CLUSTER: leaves to pages 2, 3, ... in key order ---
+
+void Vacuum::cluster(uint32_t& budget) {
+    if (Node(pager.get_page(tree.root_page_num)).get_type() == NODE_LEAF) {
+        phase = COMPACT;  // A single leaf: the root, which never moves
+        return;
+    }
+    uint32_t leaf = leaf_for(next_key, tree.root_page_num);
+    if (leaf == target - 1 && target > ROOT_PAGE + 1) {
+        // Placed by the last step, and has since taken in the next leaf's keys
+        leaf = LeafNode(pager.get_page(leaf)).get_next_leaf();
+    }
+    while (leaf != 0 && budget > 0) {
+        budget--;
+        if (leaf != target) {
+            if (!make_room(target, budget) || !move_tree_page(leaf, target)) break;
+            budget -= std::min(budget, 1u);
+            leaf = target;
+        }
+        st.leaves_in_order++;
+        target++;
+        leaf = LeafNode(pager.get_page(leaf)).get_next_leaf();
+        if (leaf != 0 && !first_key(leaf, next_key)) break;
+    }
+    if (leaf == 0 || budget > 0) phase = COMPACT;  // Done, or a page that cannot move
+}
+
+// Frees pg for the next leaf.  What sits there goes to a free page past the
+// live pages (they all fit below `live` once compacted), so it moves at most
+// once more, when COMPACT pulls it down.
+bool Vacuum::make_room(uint32_t pg, uint32_t& budget) {
+    const DbHeader& h = pager.header;
+    uint32_t live = h.total_pages - h.free_pages - h.bloom_pages - h.fsm_pages;
+    uint32_t above = std::max(pg + 1, live);
+    uint32_t first, count;
+    if (in_run(pg, first, count)) {
+        if (!move_run(pg, above, INVALID_PAGE)) return false;
+        budget -= std::min(budget, count);
+        return true;
+    }
+    if (pg >= h.total_pages || pager.fsm.is_free(pg)) return true;
+    uint32_t dest = pager.fsm.find_free(above, h.total_pages);
+    if (!move_tree_page(pg, dest == INVALID_PAGE ? h.total_pages : dest)) return false;
+    budget -= std::min(budget, 1u);
+    return true;
+}
+
+// --- COMPACT: live pages from the top into the lowest holes ---
+
+void Vacuum::compact(uint32_t& budget) {
+    uint32_t total = pager.header.total_pages;
+    if (scan_top >= total) scan_top = total - 1;
+    while (budget > 0 && scan_top > ROOT_PAGE) {
+        uint32_t pg = scan_top;
+        uint32_t hole = pager.fsm.find_free(ROOT_PAGE + 1, pg);
+        if (hole == INVALID_PAGE) break;  // Everything below is live
+        uint32_t first, count;
+        if (pager.fsm.is_free(pg)) {
+            scan_top--;
+            continue;
+        }
+        budget--;
+        if (in_run(pg, first, count)) {
+            if (move_run(pg, ROOT_PAGE + 1, first)) budget -= std::min(budget, count);
+            scan_top = first - 1;
+        } else {
+            move_tree_page(pg, hole);  // An unreachable page stays where it is
+            scan_top--;
+        }
+    }
+    if (budget > 0) phase = TRUNCATE;
+}
+
+// --- Page moves ---
+
+// The page is looked for in the table, then in each index.  An index root
+// has no parent: the header points at it.
+bool Vacuum::move_tree_page(uint32_t from, uint32_t to) {
+    if (from <= ROOT_PAGE) return false;
+    for (uint32_t& root : pager.header.index_roots) {
+        if (root != from) continue;
+        pager.move_page(from, to);
+        root = to;
+        st.pages_moved++;
+        return true;
+    }
+    uint64_t key;
+    if (!first_key(from, key)) return false;
+    bool is_leaf = Node(pager.get_page(from)).get_type() == NODE_LEAF;
+
+    // Parent slot pointing at it; for a leaf also the separator below it
+    uint32_t parent = 0, idx = 0, root = tree.root_page_num;
+    uint64_t fence = 0;
+    for (uint32_t t = 0; parent == 0 && t <= INDEX_COLUMNS; t++) {
+        root = t == 0 ? tree.root_page_num : pager.header.index_roots[t - 1];
+        fence = 0;
+        for (uint32_t node = root; root != 0 && node != from;) {
+            void* raw = pager.get_page(node);
+            if (Node(raw).get_type() != NODE_INTERNAL) {  // Not where its key leads
+                parent = 0;
+                break;
+            }
+            InternalNode internal(raw);
+            idx = internal.child_index_for(key);
+            if (idx > 0) fence = internal.get_key(idx - 1);
+            parent = node;
+            node = internal.get_child(idx);
+        }
+    }
+    if (parent == 0) return false;
+    // The leaf before it covers fence - 1 (no fence: it is the leftmost)
+    uint32_t prev = 0;
+    if (is_leaf && fence != 0) {
+        prev = leaf_for(fence - 1, root);
+        if (LeafNode(pager.get_page(prev)).get_next_leaf() != from) return false;
+    }
+
+    pager.move_page(from, to);
+    InternalNode parent_node(pager.get_page(parent));
+    pager.mark_dirty(parent);
+    parent_node.set_child(idx, to);
+    if (prev != 0) {
+        LeafNode prev_leaf(pager.get_page(prev));
+        pager.mark_dirty(prev);
+        prev_leaf.set_next_leaf(to);
+    }
+    st.pages_moved++;
+    return true;
+}
+
+// The bloom run only moves while the filter is attached: before that it is
+// still being read (or about to be replaced by a rebuild).
+bool Vacuum::move_run(uint32_t pg, uint32_t from, uint32_t below) {
+    DbHeader& h = pager.header;
+    if (h.fsm_pages && pg >= h.fsm_first_page && pg < h.fsm_first_page + h.fsm_pages) {
+        if (!pager.move_fsm(from, below)) return false;
+    } else {
+        if (!tree.bloom.attached()) return false;
+        uint32_t first = pager.allocate_run(h.bloom_pages, from, below);
+        if (first == INVALID_PAGE) return false;
+        pager.free_run(h.bloom_first_page, h.bloom_pages);
+        tree.bloom.move_to(first);
+        h.bloom_first_page = first;
+    }
+    st.runs_moved++;
+    return true;
+}
+
+bool Vacuum::in_run(uint32_t pg, uint32_t& first, uint32_t& count) const {
+    const DbHeader& h = pager.header;
+    if (h.fsm_pages && pg >= h.fsm_first_page && pg < h.fsm_first_page + h.fsm_pages) {
+        first = h.fsm_first_page;
+        count = h.fsm_pages;
+        return true;
+    }
+    if (h.bloom_pages && pg >= h.bloom_first_page && pg < h.bloom_first_page + h.bloom_pages) {
+        first = h.bloom_first_page;
+        count = h.bloom_pages;
+        return true;
+    }
+    return false;
+}
+
+// Non-root leaves and internal nodes are never empty
+bool Vacuum::first_key(uint32_t pg, uint64_t& key) {
+    void* raw = pager.get_page(pg);
+    uint8_t type = Node(raw).get_type();
+    if (type == NODE_LEAF && LeafNode(raw).get_num_cells() > 0) {
+        key = LeafNode(raw).get_key(0);
+        return true;
+    }
+    if (type == NODE_INTERNAL && InternalNode(raw).get_num_keys() > 0) {
+        key = InternalNode(raw).get_key(0);
+        return true;
+    }
+    return false;
+}
+
+uint32_t Vacuum::leaf_for(uint64_t key, uint32_t root) {
+    uint32_t node = root;
+    while (true) {
+        void* raw = pager.get_page(node);
+        if (Node(raw).get_type() != NODE_INTERNAL) return node;
+        node = InternalNode(raw).find_child(key);
+    }
+}
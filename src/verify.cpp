@@ -0,0 +1,76 @@
+#include "verify.h"
+#include <cstdlib>
+
+// ==========================================
+// PAGE VERIFIER IMPLEMENTATION
+// ==========================================
+
+PageVerifier::~PageVerifier() {
+    stop();
+}
+
+void PageVerifier::start(uint32_t num_slots, std::function<bool(uint32_t, void*)> check_fn) {
+    if (running() || num_slots == 0) return;
+    buffers = (uint8_t*)std::aligned_alloc(PAGE_SIZE, (size_t)num_slots * PAGE_SIZE);
+    if (!buffers) return;
+    check = std::move(check_fn);
+    slot_pages.assign(num_slots, 0);
+    free_slots.clear();
+    for (uint32_t i = num_slots; i > 0; i--) free_slots.push_back(i - 1);
+    stopping = false;
+    worker = std::thread(&PageVerifier::worker_loop, this);
+}
+
+void PageVerifier::stop() {
+    if (!running()) return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    worker.join();
+    queue.clear();
+    std::free(buffers);
+    buffers = nullptr;
+}
+
+void PageVerifier::worker_loop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        work_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;  // Stopping with nothing left to check
+        uint32_t idx = queue.front();
+        queue.pop_front();
+
+        lock.unlock();
+        bool ok = check(slot_pages[idx], slot_data(idx));
+        lock.lock();
+
+        stat_checked++;
+        if (!ok) stat_failed++;
+        free_slots.push_back(idx);
+    }
+}
+
+bool PageVerifier::submit(uint32_t page_num, const void* image) {
+    if (!running()) return false;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (free_slots.empty()) {
+        stat_dropped++;
+        return false;
+    }
+    uint32_t idx = free_slots.back();
+    free_slots.pop_back();
+    slot_pages[idx] = page_num;
+    std::memcpy(slot_data(idx), image, PAGE_SIZE);
+    queue.push_back(idx);
+    work_cv.notify_one();
+    return true;
+}
+
+void PageVerifier::stats(uint64_t& checked, uint64_t& failed, uint64_t& dropped) {
+    std::lock_guard<std::mutex> lock(mtx);
+    checked = stat_checked;
+    failed = stat_failed;
+    dropped = stat_dropped;
+}
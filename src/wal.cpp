@@ -0,0 +1,186 @@
+#include "wal.h"
+#include "utils.h"
+#include "metrics.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// ==========================================
+// WAL IMPLEMENTATION
+// ==========================================
+
+static const uint32_t WAL_FRAME_HEADER_SIZE = sizeof(WalFrameHeader);
+
+static uint32_t frame_crc(uint32_t algo, const WalFrameHeader& fh, const void* image) {
+    WalFrameHeader tmp = fh;
+    tmp.crc = 0;
+    uint32_t crc = checksum_compute(algo, (const uint8_t*)&tmp, WAL_FRAME_HEADER_SIZE);
+    return checksum_compute(algo, (const uint8_t*)image, PAGE_SIZE, crc);
+}
+
+Wal::~Wal() {
+    if (fd >= 0) ::close(fd);
+}
+
+void Wal::open(const std::string& path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: Cannot open write-ahead log " << path << ".\n";
+        std::exit(1);
+    }
+    recover();
+}
+
+void Wal::write_file_header() {
+    if (!pwrite_full(fd, &file_header, sizeof(WalFileHeader), 0)) {
+        std::cerr << "ERROR: WAL header write failed.\n";
+        std::exit(1);
+    }
+}
+
+// --- Recovery: keep every frame up to the last valid commit frame ---
+
+void Wal::recover() {
+    struct stat st;
+    ::fstat(fd, &st);
+    uint64_t file_size = st.st_size;
+
+    index.clear();
+    frame_count = commit_count = 0;
+
+    if (file_size < sizeof(WalFileHeader) ||
+        !pread_full(fd, &file_header, sizeof(WalFileHeader), 0) ||
+        file_header.magic != WAL_MAGIC) {
+        // Fresh (or unrecognisable) log — start a new one
+        if (file_size >= sizeof(WalFileHeader))
+            std::cerr << "WARNING: Discarding unrecognised write-ahead log.\n";
+        file_header = {WAL_MAGIC, PAGE_SIZE, 1, CHECKSUM_CRC32C};
+        if (::ftruncate(fd, 0) != 0)
+            std::cerr << "WARNING: Could not truncate write-ahead log.\n";
+        write_file_header();
+        end_offset = sizeof(WalFileHeader);
+        return;
+    }
+    if (file_header.page_size != PAGE_SIZE) {
+        std::cerr << "ERROR: Write-ahead log page size " << file_header.page_size
+                  << " does not match database page size " << PAGE_SIZE << ".\n";
+        std::exit(1);
+    }
+    if (file_header.checksum_algo > CHECKSUM_CRC32C) {
+        std::cerr << "ERROR: Write-ahead log uses unknown checksum algorithm "
+                  << file_header.checksum_algo << ".\n";
+        std::exit(1);
+    }
+
+    const uint64_t frame_size = WAL_FRAME_HEADER_SIZE + PAGE_SIZE;
+    std::vector<uint8_t> buf(frame_size);
+    std::unordered_map<uint32_t, uint64_t> pending;
+    uint32_t scanned = 0;
+    uint64_t off = sizeof(WalFileHeader);
+    uint64_t committed_end = off;
+
+    while (off + frame_size <= file_size) {
+        if (!pread_full(fd, buf.data(), frame_size, off)) break;
+        WalFrameHeader fh;
+        std::memcpy(&fh, buf.data(), WAL_FRAME_HEADER_SIZE);
+        if (fh.salt != file_header.salt ||
+            fh.crc != frame_crc(file_header.checksum_algo, fh, buf.data() + WAL_FRAME_HEADER_SIZE)) break;
+
+        pending[fh.page_num] = off;
+        scanned++;
+        off += frame_size;
+
+        if (fh.commit_pages != 0) {
+            for (auto& [pg, o] : pending) index[pg] = o;
+            pending.clear();
+            commit_count = scanned;
+            committed_end = off;
+        }
+    }
+
+    // Drop the torn / uncommitted tail
+    frame_count = synced_target = commit_count;
+    end_offset = committed_end;
+    if (end_offset < file_size && ::ftruncate(fd, end_offset) != 0) {
+        std::cerr << "WARNING: Could not truncate uncommitted WAL tail.\n";
+    }
+}
+
+// --- Frame I/O ---
+
+void Wal::append(const std::vector<std::pair<uint32_t, const void*>>& pages,
+                 uint32_t commit_pages) {
+    if (pages.empty()) return;
+
+    const uint64_t frame_size = WAL_FRAME_HEADER_SIZE + PAGE_SIZE;
+    std::vector<uint8_t> buf(frame_size * pages.size());
+    for (size_t i = 0; i < pages.size(); i++) {
+        uint8_t* dst = buf.data() + i * frame_size;
+        bool last = (i + 1 == pages.size());
+        WalFrameHeader fh = {pages[i].first, last ? commit_pages : 0, file_header.salt, 0};
+        std::memcpy(dst + WAL_FRAME_HEADER_SIZE, pages[i].second, PAGE_SIZE);
+        fh.crc = frame_crc(file_header.checksum_algo, fh, dst + WAL_FRAME_HEADER_SIZE);
+        std::memcpy(dst, &fh, WAL_FRAME_HEADER_SIZE);
+    }
+
+    if (!pwrite_full(fd, buf.data(), buf.size(), end_offset)) {
+        std::cerr << "ERROR: WAL append failed.\n";
+        std::exit(1);
+    }
+    for (size_t i = 0; i < pages.size(); i++)
+        index[pages[i].first] = end_offset + i * frame_size;
+    end_offset += buf.size();
+    frame_count += pages.size();
+
+    if (commit_pages != 0) synced_target = frame_count;
+}
+
+// One fsync per commit group.  Called without the Pager's pool mutex, so
+// readers keep evicting into the log while the commit waits on the disk;
+// commit_count is published with a release store for num_committed().
+void Wal::sync() {
+    METRIC_TIMER(HIST_SYNC_NS);
+    if (::fdatasync(fd) != 0) {
+        std::cerr << "ERROR: WAL fsync failed.\n";
+        std::exit(1);
+    }
+    commit_count.store(synced_target, std::memory_order_release);
+}
+
+bool Wal::lookup(uint32_t page_num, uint64_t& offset) const {
+    auto it = index.find(page_num);
+    if (it == index.end()) return false;
+    offset = it->second;
+    return true;
+}
+
+void Wal::read_frame(uint64_t offset, void* dest) const {
+    if (!pread_full(fd, dest, PAGE_SIZE, offset + WAL_FRAME_HEADER_SIZE)) {
+        std::cerr << "ERROR: WAL read failed at offset " << offset << ".\n";
+        std::exit(1);
+    }
+}
+
+// --- Checkpoint support ---
+
+std::vector<std::pair<uint32_t, uint64_t>> Wal::checkpoint_list() const {
+    std::vector<std::pair<uint32_t, uint64_t>> list(index.begin(), index.end());
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+void Wal::reset() {
+    file_header.salt++;
+    file_header.checksum_algo = CHECKSUM_CRC32C;  // The log is empty: an older one switches here
+    if (::ftruncate(fd, sizeof(WalFileHeader)) != 0) {
+        std::cerr << "WARNING: Could not truncate write-ahead log.\n";
+    }
+    write_file_header();
+    ::fdatasync(fd);
+    index.clear();
+    frame_count = commit_count = synced_target = 0;
+    end_offset = sizeof(WalFileHeader);
+}
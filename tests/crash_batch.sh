@@ -0,0 +1,31 @@
+#!/bin/sh
+# A batch killed after a .checkpoint inside it must leave nothing behind:
+# begin, two inserts, .checkpoint (refused), kill -9, reopen.
+# Usage: tests/crash_batch.sh [path/to/forgedb]   (run by `make test`)
+set -e
+BIN=$(cd "$(dirname "${1:-./forgedb}")" && pwd)/$(basename "${1:-./forgedb}")
+DIR=$(mktemp -d)
+trap 'kill -9 $PID 2>/dev/null || true; rm -rf "$DIR"' EXIT
+cd "$DIR"
+
+mkfifo in
+"$BIN" < in > out 2>&1 &
+PID=$!
+exec 3> in
+printf 'begin\ninsert 1 alice a@x.com\ninsert 2 bob b@x.com\n.checkpoint\n' >&3
+for _ in $(seq 50); do
+    grep -q "checkpoint inside a batch" out && break
+    sleep 0.1
+done
+kill -9 $PID
+wait $PID 2>/dev/null || true
+exec 3>&-
+
+if ! grep -q "checkpoint inside a batch" out; then
+    echo "FAIL: .checkpoint was not refused inside a batch"; cat out; exit 1
+fi
+ROWS=$(echo select | "$BIN" --script - 2>/dev/null | grep -c '^  (' || true)
+if [ "$ROWS" -ne 0 ]; then
+    echo "FAIL: $ROWS row(s) of the killed batch survived"; exit 1
+fi
+echo "PASS: crash_batch"